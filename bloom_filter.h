@@ -0,0 +1,192 @@
+/* BLOCKED BLOOM FILTER */
+
+#ifndef bloom_filter_h
+#define bloom_filter_h
+#include "wrappers.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ answers "definitely not there" or "maybe there". put in front of a table or graph whose
+ lookups mostly miss, a definite miss costs ONE cache line instead of a chain/list walk.
+
+ blocked: the high half of an item's hash picks one 512-bit block (one cache line), all k bits
+ of the item are set inside that block. a probe builds the k-bit mask for the block and checks
+ (block & mask) == mask in one pass over the 8 words (two 256-bit ops with AVX2).
+ sized from the target false-positive rate p: bits/item = -ln p / ln^2 2, k = bits/item * ln 2.
+ keeping the bits in one line costs a little accuracy, the sizing adds BLOOM_SLACK for it.
+
+ items are given as 64-bit hashes (bloom_hash_int/bloom_hash_bytes or the caller's own), so
+ one filter serves int keys and arbitrary satellites alike. no deletes: a deleted item only
+ stays a false positive until the filter is rebuilt.
+ */
+#define BLOOM_BLOCK_BITS 512
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS/64)
+#define BLOOM_MAX_K 16
+#define BLOOM_SLACK 1.1 //extra bits per item to make up for blocking
+#define BLOOM_PREFETCH_DIST 8 //bulk adds prefetch this many items ahead
+
+typedef struct bloom_block
+{
+    _Alignas(CACHE_LINE_SIZE) uint64_t words[BLOOM_BLOCK_WORDS];
+}BLOOM_BLOCK;
+
+typedef struct bloom_filter
+{
+    BLOOM_BLOCK *blocks;
+    uint32_t block_count;
+    int k;
+    size_t items;//adds so far, duplicates included
+}BLOOM_FILTER;
+
+BLOOM_FILTER *create_bloom_filter(size_t expected_items, double fp_rate);
+void bloom_add(BLOOM_FILTER *bf, uint64_t h);
+void bloom_add_bulk(BLOOM_FILTER *bf, const uint64_t *hashes, size_t n);
+bool bloom_may_contain(BLOOM_FILTER *bf, uint64_t h);
+bool bloom_union(BLOOM_FILTER *dst, BLOOM_FILTER *src);
+double bloom_fp_estimate(BLOOM_FILTER *bf);
+void destroy_bloom_filter(BLOOM_FILTER *bf);
+uint64_t bloom_hash_int(int key);
+uint64_t bloom_hash_bytes(const void *data, size_t len);
+void _bloom_mask(BLOOM_FILTER *bf, uint64_t h, uint64_t mask[BLOOM_BLOCK_WORDS]);
+
+#define BLOOM_BLOCK_OF(bf, h) (&(bf)->blocks[(uint32_t)((((h) >> 32)*(uint64_t)(bf)->block_count) >> 32)])
+
+BLOOM_FILTER *create_bloom_filter(size_t expected_items, double fp_rate)
+{
+    BLOOM_FILTER *bf;
+    double bits_per_item;
+    uint64_t bits;
+
+    if(expected_items == 0)
+        expected_items = 1;
+    if(fp_rate <= 0 || fp_rate >= 1)
+        fp_rate = 0.01;
+    bits_per_item = -log(fp_rate)/(M_LN2*M_LN2);
+    bf = (BLOOM_FILTER*)Malloc(sizeof(BLOOM_FILTER));
+    bf->k = (int)(bits_per_item*M_LN2 + 0.5);
+    if(bf->k < 1)
+        bf->k = 1;
+    if(bf->k > BLOOM_MAX_K)
+        bf->k = BLOOM_MAX_K;
+    bits = (uint64_t)(expected_items*bits_per_item*BLOOM_SLACK) + 1;
+    bf->block_count = (uint32_t)((bits + BLOOM_BLOCK_BITS - 1)/BLOOM_BLOCK_BITS);
+    bf->blocks = (BLOOM_BLOCK*)Malloc_aligned(CACHE_LINE_SIZE, bf->block_count*sizeof(BLOOM_BLOCK));
+    memset(bf->blocks, 0, bf->block_count*sizeof(BLOOM_BLOCK));
+    bf->items = 0;
+    return bf;
+}
+
+//splitmix64 finalizer: every key bit reaches both halves (block pick and bit positions)
+uint64_t bloom_hash_int(int key)
+{
+    uint64_t h = (uint64_t)(uint32_t)key + 0x9e3779b97f4a7c15ULL;
+
+    h = (h ^ (h >> 30))*0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27))*0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+uint64_t bloom_hash_bytes(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    h = (h ^ (h >> 30))*0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27))*0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+//k bit positions inside the block by double hashing the low half of h
+void _bloom_mask(BLOOM_FILTER *bf, uint64_t h, uint64_t mask[BLOOM_BLOCK_WORDS])
+{
+    uint32_t h1, h2, bit;
+
+    h1 = (uint32_t)h;
+    h2 = (h1 >> 16 | h1 << 16)*0x85ebca6bU | 1;
+    memset(mask, 0, BLOOM_BLOCK_WORDS*sizeof(uint64_t));
+    for(int i = 0; i < bf->k; i++)
+    {
+        bit = (h1 + (uint32_t)i*h2) % BLOOM_BLOCK_BITS;
+        mask[bit/64] |= 1ULL << (bit % 64);
+    }
+}
+
+void bloom_add(BLOOM_FILTER *bf, uint64_t h)
+{
+    uint64_t mask[BLOOM_BLOCK_WORDS];
+    BLOOM_BLOCK *b = BLOOM_BLOCK_OF(bf, h);
+
+    _bloom_mask(bf, h, mask);
+    for(int w = 0; w < BLOOM_BLOCK_WORDS; w++)
+        b->words[w] |= mask[w];
+    bf->items++;
+}
+
+//bulk construction: the block of item i + BLOOM_PREFETCH_DIST is in flight while item i is set
+void bloom_add_bulk(BLOOM_FILTER *bf, const uint64_t *hashes, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        if(i + BLOOM_PREFETCH_DIST < n)
+            __builtin_prefetch(BLOOM_BLOCK_OF(bf, hashes[i + BLOOM_PREFETCH_DIST]), 1, 3);
+        bloom_add(bf, hashes[i]);
+    }
+}
+
+bool bloom_may_contain(BLOOM_FILTER *bf, uint64_t h)
+{
+    uint64_t mask[BLOOM_BLOCK_WORDS];
+    BLOOM_BLOCK *b = BLOOM_BLOCK_OF(bf, h);
+
+    _bloom_mask(bf, h, mask);
+#if defined(__AVX2__)
+    //testc: CF = ((~block & mask) == 0), i.e. every mask bit is set in the block
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i*)&b->words[0]), _mm256_loadu_si256((const __m256i*)&mask[0]))
+           && _mm256_testc_si256(_mm256_load_si256((const __m256i*)&b->words[4]), _mm256_loadu_si256((const __m256i*)&mask[4]));
+#else
+    uint64_t missing = 0;
+    for(int w = 0; w < BLOOM_BLOCK_WORDS; w++)//no early exit: the compiler turns this into vector ops
+        missing |= mask[w] & ~b->words[w];
+    return missing == 0;
+#endif
+}
+
+//dst |= src. both must come from create_bloom_filter() with the same items and rate.
+bool bloom_union(BLOOM_FILTER *dst, BLOOM_FILTER *src)
+{
+    if(dst->block_count != src->block_count || dst->k != src->k)
+    {
+        printf("ERROR: BLOOM FILTERS OF DIFFERENT SHAPE!!\n");
+        return false;
+    }
+    for(uint32_t i = 0; i < dst->block_count; i++)
+        for(int w = 0; w < BLOOM_BLOCK_WORDS; w++)
+            dst->blocks[i].words[w] |= src->blocks[i].words[w];
+    dst->items += src->items;
+    return true;
+}
+
+//expected false-positive rate at the current fill, from the fraction of bits set
+double bloom_fp_estimate(BLOOM_FILTER *bf)
+{
+    uint64_t set = 0;
+
+    for(uint32_t i = 0; i < bf->block_count; i++)
+        for(int w = 0; w < BLOOM_BLOCK_WORDS; w++)
+            set += __builtin_popcountll(bf->blocks[i].words[w]);
+    return pow((double)set/((double)bf->block_count*BLOOM_BLOCK_BITS), bf->k);
+}
+
+void destroy_bloom_filter(BLOOM_FILTER *bf)
+{
+    free(bf->blocks);
+    free(bf);
+}
+#endif /* bloom_filter_h */
@@ -0,0 +1,421 @@
+/* BOUNDED KEY/VALUE CACHE: LRU, CLOCK OR 2Q */
+
+#ifndef cache_h
+#define cache_h
+#include <pthread.h>
+#include "wrappers.h"
+#include "hash_table.h"
+
+/*
+ fixed capacity, O(1) get/put/evict, no malloc after create_cache().
+ every entry is a node in ONE preallocated array; nodes link to each other by index:
+ - hnext: the hash index, heads[bucket_hash(key) & hash_mask] -> node -> node ...
+ - next/back: the policy's doubly linked lists, front = most recent.
+ free nodes are chained through next.
+
+ LRU:   one list. hits move to the front, the rear is evicted.
+ CLOCK: no list. a hit only sets the node's reference bit. to evict, the hand sweeps the array,
+        clearing set bits, and takes the first node whose bit is already clear.
+ 2Q:    A1in (FIFO, ~1/4 of capacity) takes first-time keys, Am (LRU) takes keys seen again.
+        keys evicted from A1in leave a ghost (key only, no value) in A1out; a put that hits a
+        ghost goes straight to Am. a one-off scan only churns A1in and cannot flush Am.
+ */
+typedef enum {CACHE_LRU=1,CACHE_CLOCK=2,CACHE_2Q=3} CACHE_POLICY;
+typedef enum {CACHE_FREE=0,CACHE_A1IN=1,CACHE_AM=2,CACHE_A1OUT=3} CACHE_LIST_ID;//LRU uses CACHE_AM only
+
+#define CACHE_2Q_IN_SHARE 4 //A1in holds capacity/4 entries
+#define CACHE_2Q_OUT_SHARE 2 //A1out remembers capacity/2 ghost keys
+
+typedef struct cache_node
+{
+    void *satellite;
+    int key;
+    int next;//policy list (or free list)
+    int back;
+    int hnext;//hash chain
+    uint8_t list;//CACHE_LIST_ID
+    uint8_t referenced;//CLOCK
+}CACHE_NODE;
+
+typedef struct cache_list
+{
+    int front;
+    int rear;
+    int count;
+}CACHE_LIST;
+
+typedef struct cache
+{
+    CACHE_NODE *nodes;
+    int *heads;
+    uint32_t hash_mask;
+    int capacity;//entries holding a value
+    int node_count;//capacity + ghosts
+    int free_node;
+    int count;
+    CACHE_LIST lists[4];//indexed by CACHE_LIST_ID
+    int hand;//CLOCK
+    CACHE_POLICY policy;
+    void (*on_evict)(int key, void *satellite);//optional: called for every value pushed out
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+}CACHE;
+
+typedef struct cache_shard
+{
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    CACHE *cache;
+}CACHE_SHARD;
+
+typedef struct sharded_cache
+{
+    CACHE_SHARD *shards;
+    int shard_count;
+}SHARDED_CACHE;
+
+CACHE *create_cache(int capacity, CACHE_POLICY policy, void (*on_evict)(int key, void *satellite));
+void *cache_get(CACHE *c, int key);
+bool cache_put(CACHE *c, int key, void *satellite);
+bool cache_remove(CACHE *c, int key);
+void print_cache_stats(CACHE *c);
+void destroy_cache(CACHE *c);
+SHARDED_CACHE *create_sharded_cache(int capacity, int shard_count, CACHE_POLICY policy,
+                                    void (*on_evict)(int key, void *satellite));
+void *sharded_cache_get(SHARDED_CACHE *sc, int key);
+bool sharded_cache_put(SHARDED_CACHE *sc, int key, void *satellite);
+bool sharded_cache_remove(SHARDED_CACHE *sc, int key);
+void sharded_cache_totals(SHARDED_CACHE *sc, uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+void destroy_sharded_cache(SHARDED_CACHE *sc);
+int  _cache_find(CACHE *c, int key);
+void _cache_unhash(CACHE *c, int i);
+void _cache_push_front(CACHE *c, int list, int i);
+void _cache_unlink(CACHE *c, int i);
+void _cache_release(CACHE *c, int i);
+void _cache_evict(CACHE *c);
+
+CACHE *create_cache(int capacity, CACHE_POLICY policy, void (*on_evict)(int key, void *satellite))
+{
+    CACHE *c = (CACHE*)Malloc(sizeof(CACHE));
+    uint32_t hash_size = 1;
+
+    if(capacity < 1)
+        capacity = 1;
+    c->capacity = capacity;
+    c->node_count = capacity;
+    if(policy == CACHE_2Q)
+        c->node_count += capacity/CACHE_2Q_OUT_SHARE + 1;
+    while(hash_size < (uint32_t)c->node_count)
+        hash_size <<= 1;
+    c->hash_mask = hash_size - 1;
+    c->heads = (int*)Malloc(hash_size*sizeof(int));
+    memset(c->heads, 0xff, hash_size*sizeof(int));//-1: empty bucket
+    c->nodes = (CACHE_NODE*)Calloc(c->node_count, sizeof(CACHE_NODE));
+    for(int i = 0; i < c->node_count; i++)
+        c->nodes[i].next = i + 1 < c->node_count ? i + 1 : -1;
+    c->free_node = 0;
+    for(int l = 0; l < 4; l++)
+    {
+        c->lists[l].front = c->lists[l].rear = -1;
+        c->lists[l].count = 0;
+    }
+    c->count = 0;
+    c->hand = 0;
+    c->policy = policy;
+    c->on_evict = on_evict;
+    c->hits = c->misses = c->evictions = 0;
+    return c;
+}
+
+//node holding key (a 2Q ghost included), -1 if none
+int _cache_find(CACHE *c, int key)
+{
+    int i;
+
+    for(i = c->heads[bucket_hash(key) & c->hash_mask]; i != -1; i = c->nodes[i].hnext)
+        if(c->nodes[i].key == key)
+            break;
+    return i;
+}
+
+void _cache_unhash(CACHE *c, int i)
+{
+    int *link = &c->heads[bucket_hash(c->nodes[i].key) & c->hash_mask];
+
+    while(*link != i)
+        link = &c->nodes[*link].hnext;
+    *link = c->nodes[i].hnext;
+}
+
+void _cache_push_front(CACHE *c, int list, int i)
+{
+    CACHE_LIST *l = &c->lists[list];
+
+    c->nodes[i].list = (uint8_t)list;
+    c->nodes[i].back = -1;
+    c->nodes[i].next = l->front;
+    if(l->front != -1)
+        c->nodes[l->front].back = i;
+    else
+        l->rear = i;
+    l->front = i;
+    l->count++;
+}
+
+void _cache_unlink(CACHE *c, int i)
+{
+    CACHE_NODE *n = &c->nodes[i];
+    CACHE_LIST *l = &c->lists[n->list];
+
+    if(c->policy == CACHE_CLOCK)//CLOCK keeps no lists
+        return;
+    if(n->back != -1)
+        c->nodes[n->back].next = n->next;
+    else
+        l->front = n->next;
+    if(n->next != -1)
+        c->nodes[n->next].back = n->back;
+    else
+        l->rear = n->back;
+    l->count--;
+}
+
+//node back to the free list, out of the hash and off its policy list
+void _cache_release(CACHE *c, int i)
+{
+    _cache_unhash(c, i);
+    _cache_unlink(c, i);
+    c->nodes[i].list = CACHE_FREE;
+    c->nodes[i].satellite = NULL;
+    c->nodes[i].next = c->free_node;
+    c->free_node = i;
+}
+
+//makes room for one value. only called when count == capacity.
+void _cache_evict(CACHE *c)
+{
+    CACHE_NODE *n;
+    int victim;
+
+    switch(c->policy)
+    {
+        case CACHE_CLOCK:
+            for(;;)
+            {
+                n = &c->nodes[c->hand];
+                if(n->list != CACHE_FREE && !n->referenced)
+                    break;
+                n->referenced = 0;//second chance
+                c->hand = (c->hand + 1) % c->capacity;
+            }
+            victim = c->hand;
+            c->hand = (c->hand + 1) % c->capacity;
+            break;
+        case CACHE_2Q:
+            if(c->lists[CACHE_A1IN].count > c->capacity/CACHE_2Q_IN_SHARE || c->lists[CACHE_AM].count == 0)
+            {
+                //A1in rear becomes a ghost: the key stays in the hash, the value goes
+                victim = c->lists[CACHE_A1IN].rear;
+                n = &c->nodes[victim];
+                if(c->on_evict)
+                    c->on_evict(n->key, n->satellite);
+                _cache_unlink(c, victim);
+                n->satellite = NULL;
+                _cache_push_front(c, CACHE_A1OUT, victim);
+                c->count--;
+                c->evictions++;
+                if(c->lists[CACHE_A1OUT].count > c->capacity/CACHE_2Q_OUT_SHARE)
+                    _cache_release(c, c->lists[CACHE_A1OUT].rear);
+                return;
+            }
+            victim = c->lists[CACHE_AM].rear;
+            break;
+        default://CACHE_LRU
+            victim = c->lists[CACHE_AM].rear;
+            break;
+    }
+    n = &c->nodes[victim];
+    if(c->on_evict)
+        c->on_evict(n->key, n->satellite);
+    _cache_release(c, victim);
+    c->count--;
+    c->evictions++;
+}
+
+void *cache_get(CACHE *c, int key)
+{
+    int i = _cache_find(c, key);
+
+    if(i == -1 || c->nodes[i].list == CACHE_A1OUT)//a ghost has no value
+    {
+        c->misses++;
+        return NULL;
+    }
+    c->hits++;
+    if(c->policy == CACHE_CLOCK)
+        c->nodes[i].referenced = 1;
+    else if(c->nodes[i].list == CACHE_AM)//2Q leaves A1in hits in place: that list is a FIFO
+    {
+        _cache_unlink(c, i);
+        _cache_push_front(c, CACHE_AM, i);
+    }
+    return c->nodes[i].satellite;
+}
+
+//true if key is new, false if its value was replaced
+bool cache_put(CACHE *c, int key, void *satellite)
+{
+    int i, list;
+
+    i = _cache_find(c, key);
+    if(i != -1 && c->nodes[i].list != CACHE_A1OUT)
+    {
+        c->nodes[i].satellite = satellite;
+        if(c->policy == CACHE_CLOCK)
+            c->nodes[i].referenced = 1;
+        else if(c->nodes[i].list == CACHE_AM)
+        {
+            _cache_unlink(c, i);
+            _cache_push_front(c, CACHE_AM, i);
+        }
+        return false;
+    }
+    list = CACHE_AM;
+    if(c->policy == CACHE_2Q)
+    {
+        if(i != -1)//ghost hit: the key was seen recently, it earns a place in Am
+            _cache_release(c, i);
+        else
+            list = CACHE_A1IN;
+    }
+    if(c->count == c->capacity)
+        _cache_evict(c);
+    //CLOCK: values live in [0, capacity) so the hand only sweeps value nodes
+    i = c->free_node;
+    c->free_node = c->nodes[i].next;
+    c->nodes[i].key = key;
+    c->nodes[i].satellite = satellite;
+    c->nodes[i].referenced = 0;
+    c->nodes[i].hnext = c->heads[bucket_hash(key) & c->hash_mask];
+    c->heads[bucket_hash(key) & c->hash_mask] = i;
+    if(c->policy == CACHE_CLOCK)
+        c->nodes[i].list = CACHE_AM;
+    else
+        _cache_push_front(c, list, i);
+    c->count++;
+    return true;
+}
+
+//drops key without calling on_evict (the caller asked for it)
+bool cache_remove(CACHE *c, int key)
+{
+    int i = _cache_find(c, key);
+
+    if(i == -1)
+        return false;
+    if(c->nodes[i].list != CACHE_A1OUT)
+        c->count--;
+    _cache_release(c, i);
+    return true;
+}
+
+void print_cache_stats(CACHE *c)
+{
+    uint64_t lookups = c->hits + c->misses;
+
+    printf("%s: %d/%d entries, %llu hits, %llu misses (hit ratio %.3f), %llu evictions\n",
+           c->policy == CACHE_LRU ? "LRU" : c->policy == CACHE_CLOCK ? "CLOCK" : "2Q", c->count, c->capacity,
+           (unsigned long long)c->hits, (unsigned long long)c->misses,
+           lookups ? (double)c->hits/lookups : 0.0, (unsigned long long)c->evictions);
+}
+
+void destroy_cache(CACHE *c)
+{
+    free(c->nodes);
+    free(c->heads);
+    free(c);
+}
+
+/*
+ SHARDED: capacity split over shard_count independent caches, one mutex each (a get moves
+ the entry, so even reads write). the shard comes from the HIGH bits of the hash, the bucket
+ inside the shard from the low bits, so sharding does not thin out the buckets.
+ a value returned by sharded_cache_get() may be evicted by another thread right after:
+ the satellites must stay owned by the caller.
+ */
+#define CACHE_SHARD_OF(sc, key) (&(sc)->shards[(uint32_t)(((uint64_t)bucket_hash(key)*(uint32_t)(sc)->shard_count) >> 32)])
+
+SHARDED_CACHE *create_sharded_cache(int capacity, int shard_count, CACHE_POLICY policy,
+                                    void (*on_evict)(int key, void *satellite))
+{
+    SHARDED_CACHE *sc = (SHARDED_CACHE*)Malloc(sizeof(SHARDED_CACHE));
+
+    if(shard_count < 1)
+        shard_count = 1;
+    sc->shard_count = shard_count;
+    sc->shards = (CACHE_SHARD*)Malloc_aligned(CACHE_LINE_SIZE, shard_count*sizeof(CACHE_SHARD));
+    for(int s = 0; s < shard_count; s++)
+    {
+        pthread_mutex_init(&sc->shards[s].lock, NULL);
+        sc->shards[s].cache = create_cache((capacity + shard_count - 1)/shard_count, policy, on_evict);
+    }
+    return sc;
+}
+
+void *sharded_cache_get(SHARDED_CACHE *sc, int key)
+{
+    CACHE_SHARD *s = CACHE_SHARD_OF(sc, key);
+    void *data_out;
+
+    pthread_mutex_lock(&s->lock);
+    data_out = cache_get(s->cache, key);
+    pthread_mutex_unlock(&s->lock);
+    return data_out;
+}
+
+bool sharded_cache_put(SHARDED_CACHE *sc, int key, void *satellite)
+{
+    CACHE_SHARD *s = CACHE_SHARD_OF(sc, key);
+    bool added;
+
+    pthread_mutex_lock(&s->lock);
+    added = cache_put(s->cache, key, satellite);
+    pthread_mutex_unlock(&s->lock);
+    return added;
+}
+
+bool sharded_cache_remove(SHARDED_CACHE *sc, int key)
+{
+    CACHE_SHARD *s = CACHE_SHARD_OF(sc, key);
+    bool removed;
+
+    pthread_mutex_lock(&s->lock);
+    removed = cache_remove(s->cache, key);
+    pthread_mutex_unlock(&s->lock);
+    return removed;
+}
+
+void sharded_cache_totals(SHARDED_CACHE *sc, uint64_t *hits, uint64_t *misses, uint64_t *evictions)
+{
+    *hits = *misses = *evictions = 0;
+    for(int s = 0; s < sc->shard_count; s++)
+    {
+        pthread_mutex_lock(&sc->shards[s].lock);
+        *hits += sc->shards[s].cache->hits;
+        *misses += sc->shards[s].cache->misses;
+        *evictions += sc->shards[s].cache->evictions;
+        pthread_mutex_unlock(&sc->shards[s].lock);
+    }
+}
+
+void destroy_sharded_cache(SHARDED_CACHE *sc)
+{
+    for(int s = 0; s < sc->shard_count; s++)
+    {
+        destroy_cache(sc->shards[s].cache);
+        pthread_mutex_destroy(&sc->shards[s].lock);
+    }
+    free(sc->shards);
+    free(sc);
+}
+#endif /* cache_h */
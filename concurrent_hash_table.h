@@ -0,0 +1,255 @@
+/* CONCURRENT CHAINED HASH TABLE WITH LOCK STRIPING */
+
+#ifndef concurrent_hash_table_h
+#define concurrent_hash_table_h
+#include <pthread.h>
+#include "wrappers.h"
+#include "hash_table.h"
+
+/*
+ same dictionary ops as the CHAINING table, safe to call from any thread.
+ slot i is guarded by stripe (i % CHT_STRIPES). the table size is always a multiple of
+ CHT_STRIPES, so h(key) % size and h(key) % CHT_STRIPES agree on the stripe before and
+ after a resize: a thread picks its stripe from the hash alone, then reads the size under it.
+ readers take the stripe lock shared, so lookups on the same stripe run in parallel.
+ resize: the writer that pushes its stripe over the load factor takes every stripe
+ exclusively, in order (no deadlock), and rehashes only if nobody beat it to it.
+ */
+#define CHT_STRIPES 64
+#define CHT_MAX_LOAD 2 //entries per slot before the table doubles
+#define CHT_BLOCK_NODES 256
+
+typedef struct cht_node
+{
+    void *satellite;
+    int key;
+    struct cht_node *next;
+}CHT_NODE;
+
+typedef struct cht_block
+{
+    struct cht_block *next;
+    CHT_NODE nodes[CHT_BLOCK_NODES];
+}CHT_BLOCK;
+
+//one stripe per cache line so neighbouring locks don't false-share.
+//each stripe owns the nodes of its slots, allocation needs no extra lock.
+typedef struct cht_stripe
+{
+    _Alignas(CACHE_LINE_SIZE) pthread_rwlock_t lock;
+    CHT_BLOCK *blocks;
+    CHT_NODE *free_list;
+    int used;//nodes handed out from the newest block
+    int count;//entries in this stripe's slots
+}CHT_STRIPE;
+
+typedef struct concurrent_hash_table
+{
+    CHT_NODE **slots;
+    int size;
+    int resize_count;
+    CHT_STRIPE *stripes;
+    int (*compare)(void *arg1, void *arg2);//NULL: keys alone identify entries
+}CONCURRENT_HT;
+
+CONCURRENT_HT *create_concurrent_ht(int m, int (*compare)(void *arg1, void *arg2));
+bool cht_insert(CONCURRENT_HT *ht, void *data_in, int key);
+bool cht_search(CONCURRENT_HT *ht, void *target, int key);
+void *cht_retrieve(CONCURRENT_HT *ht, void *target, int key);
+bool cht_delete(CONCURRENT_HT *ht, void *target, int key);
+int  cht_count(CONCURRENT_HT *ht);
+void destroy_concurrent_ht(CONCURRENT_HT *ht);
+void _cht_resize(CONCURRENT_HT *ht, int seen_size);
+CHT_NODE *_cht_find(CONCURRENT_HT *ht, CHT_NODE ***link, void *target, int key, uint32_t h);
+
+CONCURRENT_HT *create_concurrent_ht(int m, int (*compare)(void *arg1, void *arg2))
+{
+    CONCURRENT_HT *ht = (CONCURRENT_HT*)Malloc(sizeof(CONCURRENT_HT));
+
+    //round up to a multiple of the stripe count
+    ht->size = ((m + CHT_STRIPES - 1)/CHT_STRIPES)*CHT_STRIPES;
+    if(ht->size == 0)
+        ht->size = CHT_STRIPES;
+    ht->slots = (CHT_NODE**)Calloc(ht->size, sizeof(CHT_NODE*));
+    ht->resize_count = 0;
+    ht->compare = compare;
+    ht->stripes = (CHT_STRIPE*)Malloc_aligned(CACHE_LINE_SIZE, CHT_STRIPES*sizeof(CHT_STRIPE));
+    for(int i = 0; i < CHT_STRIPES; i++)
+    {
+        pthread_rwlock_init(&ht->stripes[i].lock, NULL);
+        ht->stripes[i].blocks = NULL;
+        ht->stripes[i].free_list = NULL;
+        ht->stripes[i].used = CHT_BLOCK_NODES;//forces a block on first use
+        ht->stripes[i].count = 0;
+    }
+    return ht;
+}
+
+//caller holds the stripe of h. *link is left pointing at the link to the match (or the chain's tail).
+CHT_NODE *_cht_find(CONCURRENT_HT *ht, CHT_NODE ***link, void *target, int key, uint32_t h)
+{
+    CHT_NODE **pre, *cur;
+
+    pre = &ht->slots[h % ht->size];
+    for(cur = *pre; cur; pre = &cur->next, cur = cur->next)
+    {
+        if(cur->key == key && (!ht->compare || ht->compare(target, cur->satellite) == 0))
+            break;
+    }
+    *link = pre;
+    return cur;
+}
+
+bool cht_insert(CONCURRENT_HT *ht, void *data_in, int key)
+{
+    CHT_STRIPE *s;
+    CHT_BLOCK *block;
+    CHT_NODE **link, *pnew;
+    uint32_t h;
+    int seen_size;
+    bool grow;
+
+    h = bucket_hash(key);
+    s = &ht->stripes[h % CHT_STRIPES];
+    pthread_rwlock_wrlock(&s->lock);
+    if(_cht_find(ht, &link, data_in, key, h))
+    {
+        pthread_rwlock_unlock(&s->lock);
+        return false;//no duplicates
+    }
+    if(s->free_list)
+    {
+        pnew = s->free_list;
+        s->free_list = pnew->next;
+    }
+    else
+    {
+        if(s->used == CHT_BLOCK_NODES)
+        {
+            block = (CHT_BLOCK*)Malloc(sizeof(CHT_BLOCK));
+            block->next = s->blocks;
+            s->blocks = block;
+            s->used = 0;
+        }
+        pnew = &s->blocks->nodes[s->used];
+        s->used++;
+    }
+    pnew->satellite = data_in;
+    pnew->key = key;
+    pnew->next = NULL;
+    *link = pnew;//append at the tail
+    s->count++;
+    seen_size = ht->size;
+    grow = s->count > CHT_MAX_LOAD*(seen_size/CHT_STRIPES);
+    pthread_rwlock_unlock(&s->lock);
+    if(grow)
+        _cht_resize(ht, seen_size);
+    return true;
+}
+
+bool cht_search(CONCURRENT_HT *ht, void *target, int key)
+{
+    return cht_retrieve(ht, target, key) != NULL;
+}
+
+void *cht_retrieve(CONCURRENT_HT *ht, void *target, int key)
+{
+    CHT_STRIPE *s;
+    CHT_NODE **link, *cur;
+    void *data_out;
+    uint32_t h;
+
+    h = bucket_hash(key);
+    s = &ht->stripes[h % CHT_STRIPES];
+    pthread_rwlock_rdlock(&s->lock);
+    cur = _cht_find(ht, &link, target, key, h);
+    data_out = cur ? cur->satellite : NULL;
+    pthread_rwlock_unlock(&s->lock);
+    return data_out;
+}
+
+bool cht_delete(CONCURRENT_HT *ht, void *target, int key)
+{
+    CHT_STRIPE *s;
+    CHT_NODE **link, *cur;
+    uint32_t h;
+
+    h = bucket_hash(key);
+    s = &ht->stripes[h % CHT_STRIPES];
+    pthread_rwlock_wrlock(&s->lock);
+    cur = _cht_find(ht, &link, target, key, h);
+    if(cur)
+    {
+        *link = cur->next;
+        cur->next = s->free_list;//node goes back to its stripe
+        s->free_list = cur;
+        s->count--;
+    }
+    pthread_rwlock_unlock(&s->lock);
+    return cur != NULL;
+}
+
+//approximate while writers are running, exact once they are done.
+int cht_count(CONCURRENT_HT *ht)
+{
+    int count = 0;
+
+    for(int i = 0; i < CHT_STRIPES; i++)
+    {
+        pthread_rwlock_rdlock(&ht->stripes[i].lock);
+        count += ht->stripes[i].count;
+        pthread_rwlock_unlock(&ht->stripes[i].lock);
+    }
+    return count;
+}
+
+void _cht_resize(CONCURRENT_HT *ht, int seen_size)
+{
+    CHT_NODE **slots, *cur, *next;
+    int new_size;
+
+    for(int i = 0; i < CHT_STRIPES; i++)
+        pthread_rwlock_wrlock(&ht->stripes[i].lock);
+    if(ht->size == seen_size)//another writer may have grown it already
+    {
+        new_size = 2*ht->size;
+        slots = (CHT_NODE**)Calloc(new_size, sizeof(CHT_NODE*));
+        for(int i = 0; i < ht->size; i++)
+        {
+            for(cur = ht->slots[i]; cur; cur = next)
+            {
+                next = cur->next;
+                cur->next = slots[bucket_hash(cur->key) % new_size];
+                slots[bucket_hash(cur->key) % new_size] = cur;
+            }
+        }
+        free(ht->slots);
+        ht->slots = slots;
+        ht->size = new_size;
+        ht->resize_count++;
+    }
+    for(int i = CHT_STRIPES - 1; i >= 0; i--)
+        pthread_rwlock_unlock(&ht->stripes[i].lock);
+}
+
+//no other thread may touch the table at this point.
+void destroy_concurrent_ht(CONCURRENT_HT *ht)
+{
+    CHT_BLOCK *pre, *cur;
+
+    for(int i = 0; i < CHT_STRIPES; i++)
+    {
+        cur = ht->stripes[i].blocks;
+        while(cur)
+        {
+            pre = cur;
+            cur = cur->next;
+            free(pre);
+        }
+        pthread_rwlock_destroy(&ht->stripes[i].lock);
+    }
+    free(ht->stripes);
+    free(ht->slots);
+    free(ht);
+}
+#endif /* concurrent_hash_table_h */
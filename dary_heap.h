@@ -0,0 +1,178 @@
+/* D-ARY MIN HEAP: CACHE-ALIGNED SIBLINGS, ITERATIVE HOLE-BASED REHEAP */
+
+#ifndef dary_heap_h
+#define dary_heap_h
+#include "wrappers.h"
+
+/*
+ same contract as HEAP_ADT: a min heap of void* ordered by compare(a, b) < 0, but each node has
+ d = 2, 4 or 8 children instead of 2.
+   children of k are d*k+1 .. d*k+d. the array starts d-1 slots into a cache-aligned block, so
+   every sibling group starts at a multiple of d slots: with 8-byte pointers the d children of a
+   node never straddle a cache line and picking the smallest costs one miss, not d/2.
+   the tree is log_d(n) deep: for d = 4 half the levels of a binary heap, and so about half the
+   misses per reheap down, paid for with d-1 compares per level instead of 1.
+ reheap up/down move a hole instead of swapping: each level costs one pointer store, and the
+ element being placed is written once at the end.
+ the array doubles when full; the old block is copied into a new aligned one (realloc would lose
+ the alignment).
+ */
+#define DARY_MAX_D (CACHE_LINE_SIZE/(int)sizeof(void*))
+
+typedef struct dary_heap
+{
+    int (*compare)(void *arg1, void *arg2);
+    int d;
+    int size;//capacity
+    int count;
+    void **block;//aligned allocation
+    void **ary;//block + d-1: ary[0] is the root
+}DARY_HEAP;
+
+DARY_HEAP *create_dary_heap(int d, int size, int (*compare)(void *arg1, void *arg2));
+void dary_heap_insert(DARY_HEAP *heap, void *data_in);
+void *dary_heap_get_min(DARY_HEAP *heap);
+void *dary_heap_peek(DARY_HEAP *heap);
+void *dary_heap_replace_min(DARY_HEAP *heap, void *data_in);
+void dary_heap_build(DARY_HEAP *heap, void **data, int n);
+void destroy_dary_heap(DARY_HEAP *heap);
+void _dary_reheap_up(DARY_HEAP *heap, int hole, void *data);
+void _dary_reheap_down(DARY_HEAP *heap, int hole, void *data);
+void _dary_resize(DARY_HEAP *heap, int size);
+
+//d must be a power of 2 up to a cache line of pointers; NULL otherwise
+DARY_HEAP *create_dary_heap(int d, int size, int (*compare)(void *arg1, void *arg2))
+{
+    DARY_HEAP *heap;
+
+    if(d < 2 || d > DARY_MAX_D || (d & (d - 1)))
+    {
+        INDEX_ERROR;
+        return NULL;
+    }
+    heap = (DARY_HEAP*)Malloc(sizeof(DARY_HEAP));
+    heap->compare = compare;
+    heap->d = d;
+    heap->count = 0;
+    heap->size = 0;
+    heap->block = NULL;
+    _dary_resize(heap, size > 0 ? size : 16);
+    return heap;
+}
+
+void _dary_resize(DARY_HEAP *heap, int size)
+{
+    void **block = (void**)Malloc_aligned(CACHE_LINE_SIZE, ((size_t)size + heap->d - 1)*sizeof(void*));
+
+    if(heap->block)
+    {
+        memcpy(block + heap->d - 1, heap->ary, (size_t)heap->count*sizeof(void*));
+        free(heap->block);
+    }
+    heap->block = block;
+    heap->ary = block + heap->d - 1;
+    heap->size = size;
+}
+
+void _dary_reheap_up(DARY_HEAP *heap, int hole, void *data)
+{
+    void **ary = heap->ary;
+    int parent;
+
+    while(hole)
+    {
+        parent = (hole - 1)/heap->d;
+        if(heap->compare(data, ary[parent]) >= 0)
+            break;
+        ary[hole] = ary[parent];
+        hole = parent;
+    }
+    ary[hole] = data;
+}
+
+void _dary_reheap_down(DARY_HEAP *heap, int hole, void *data)
+{
+    void **ary = heap->ary;
+    int d = heap->d, count = heap->count, child, last, smallest;
+
+    while((child = d*hole + 1) < count)
+    {
+        last = child + d < count ? child + d : count;
+        for(int i = child; i < last; i++)
+            __builtin_prefetch(ary[i]);//the compares below miss on these in parallel, not one by one
+        smallest = child;
+        for(child++; child < last; child++)
+            if(heap->compare(ary[child], ary[smallest]) < 0)
+                smallest = child;
+        if(heap->compare(ary[smallest], data) >= 0)
+            break;
+        __builtin_prefetch(&ary[d*smallest + 1]);//its sibling group, one line, is next
+        ary[hole] = ary[smallest];
+        hole = smallest;
+    }
+    ary[hole] = data;
+}
+
+void dary_heap_insert(DARY_HEAP *heap, void *data_in)
+{
+    if(heap->count == heap->size)
+        _dary_resize(heap, heap->size*2);
+    heap->count++;
+    _dary_reheap_up(heap, heap->count - 1, data_in);
+}
+
+//NULL when empty
+void *dary_heap_get_min(DARY_HEAP *heap)
+{
+    void *root;
+
+    if(heap->count == 0)
+        return NULL;
+    root = heap->ary[0];
+    heap->count--;
+    if(heap->count)
+        _dary_reheap_down(heap, 0, heap->ary[heap->count]);
+    return root;
+}
+
+void *dary_heap_peek(DARY_HEAP *heap)
+{
+    return heap->count ? heap->ary[0] : NULL;
+}
+
+//get_min + insert in one reheap down; NULL (and a plain insert) when empty
+void *dary_heap_replace_min(DARY_HEAP *heap, void *data_in)
+{
+    void *root;
+
+    if(heap->count == 0)
+    {
+        dary_heap_insert(heap, data_in);
+        return NULL;
+    }
+    root = heap->ary[0];
+    _dary_reheap_down(heap, 0, data_in);
+    return root;
+}
+
+//appends n elements and heapifies bottom up: O(n) instead of n inserts
+void dary_heap_build(DARY_HEAP *heap, void **data, int n)
+{
+    int size = heap->size;
+
+    while(heap->count + n > size)
+        size *= 2;
+    if(size != heap->size)
+        _dary_resize(heap, size);
+    memcpy(heap->ary + heap->count, data, (size_t)n*sizeof(void*));
+    heap->count += n;
+    for(int i = (heap->count - 2)/heap->d; i >= 0 && heap->count > 1; i--)
+        _dary_reheap_down(heap, i, heap->ary[i]);
+}
+
+void destroy_dary_heap(DARY_HEAP *heap)
+{
+    free(heap->block);
+    free(heap);
+}
+#endif /* dary_heap_h */
@@ -0,0 +1,396 @@
+/* EXTERNAL-MEMORY PRIORITY QUEUE: INSERTION HEAP, SORTED RUNS ON DISK, MULTIWAY MERGE */
+
+#ifndef ext_heap_h
+#define ext_heap_h
+#include <limits.h>
+#include <unistd.h>
+#include "wrappers.h"
+#include "dary_heap.h"
+
+/*
+ a min priority queue (HEAP_ADT's order: compare < 0 comes out first) for more records than fit
+ in memory. records are fixed-size and copied in, so they can be written out.
+   insert: into an in-memory heap (DARY_HEAP over slots of a record arena). when the arena is
+   full the heap is drained in order into a new sorted run on disk, through a buffered writer.
+   get_min: the smaller of the insertion heap's root and the merge's root. the merge is a heap of
+   runs keyed on each run's head record (one block of each run is in memory); taking the head
+   advances the run, which is reheaped down, or dropped when used up.
+ memory budget: half for the arena (records and the pointers to their slots), half for the
+ blocks of the runs and the writer: max_runs = budget/2 / block - 1 runs open at once. when another
+ run would not get its block, the two smallest runs are merged into one first, together with
+ every next smallest that holds at most twice what is merged so far. merging all runs would
+ rewrite the biggest one every time, quadratic I/O; merging runs of similar size keeps the sizes
+ geometric, like the levels of an LSM tree, so a record is rewritten about log(N/M) / log(fan-in)
+ times (N records, M in the arena) and memory stays within the budget however many go through.
+ run files are made in dir (NULL: the system's temp dir) and unlinked at once: nothing is left
+ behind, even if the process dies.
+ the pointer get_min returns is valid until the next call on the queue.
+ */
+#define EXT_BLOCK_SIZE (1 << 16) //bytes of each run's read block and of the write buffer
+#define EXT_MIN_FAN_IN 2
+
+typedef struct ext_run
+{
+    struct ext_heap *owner;//for the compare callback
+    FILE *fp;
+    char *block;
+    size_t count;//records in block
+    size_t pos;//head of the run: block + pos*record_size
+    uint64_t on_disk;//records of the run not read yet
+}EXT_RUN;
+
+typedef struct ext_writer
+{
+    FILE *fp;
+    char *buf;
+    size_t used;//bytes
+    bool failed;
+}EXT_WRITER;
+
+typedef struct ext_stats
+{
+    uint64_t runs;//written by spills
+    uint64_t merges;//of the smaller runs into one
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+}EXT_STATS;
+
+typedef struct ext_heap
+{
+    size_t record_size;
+    int (*compare)(void *arg1, void *arg2);
+    char *dir;
+    char *arena;
+    void **free_slots;//arena slots not holding a record
+    size_t free_count;
+    size_t capacity;//records the arena holds
+    DARY_HEAP *inserted;//slots of the arena, min first
+    DARY_HEAP *runs;//EXT_RUNs with records left, by head record
+    int max_runs;//runs whose blocks fit in the budget
+    size_t block_records;
+    EXT_WRITER writer;
+    char *out;//record returned by get_min
+    uint64_t count;
+    EXT_STATS stats;
+}EXT_HEAP;
+
+EXT_HEAP *create_ext_heap(size_t record_size, size_t budget, int (*compare)(void *arg1, void *arg2), const char *dir);
+bool ext_heap_insert(EXT_HEAP *heap, void *data_in);
+void *ext_heap_get_min(EXT_HEAP *heap);
+void print_ext_heap_stats(EXT_HEAP *heap);
+void destroy_ext_heap(EXT_HEAP *heap);
+int _ext_run_compare(void *arg1, void *arg2);
+void *_ext_run_head(EXT_RUN *run);
+bool _ext_run_fill(EXT_RUN *run);
+bool _ext_run_advance(EXT_RUN *run);
+void _ext_run_destroy(EXT_RUN *run);
+FILE *_ext_run_file(EXT_HEAP *heap);
+void _ext_writer_put(EXT_HEAP *heap, void *record);
+bool _ext_writer_finish(EXT_HEAP *heap);
+bool _ext_add_run(EXT_HEAP *heap, FILE *fp, uint64_t records);
+bool _ext_spill(EXT_HEAP *heap);
+bool _ext_merge_runs(EXT_HEAP *heap);
+uint64_t _ext_run_left(EXT_RUN *run);
+int _ext_run_size_compare(const void *arg1, const void *arg2);
+
+//budget in bytes; NULL if it cannot hold the arena and two runs' blocks
+EXT_HEAP *create_ext_heap(size_t record_size, size_t budget, int (*compare)(void *arg1, void *arg2), const char *dir)
+{
+    EXT_HEAP *heap;
+    size_t block_records = EXT_BLOCK_SIZE/record_size > 0 ? EXT_BLOCK_SIZE/record_size : 1;
+    size_t block = block_records*record_size;
+
+    if(record_size == 0 || budget/2 < (EXT_MIN_FAN_IN + 1)*block || budget/2 < record_size + 2*sizeof(void*))
+    {
+        INDEX_ERROR;
+        return NULL;
+    }
+    heap = (EXT_HEAP*)Calloc(1, sizeof(EXT_HEAP));
+    heap->record_size = record_size;
+    heap->compare = compare;
+    heap->dir = dir ? strdup(dir) : NULL;
+    heap->capacity = budget/2/(record_size + 2*sizeof(void*));//the record, its free and heap pointers
+    heap->capacity = heap->capacity < INT_MAX ? heap->capacity : INT_MAX;
+    heap->arena = (char*)Malloc(heap->capacity*record_size);
+    heap->free_slots = (void**)Malloc(heap->capacity*sizeof(void*));
+    for(size_t i = 0; i < heap->capacity; i++)
+        heap->free_slots[i] = heap->arena + (heap->capacity - 1 - i)*record_size;
+    heap->free_count = heap->capacity;
+    heap->inserted = create_dary_heap(4, (int)heap->capacity, compare);
+    heap->block_records = block_records;
+    heap->max_runs = (int)(budget/2/block) - 1;//one block is the writer's
+    heap->runs = create_dary_heap(2, heap->max_runs + 1, _ext_run_compare);
+    heap->writer.buf = (char*)Malloc(block);
+    heap->out = (char*)Malloc(record_size);
+    return heap;
+}
+
+int _ext_run_compare(void *arg1, void *arg2)
+{
+    EXT_RUN *a = (EXT_RUN*)arg1, *b = (EXT_RUN*)arg2;
+
+    return a->owner->compare(_ext_run_head(a), _ext_run_head(b));
+}
+
+void *_ext_run_head(EXT_RUN *run)
+{
+    return run->block + run->pos*run->owner->record_size;
+}
+
+//next block of the run; false when the run is used up
+bool _ext_run_fill(EXT_RUN *run)
+{
+    EXT_HEAP *heap = run->owner;
+    size_t want = run->on_disk < heap->block_records ? (size_t)run->on_disk : heap->block_records;
+
+    run->pos = 0;
+    run->count = want ? fread(run->block, heap->record_size, want, run->fp) : 0;
+    if(run->count < want)
+    {
+        printf("ERROR: SHORT READ ON A RUN, %llu RECORDS LOST!!\n", (unsigned long long)(run->on_disk - run->count));
+        heap->count -= run->on_disk - run->count;
+    }
+    run->on_disk = run->count < want ? 0 : run->on_disk - run->count;
+    heap->stats.bytes_read += run->count*heap->record_size;
+    return run->count > 0;
+}
+
+uint64_t _ext_run_left(EXT_RUN *run)
+{
+    return run->count - run->pos + run->on_disk;
+}
+
+//qsort order of EXT_RUN pointers: fewest records left first
+int _ext_run_size_compare(const void *arg1, const void *arg2)
+{
+    uint64_t a = _ext_run_left(*(EXT_RUN**)arg1), b = _ext_run_left(*(EXT_RUN**)arg2);
+
+    return a < b ? -1 : a > b;
+}
+
+bool _ext_run_advance(EXT_RUN *run)
+{
+    if(++run->pos < run->count)
+        return true;
+    return _ext_run_fill(run);
+}
+
+void _ext_run_destroy(EXT_RUN *run)
+{
+    fclose(run->fp);
+    free(run->block);
+    free(run);
+}
+
+//an anonymous file: created and unlinked right away
+FILE *_ext_run_file(EXT_HEAP *heap)
+{
+    char *path;
+    int fd;
+    FILE *fp;
+
+    if(!heap->dir)
+        return tmpfile();
+    path = (char*)Malloc(strlen(heap->dir) + sizeof("/ext_run_XXXXXX"));
+    sprintf(path, "%s/ext_run_XXXXXX", heap->dir);
+    fd = mkstemp(path);
+    if(fd != -1)
+        unlink(path);
+    free(path);
+    if(fd == -1 || !(fp = fdopen(fd, "w+b")))
+    {
+        if(fd != -1)
+            close(fd);
+        return NULL;
+    }
+    return fp;
+}
+
+void _ext_writer_put(EXT_HEAP *heap, void *record)
+{
+    EXT_WRITER *w = &heap->writer;
+
+    if(w->used + heap->record_size > heap->block_records*heap->record_size)
+    {
+        if(fwrite(w->buf, 1, w->used, w->fp) != w->used)
+            w->failed = true;
+        heap->stats.bytes_written += w->used;
+        w->used = 0;
+    }
+    memcpy(w->buf + w->used, record, heap->record_size);
+    w->used += heap->record_size;
+}
+
+//flushes and rewinds the run for reading
+bool _ext_writer_finish(EXT_HEAP *heap)
+{
+    EXT_WRITER *w = &heap->writer;
+
+    if(w->used && fwrite(w->buf, 1, w->used, w->fp) != w->used)
+        w->failed = true;
+    heap->stats.bytes_written += w->used;
+    w->used = 0;
+    if(fflush(w->fp) != 0 || fseek(w->fp, 0, SEEK_SET) != 0)
+        w->failed = true;
+    return !w->failed;
+}
+
+bool _ext_add_run(EXT_HEAP *heap, FILE *fp, uint64_t records)
+{
+    EXT_RUN *run = (EXT_RUN*)Malloc(sizeof(EXT_RUN));
+
+    run->owner = heap;
+    run->fp = fp;
+    run->block = (char*)Malloc(heap->block_records*heap->record_size);
+    run->on_disk = records;
+    if(!_ext_run_fill(run))
+    {
+        _ext_run_destroy(run);
+        return false;
+    }
+    dary_heap_insert(heap->runs, run);
+    return true;
+}
+
+//the insertion heap, in order, into a new run; the arena is empty afterwards
+bool _ext_spill(EXT_HEAP *heap)
+{
+    uint64_t records = heap->inserted->count;
+    void *slot;
+
+    if(heap->runs->count >= heap->max_runs && !_ext_merge_runs(heap))
+        return false;
+    if(!(heap->writer.fp = _ext_run_file(heap)))
+    {
+        FOPEN_ERROR;
+        return false;
+    }
+    heap->writer.failed = false;
+    while((slot = dary_heap_get_min(heap->inserted)))
+    {
+        _ext_writer_put(heap, slot);
+        heap->free_slots[heap->free_count++] = slot;
+    }
+    if(!_ext_writer_finish(heap))
+    {
+        printf("ERROR: CANNOT WRITE A RUN, %llu RECORDS LOST!!\n", (unsigned long long)records);
+        fclose(heap->writer.fp);
+        heap->count -= records;
+        return false;
+    }
+    heap->stats.runs++;
+    return _ext_add_run(heap, heap->writer.fp, records);
+}
+
+//the smallest runs into one, through a heap of their own: frees blocks for more runs
+bool _ext_merge_runs(EXT_HEAP *heap)
+{
+    EXT_RUN *run, **all;
+    DARY_HEAP *merging;
+    uint64_t records = 0, merged;
+    int n = heap->runs->count, fan = n < 2 ? n : 2;
+
+    if(!(heap->writer.fp = _ext_run_file(heap)))
+    {
+        FOPEN_ERROR;
+        return false;
+    }
+    heap->writer.failed = false;
+    //split the runs: the fan smallest to merge, the rest back into the run heap
+    all = (EXT_RUN**)Malloc(n*sizeof(EXT_RUN*));
+    memcpy(all, heap->runs->ary, n*sizeof(EXT_RUN*));
+    qsort(all, n, sizeof(EXT_RUN*), _ext_run_size_compare);
+    merged = 0;
+    for(int i = 0; i < fan; i++)
+        merged += _ext_run_left(all[i]);
+    while(fan < n && _ext_run_left(all[fan]) <= 2*merged)
+        merged += _ext_run_left(all[fan++]);
+    merging = create_dary_heap(2, fan, _ext_run_compare);
+    dary_heap_build(merging, (void**)all, fan);
+    heap->runs->count = 0;
+    dary_heap_build(heap->runs, (void**)(all + fan), n - fan);
+    free(all);
+    while((run = (EXT_RUN*)dary_heap_peek(merging)))
+    {
+        _ext_writer_put(heap, _ext_run_head(run));
+        records++;
+        if(_ext_run_advance(run))
+            dary_heap_replace_min(merging, run);
+        else
+            _ext_run_destroy((EXT_RUN*)dary_heap_get_min(merging));
+    }
+    destroy_dary_heap(merging);
+    if(!_ext_writer_finish(heap))
+    {
+        printf("ERROR: CANNOT WRITE A RUN, %llu RECORDS LOST!!\n", (unsigned long long)records);
+        fclose(heap->writer.fp);
+        heap->count -= records;
+        return false;
+    }
+    heap->stats.merges++;
+    return _ext_add_run(heap, heap->writer.fp, records);
+}
+
+//copies record_size bytes from data_in
+bool ext_heap_insert(EXT_HEAP *heap, void *data_in)
+{
+    void *slot;
+
+    if(heap->free_count == 0 && !_ext_spill(heap))
+        return false;
+    slot = heap->free_slots[--heap->free_count];
+    memcpy(slot, data_in, heap->record_size);
+    dary_heap_insert(heap->inserted, slot);
+    heap->count++;
+    return true;
+}
+
+//the smallest record, NULL if empty
+void *ext_heap_get_min(EXT_HEAP *heap)
+{
+    EXT_RUN *run = (EXT_RUN*)dary_heap_peek(heap->runs);
+    void *slot = dary_heap_peek(heap->inserted);
+
+    if(!run && !slot)
+        return NULL;
+    if(slot && (!run || heap->compare(slot, _ext_run_head(run)) <= 0))
+    {
+        dary_heap_get_min(heap->inserted);
+        memcpy(heap->out, slot, heap->record_size);
+        heap->free_slots[heap->free_count++] = slot;
+    }
+    else
+    {
+        memcpy(heap->out, _ext_run_head(run), heap->record_size);
+        if(_ext_run_advance(run))
+            dary_heap_replace_min(heap->runs, run);
+        else
+            _ext_run_destroy((EXT_RUN*)dary_heap_get_min(heap->runs));
+    }
+    heap->count--;
+    return heap->out;
+}
+
+void print_ext_heap_stats(EXT_HEAP *heap)
+{
+    printf("records: %llu (%d runs open), runs spilled: %llu, merges: %llu, MB written: %.1f, MB read: %.1f\n",
+           (unsigned long long)heap->count, heap->runs->count, (unsigned long long)heap->stats.runs,
+           (unsigned long long)heap->stats.merges, heap->stats.bytes_written/1e6, heap->stats.bytes_read/1e6);
+}
+
+void destroy_ext_heap(EXT_HEAP *heap)
+{
+    EXT_RUN *run;
+
+    while((run = (EXT_RUN*)dary_heap_get_min(heap->runs)))
+        _ext_run_destroy(run);
+    destroy_dary_heap(heap->runs);
+    destroy_dary_heap(heap->inserted);
+    free(heap->writer.buf);
+    free(heap->out);
+    free(heap->free_slots);
+    free(heap->arena);
+    free(heap->dir);
+    free(heap);
+}
+#endif /* ext_heap_h */
@@ -0,0 +1,373 @@
+/* IPv4 FORWARDING TABLE: LONGEST PREFIX MATCH, DIR-24-8 LAYOUT */
+
+#ifndef fib_h
+#define fib_h
+#include "wrappers.h"
+#include "hash_table.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ every IPv4 address resolves in AT MOST TWO memory accesses, whatever the prefix mix:
+   tbl24[addr >> 8]: one entry per /24 (16M x 4 bytes). prefixes /0../24 are expanded into it.
+   tbl8[group][addr & 0xff]: 256-entry groups, one per /24 that holds a longer prefix (/25../32).
+ an entry is {next hop:24, depth:6, valid:1, ext:1}. ext set in tbl24 means "the low 24 bits
+ are a tbl8 group", the second access. depth is the prefix length that wrote the entry: a
+ shorter prefix never overwrites a longer one, and a delete only rewrites what it wrote.
+
+ the rules themselves (prefix/len -> next hop) live in a KEYED hash table on the side. lookups
+ never touch it; a delete uses it to find the longest covering rule that takes over.
+ tbl8 groups come from a fixed pool sized at create time and are handed back when a delete
+ leaves a group uniform, so the tables never move under a reader.
+
+ fib_lookup_bulk() resolves a batch: with AVX2, 8 addresses per step as one gather into tbl24
+ and, only if some of them hit a group, one masked gather into tbl8. without AVX2 the batch
+ is resolved in blocks of FIB_BULK so the tbl24 misses of a block overlap.
+ */
+#define FIB_TBL24_SIZE (1 << 24)
+#define FIB_GROUP_SIZE 256
+#define FIB_NEXT_HOP_MASK 0x00ffffffU
+#define FIB_DEPTH_SHIFT 24
+#define FIB_VALID 0x40000000U
+#define FIB_EXT 0x80000000U
+#define FIB_NO_ROUTE 0xffffffffU //lookup result for addresses no rule covers
+#define FIB_MAX_NEXT_HOP FIB_NEXT_HOP_MASK
+#define FIB_MAX_GROUPS (1 << 23) //tbl8 index g*256 + low byte stays a positive int32 (gathers)
+#define FIB_BULK 16
+
+typedef struct fib_rule
+{
+    uint64_t key;//prefix << 8 | len: one word, hashed and compared as a u64
+    uint32_t next_hop;
+}FIB_RULE;
+
+typedef struct fib
+{
+    uint32_t *tbl24;
+    uint32_t *tbl8;
+    uint32_t group_count;
+    uint32_t groups_used;
+    uint32_t *free_groups;//stack of returned group indices
+    uint32_t free_top;
+    HASH_TABLE *rules;
+    uint32_t rule_count;
+}FIB;
+
+FIB *create_fib(uint32_t tbl8_groups);
+bool fib_insert(FIB *fib, uint32_t prefix, uint8_t len, uint32_t next_hop);
+bool fib_delete(FIB *fib, uint32_t prefix, uint8_t len);
+uint32_t fib_lookup(FIB *fib, uint32_t addr);
+void fib_lookup_bulk(FIB *fib, const uint32_t *addrs, uint32_t *next_hops, int n);
+int fib_load(FIB *fib, char *file);
+bool fib_parse_route(char *line, uint32_t *prefix, uint8_t *len, uint32_t *next_hop);
+void destroy_fib(FIB *fib);
+const void *_fib_rule_key(void *data);
+FIB_RULE *_fib_find_rule(FIB *fib, uint32_t prefix, uint8_t len);
+FIB_RULE *_fib_covering_rule(FIB *fib, uint32_t prefix, uint8_t len);
+void _fib_set_range(uint32_t *tbl, uint32_t first, uint32_t count, uint32_t entry, uint8_t len, bool remove);
+bool _fib_alloc_group(FIB *fib, uint32_t idx24);
+void _fib_try_collapse(FIB *fib, uint32_t idx24);
+
+#define FIB_MASK(len) ((len) == 0 ? 0 : 0xffffffffU << (32 - (len)))
+#define FIB_ENTRY(next_hop, len) (FIB_VALID | (uint32_t)(len) << FIB_DEPTH_SHIFT | (next_hop))
+#define FIB_DEPTH(entry) (((entry) >> FIB_DEPTH_SHIFT) & 0x3f)
+#define FIB_RULE_KEY(prefix, len) ((uint64_t)(prefix) << 8 | (len))
+
+const HT_KEY_OPS fib_rule_ops = {_fib_rule_key, ht_u64_hash, ht_u64_equal};
+
+const void *_fib_rule_key(void *data)
+{
+    return &((FIB_RULE*)data)->key;
+}
+
+FIB *create_fib(uint32_t tbl8_groups)
+{
+    FIB *fib;
+
+    if(tbl8_groups > FIB_MAX_GROUPS)
+        tbl8_groups = FIB_MAX_GROUPS;
+    fib = (FIB*)Malloc(sizeof(FIB));
+    //zero is an invalid entry: calloc gives an empty table (and untouched pages stay unbacked)
+    fib->tbl24 = (uint32_t*)Calloc(FIB_TBL24_SIZE, sizeof(uint32_t));
+    fib->tbl8 = (uint32_t*)Calloc((size_t)tbl8_groups*FIB_GROUP_SIZE, sizeof(uint32_t));
+    fib->group_count = tbl8_groups;
+    fib->groups_used = 0;
+    fib->free_groups = (uint32_t*)Malloc((tbl8_groups + 1)*sizeof(uint32_t));
+    fib->free_top = 0;
+    fib->rules = create_keyed_hash_table(64, &fib_rule_ops, NULL);
+    fib->rule_count = 0;
+    return fib;
+}
+
+//at most two accesses: tbl24, then the tbl8 group if the /24 holds longer prefixes
+uint32_t fib_lookup(FIB *fib, uint32_t addr)
+{
+    uint32_t e = fib->tbl24[addr >> 8];
+
+    if(e & FIB_EXT)
+        e = fib->tbl8[(e & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE + (addr & 0xff)];
+    return (e & FIB_VALID) ? e & FIB_NEXT_HOP_MASK : FIB_NO_ROUTE;
+}
+
+void fib_lookup_bulk(FIB *fib, const uint32_t *addrs, uint32_t *next_hops, int n)
+{
+    uint32_t e[FIB_BULK];
+    int i = 0, b;
+
+#if defined(__AVX2__)
+    const __m256i hop_mask = _mm256_set1_epi32((int)FIB_NEXT_HOP_MASK);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    __m256i a, v, ext, valid;
+
+    for(; i + 8 <= n; i += 8)
+    {
+        a = _mm256_loadu_si256((const __m256i*)&addrs[i]);
+        v = _mm256_i32gather_epi32((const int*)fib->tbl24, _mm256_srli_epi32(a, 8), 4);
+        ext = _mm256_srai_epi32(v, 31);//FIB_EXT is the sign bit: all ones where set
+        if(!_mm256_testz_si256(ext, ext))
+            v = _mm256_mask_i32gather_epi32(v, (const int*)fib->tbl8,
+                    _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, hop_mask), 8), _mm256_and_si256(a, low_byte)), ext, 4);
+        valid = _mm256_srai_epi32(_mm256_slli_epi32(v, 1), 31);//FIB_VALID -> all ones
+        //valid: the next hop, otherwise all ones == FIB_NO_ROUTE
+        _mm256_storeu_si256((__m256i*)&next_hops[i], _mm256_or_si256(_mm256_and_si256(v, _mm256_and_si256(valid, hop_mask)), _mm256_andnot_si256(valid, _mm256_set1_epi32(-1))));
+    }
+#endif
+    for(; i < n; i += FIB_BULK)
+    {
+        b = n - i < FIB_BULK ? n - i : FIB_BULK;
+        for(int k = 0; k < b; k++)//independent loads: the misses of the block overlap
+            e[k] = fib->tbl24[addrs[i+k] >> 8];
+        for(int k = 0; k < b; k++)
+        {
+            if(e[k] & FIB_EXT)
+                e[k] = fib->tbl8[(e[k] & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE + (addrs[i+k] & 0xff)];
+            next_hops[i+k] = (e[k] & FIB_VALID) ? e[k] & FIB_NEXT_HOP_MASK : FIB_NO_ROUTE;
+        }
+    }
+}
+
+FIB_RULE *_fib_find_rule(FIB *fib, uint32_t prefix, uint8_t len)
+{
+    uint64_t key = FIB_RULE_KEY(prefix, len);
+
+    return (FIB_RULE*)keyed_ht_retrieve(fib->rules, &key);
+}
+
+//longest rule strictly shorter than len that covers prefix/len, NULL if none
+FIB_RULE *_fib_covering_rule(FIB *fib, uint32_t prefix, uint8_t len)
+{
+    FIB_RULE *rule;
+
+    for(int d = len - 1; d >= 0; d--)
+        if((rule = _fib_find_rule(fib, prefix & FIB_MASK(d), (uint8_t)d)))
+            return rule;
+    return NULL;
+}
+
+/*
+ writes entry over tbl[first..first+count). insert (remove == false): only over entries of
+ depth <= len, longer prefixes underneath keep winning. delete: only over entries of exactly
+ depth len, i.e. the ones the deleted rule wrote. ext entries are left to the caller, which
+ walks their groups.
+ */
+void _fib_set_range(uint32_t *tbl, uint32_t first, uint32_t count, uint32_t entry, uint8_t len, bool remove)
+{
+    uint32_t e;
+
+    for(uint32_t i = first; i < first + count; i++)
+    {
+        e = tbl[i];
+        if(e & FIB_EXT)
+            continue;//handled by the caller, it knows where the groups are
+        if(remove ? ((e & FIB_VALID) && FIB_DEPTH(e) == len) : (!(e & FIB_VALID) || FIB_DEPTH(e) <= len))
+            tbl[i] = entry;
+    }
+}
+
+//gives the /24 at idx24 a group that starts as 256 copies of its tbl24 entry.
+//the group is filled before tbl24 points at it: a reader sees the old entry or the full group.
+bool _fib_alloc_group(FIB *fib, uint32_t idx24)
+{
+    uint32_t g, *group;
+
+    if(fib->free_top)
+        g = fib->free_groups[--fib->free_top];
+    else if(fib->groups_used < fib->group_count)
+        g = fib->groups_used++;
+    else
+    {
+        printf("ERROR: FIB OUT OF TBL8 GROUPS!!\n");
+        return false;
+    }
+    group = &fib->tbl8[(size_t)g*FIB_GROUP_SIZE];
+    for(int i = 0; i < FIB_GROUP_SIZE; i++)
+        group[i] = fib->tbl24[idx24];
+    __atomic_store_n(&fib->tbl24[idx24], FIB_EXT | g, __ATOMIC_RELEASE);
+    return true;
+}
+
+//a group whose 256 entries are equal and no longer than /24 folds back into tbl24
+void _fib_try_collapse(FIB *fib, uint32_t idx24)
+{
+    uint32_t g, *group;
+
+    g = fib->tbl24[idx24] & FIB_NEXT_HOP_MASK;
+    group = &fib->tbl8[(size_t)g*FIB_GROUP_SIZE];
+    if((group[0] & FIB_VALID) && FIB_DEPTH(group[0]) > 24)
+        return;
+    for(int i = 1; i < FIB_GROUP_SIZE; i++)
+        if(group[i] != group[0])
+            return;
+    __atomic_store_n(&fib->tbl24[idx24], group[0], __ATOMIC_RELEASE);
+    fib->free_groups[fib->free_top++] = g;
+}
+
+//adds prefix/len -> next_hop, or changes the next hop of an existing rule
+bool fib_insert(FIB *fib, uint32_t prefix, uint8_t len, uint32_t next_hop)
+{
+    FIB_RULE *rule;
+    uint32_t entry, first, count, idx24;
+
+    if(len > 32 || next_hop > FIB_MAX_NEXT_HOP)
+    {
+        INDEX_ERROR;
+        return false;
+    }
+    prefix &= FIB_MASK(len);
+    entry = FIB_ENTRY(next_hop, len);
+    if(len > 24)
+    {
+        idx24 = prefix >> 8;
+        if(!(fib->tbl24[idx24] & FIB_EXT) && !_fib_alloc_group(fib, idx24))
+            return false;
+        first = (fib->tbl24[idx24] & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE + (prefix & 0xff);
+        _fib_set_range(fib->tbl8, first, 1U << (32 - len), entry, len, false);
+    }
+    else
+    {
+        first = prefix >> 8;
+        count = 1U << (24 - len);
+        _fib_set_range(fib->tbl24, first, count, entry, len, false);
+        for(uint32_t i = first; i < first + count; i++)
+            if(fib->tbl24[i] & FIB_EXT)
+                _fib_set_range(fib->tbl8, (fib->tbl24[i] & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE, FIB_GROUP_SIZE, entry, len, false);
+    }
+    if((rule = _fib_find_rule(fib, prefix, len)))
+    {
+        rule->next_hop = next_hop;
+        return true;
+    }
+    rule = (FIB_RULE*)Malloc(sizeof(FIB_RULE));
+    rule->key = FIB_RULE_KEY(prefix, len);
+    rule->next_hop = next_hop;
+    keyed_ht_insert(fib->rules, rule);
+    fib->rule_count++;
+    return true;
+}
+
+//removes prefix/len; what it covered falls back to the longest shorter rule, if any
+bool fib_delete(FIB *fib, uint32_t prefix, uint8_t len)
+{
+    FIB_RULE *rule, *cover;
+    uint32_t entry, first, count, idx24;
+
+    if(len > 32)
+        return false;
+    prefix &= FIB_MASK(len);
+    if(!(rule = _fib_find_rule(fib, prefix, len)))
+    {
+        DELETE_ERROR;
+        return false;
+    }
+    cover = _fib_covering_rule(fib, prefix, len);
+    entry = cover ? FIB_ENTRY(cover->next_hop, (uint32_t)(cover->key & 0xff)) : 0;
+    if(len > 24)
+    {
+        idx24 = prefix >> 8;
+        first = (fib->tbl24[idx24] & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE + (prefix & 0xff);
+        _fib_set_range(fib->tbl8, first, 1U << (32 - len), entry, len, true);
+        _fib_try_collapse(fib, idx24);
+    }
+    else
+    {
+        first = prefix >> 8;
+        count = 1U << (24 - len);
+        _fib_set_range(fib->tbl24, first, count, entry, len, true);
+        for(uint32_t i = first; i < first + count; i++)
+            if(fib->tbl24[i] & FIB_EXT)
+            {
+                _fib_set_range(fib->tbl8, (fib->tbl24[i] & FIB_NEXT_HOP_MASK)*FIB_GROUP_SIZE, FIB_GROUP_SIZE, entry, len, true);
+                _fib_try_collapse(fib, i);
+            }
+    }
+    keyed_ht_delete(fib->rules, &rule->key);
+    free(rule);
+    fib->rule_count--;
+    return true;
+}
+
+/*
+ ROUTE LINE: "a.b.c.d[/len] [next_hop]". a bare address is a /24 (the old prefix24_hash
+ table), a missing next hop is left to the caller (*next_hop untouched).
+ */
+bool fib_parse_route(char *line, uint32_t *prefix, uint8_t *len, uint32_t *next_hop)
+{
+    unsigned o[4], l, nh;
+    int used;
+
+    if(sscanf(line, "%u.%u.%u.%u%n", &o[0], &o[1], &o[2], &o[3], &used) != 4
+       || o[0] > 255 || o[1] > 255 || o[2] > 255 || o[3] > 255)
+        return false;
+    line += used;
+    l = 24;
+    if(*line == '/')
+    {
+        if(sscanf(line + 1, "%u%n", &l, &used) != 1 || l > 32)
+            return false;
+        line += used + 1;
+    }
+    if(sscanf(line, "%u", &nh) == 1)
+        *next_hop = nh;
+    *prefix = o[0] << 24 | o[1] << 16 | o[2] << 8 | o[3];
+    *len = (uint8_t)l;
+    return true;
+}
+
+//one route per line. lines without a next hop follow prefix24_hash's pairing: routes 2i and
+//2i+1 go out interface i. returns the routes installed.
+int fib_load(FIB *fib, char *file)
+{
+    FILE *fp;
+    char buffer[128];
+    uint32_t prefix, next_hop;
+    uint8_t len;
+    int line, installed;
+
+    fp = Fopen(file, "r");
+    line = installed = 0;
+    while(fgets(buffer, sizeof(buffer), fp))
+    {
+        next_hop = (uint32_t)line/2;
+        if(fib_parse_route(buffer, &prefix, &len, &next_hop))
+        {
+            if(fib_insert(fib, prefix, len, next_hop))
+                installed++;
+            line++;
+        }
+    }
+    Fclose(fp);
+    return installed;
+}
+
+void destroy_fib(FIB *fib)
+{
+    for(int e = 0; e < fib->rules->entry_used; e++)
+        free(fib->rules->entries[e].satellite);//NULL for freed entries
+    free_ht(fib->rules);
+    free(fib->free_groups);
+    free(fib->tbl8);
+    free(fib->tbl24);
+    free(fib);
+}
+#endif /* fib_h */
@@ -0,0 +1,442 @@
+/* IPv6 FORWARDING TABLE: LONGEST PREFIX MATCH, STRIDE TRIE 24-8-4-4-... */
+
+#ifndef fib6_h
+#define fib6_h
+#include <arpa/inet.h>
+#include "wrappers.h"
+#include "hash_table.h"
+
+/*
+ fib.h's scheme carried to 128 bits, with strides that follow how IPv6 is handed out:
+   level 0: tbl24, the first 3 bytes.                               resolves /0../24
+   level 1: 256-entry groups, byte 3.                               resolves ../32
+   level 2..25: 16-entry groups (one cache line), one nibble each.  resolves ../36, ../40 ... ../128
+ allocations are /29../32 (levels 0-1), and everything below them is assigned on nibble
+ boundaries (/36, /40, /44, /48, /56, /64): the common lengths end exactly on a level, expand
+ into ONE entry, and a new /48 costs four 64-byte groups, not kilobytes. a lookup is one
+ access per level it descends: a /32 takes 2, a /48 6, a /64 10.
+ nothing in a default-free table is shorter than /16, so only the pages of tbl24 that cover
+ allocated space are ever backed.
+
+ entry: {next hop or group:22, depth:8, valid:1, ext:1}. ext entries at level 0 point into the
+ 256-entry pool, deeper ones into the 16-entry pool. depth and the rule table (a KEYED hash
+ table of prefix/len) work as in fib.h: inserts never overwrite longer prefixes, deletes
+ rewrite only their own entries with the longest covering rule, and a group that becomes
+ uniform folds back into its parent entry.
+ */
+#define FIB6_TBL24_SIZE (1 << 24)
+#define FIB6_LEVELS 26 //24 + 8 + 24*4 = 128
+#define FIB6_NEXT_HOP_MASK 0x003fffffU
+#define FIB6_DEPTH_SHIFT 22
+#define FIB6_VALID 0x40000000U
+#define FIB6_EXT 0x80000000U
+#define FIB6_NO_ROUTE 0xffffffffU
+#define FIB6_MAX_NEXT_HOP FIB6_NEXT_HOP_MASK
+
+typedef struct fib6_key
+{
+    uint8_t prefix[16];//network byte order, bits past len zeroed
+    uint8_t len;
+}FIB6_KEY;
+
+typedef struct fib6_rule
+{
+    FIB6_KEY key;
+    uint32_t next_hop;
+}FIB6_RULE;
+
+//groups of one size, addressed by index: the array may move when it grows
+typedef struct fib6_pool
+{
+    uint32_t *entries;
+    uint32_t group_size;
+    uint32_t count, cap;
+    uint32_t *free_groups;
+    uint32_t free_top;
+}FIB6_POOL;
+
+typedef struct fib6
+{
+    uint32_t *tbl24;
+    FIB6_POOL pools[2];//[0]: 256-entry groups of level 1, [1]: 16-entry groups below
+    HASH_TABLE *rules;
+    uint32_t rule_count;
+}FIB6;
+
+FIB6 *create_fib6(uint32_t initial_groups);
+bool fib6_insert(FIB6 *fib, const uint8_t prefix[16], uint8_t len, uint32_t next_hop);
+bool fib6_delete(FIB6 *fib, const uint8_t prefix[16], uint8_t len);
+uint32_t fib6_lookup(FIB6 *fib, const uint8_t addr[16]);
+bool fib6_parse_route(char *line, uint8_t prefix[16], uint8_t *len, uint32_t *next_hop);
+int fib6_load(FIB6 *fib, char *file);
+size_t fib6_memory(FIB6 *fib);
+void destroy_fib6(FIB6 *fib);
+const void *_fib6_rule_key(void *data);
+uint64_t _fib6_key_hash(const void *key);
+bool _fib6_key_equal(const void *key1, const void *key2);
+void _fib6_mask(uint8_t dst[16], const uint8_t src[16], uint8_t len);
+FIB6_RULE *_fib6_find_rule(FIB6 *fib, const uint8_t prefix[16], uint8_t len);
+uint32_t _fib6_index(const uint8_t addr[16], int level);
+uint32_t _fib6_alloc_group(FIB6_POOL *pool, uint32_t fill);
+bool _fib6_try_collapse(FIB6 *fib, uint32_t *parent, int level);
+void _fib6_set_range(FIB6 *fib, uint32_t *tbl, int level, uint32_t first, uint32_t count, uint32_t entry, uint8_t len, bool remove);
+uint32_t *_fib6_walk(FIB6 *fib, const uint8_t prefix[16], int level_end, bool create, uint32_t **path);
+
+#define FIB6_STRIDE(level) ((level) == 0 ? 24 : (level) == 1 ? 8 : 4)
+#define FIB6_LEVEL_END(level) ((level) == 0 ? 24 : (level) == 1 ? 32 : 28 + 4*(level)) //prefix bits resolved
+#define FIB6_LEVEL_OF(len) ((len) <= 24 ? 0 : (len) <= 32 ? 1 : ((len) - 25)/4)
+#define FIB6_POOL_OF(fib, level) (&(fib)->pools[(level) == 1 ? 0 : 1]) //pool of the groups AT level
+#define FIB6_GROUP(pool, entry) (&(pool)->entries[(size_t)((entry) & FIB6_NEXT_HOP_MASK)*(pool)->group_size])
+#define FIB6_ENTRY(next_hop, len) (FIB6_VALID | (uint32_t)(len) << FIB6_DEPTH_SHIFT | (next_hop))
+#define FIB6_DEPTH(entry) (((entry) >> FIB6_DEPTH_SHIFT) & 0xff)
+#define FIB6_INDEX24(a) ((uint32_t)(a)[0] << 16 | (uint32_t)(a)[1] << 8 | (a)[2])
+#define FIB6_NIBBLE(a, bit) (((a)[(bit) >> 3] >> (((bit) & 4) ^ 4)) & 0xf)
+
+const HT_KEY_OPS fib6_rule_ops = {_fib6_rule_key, _fib6_key_hash, _fib6_key_equal};
+
+const void *_fib6_rule_key(void *data)
+{
+    return &((FIB6_RULE*)data)->key;
+}
+
+uint64_t _fib6_key_hash(const void *key)
+{
+    return ht_hash_bytes(key, sizeof(FIB6_KEY), 0);//17 bytes, no padding
+}
+
+bool _fib6_key_equal(const void *key1, const void *key2)
+{
+    return memcmp(key1, key2, sizeof(FIB6_KEY)) == 0;
+}
+
+void _fib6_mask(uint8_t dst[16], const uint8_t src[16], uint8_t len)
+{
+    for(int i = 0; i < 16; i++)
+    {
+        if(8*i + 8 <= len)
+            dst[i] = src[i];
+        else if(8*i >= len)
+            dst[i] = 0;
+        else
+            dst[i] = src[i] & (uint8_t)(0xff << (8 - len % 8));
+    }
+}
+
+FIB6 *create_fib6(uint32_t initial_groups)
+{
+    FIB6 *fib = (FIB6*)Malloc(sizeof(FIB6));
+    FIB6_POOL *pool;
+
+    if(initial_groups == 0)
+        initial_groups = 1;
+    fib->tbl24 = (uint32_t*)Calloc(FIB6_TBL24_SIZE, sizeof(uint32_t));//pages stay unbacked until written
+    for(int p = 0; p < 2; p++)
+    {
+        pool = &fib->pools[p];
+        pool->group_size = p == 0 ? 256 : 16;
+        pool->cap = initial_groups;
+        pool->entries = (uint32_t*)Malloc((size_t)pool->cap*pool->group_size*sizeof(uint32_t));
+        pool->free_groups = (uint32_t*)Malloc(pool->cap*sizeof(uint32_t));
+        pool->count = pool->free_top = 0;
+    }
+    fib->rules = create_keyed_hash_table(64, &fib6_rule_ops, NULL);
+    fib->rule_count = 0;
+    return fib;
+}
+
+//one access per level: tbl24, byte 3 in a 256-entry group, then a nibble per 16-entry group
+uint32_t fib6_lookup(FIB6 *fib, const uint8_t addr[16])
+{
+    uint32_t e = fib->tbl24[FIB6_INDEX24(addr)];
+
+    if(e & FIB6_EXT)
+    {
+        e = FIB6_GROUP(&fib->pools[0], e)[addr[3]];
+        for(int bit = 32; e & FIB6_EXT; bit += 4)
+            e = FIB6_GROUP(&fib->pools[1], e)[FIB6_NIBBLE(addr, bit)];
+    }
+    return (e & FIB6_VALID) ? e & FIB6_NEXT_HOP_MASK : FIB6_NO_ROUTE;
+}
+
+//slot of addr in a table of level
+uint32_t _fib6_index(const uint8_t addr[16], int level)
+{
+    if(level == 0)
+        return FIB6_INDEX24(addr);
+    if(level == 1)
+        return addr[3];
+    return FIB6_NIBBLE(addr, FIB6_LEVEL_END(level - 1));
+}
+
+FIB6_RULE *_fib6_find_rule(FIB6 *fib, const uint8_t prefix[16], uint8_t len)
+{
+    FIB6_KEY key;
+
+    _fib6_mask(key.prefix, prefix, len);
+    key.len = len;
+    return (FIB6_RULE*)keyed_ht_retrieve(fib->rules, &key);
+}
+
+//a group of copies of fill. the pool may move: callers hold indices, not pointers, across this.
+uint32_t _fib6_alloc_group(FIB6_POOL *pool, uint32_t fill)
+{
+    uint32_t g, *group;
+
+    if(pool->free_top)
+        g = pool->free_groups[--pool->free_top];
+    else
+    {
+        if(pool->count == pool->cap)
+        {
+            if(pool->cap > FIB6_NEXT_HOP_MASK/2)
+            {
+                printf("ERROR: FIB6 OUT OF GROUPS!!\n");
+                return FIB6_NO_ROUTE;
+            }
+            pool->cap *= 2;
+            pool->entries = (uint32_t*)Realloc(pool->entries, (size_t)pool->cap*pool->group_size*sizeof(uint32_t));
+            pool->free_groups = (uint32_t*)Realloc(pool->free_groups, pool->cap*sizeof(uint32_t));
+        }
+        g = pool->count++;
+    }
+    group = &pool->entries[(size_t)g*pool->group_size];
+    for(uint32_t i = 0; i < pool->group_size; i++)
+        group[i] = fill;
+    return g;
+}
+
+//the group at level under *parent folds into *parent if it is uniform and no entry in it is
+//longer than the prefix *parent stands for. true if it did.
+bool _fib6_try_collapse(FIB6 *fib, uint32_t *parent, int level)
+{
+    FIB6_POOL *pool = FIB6_POOL_OF(fib, level);
+    uint32_t *group = FIB6_GROUP(pool, *parent);
+
+    if((group[0] & FIB6_EXT) || ((group[0] & FIB6_VALID) && (int)FIB6_DEPTH(group[0]) > FIB6_LEVEL_END(level - 1)))
+        return false;
+    for(uint32_t i = 1; i < pool->group_size; i++)
+        if(group[i] != group[0])
+            return false;
+    pool->free_groups[pool->free_top++] = *parent & FIB6_NEXT_HOP_MASK;
+    *parent = group[0];
+    return true;
+}
+
+/*
+ fib.h's depth rule over tbl[first..first+count) at level, descending into every group in
+ the range: insert writes over depth <= len, delete over depth == len (and folds the groups
+ it emptied of longer prefixes). groups are never allocated here, so tbl stays put.
+ */
+void _fib6_set_range(FIB6 *fib, uint32_t *tbl, int level, uint32_t first, uint32_t count, uint32_t entry, uint8_t len, bool remove)
+{
+    FIB6_POOL *below = FIB6_POOL_OF(fib, level + 1);
+    uint32_t e;
+
+    for(uint32_t i = first; i < first + count; i++)
+    {
+        e = tbl[i];
+        if(e & FIB6_EXT)
+        {
+            _fib6_set_range(fib, FIB6_GROUP(below, e), level + 1, 0, below->group_size, entry, len, remove);
+            if(remove)
+                _fib6_try_collapse(fib, &tbl[i], level + 1);
+        }
+        else if(remove ? ((e & FIB6_VALID) && FIB6_DEPTH(e) == len) : (!(e & FIB6_VALID) || FIB6_DEPTH(e) <= len))
+            tbl[i] = entry;
+    }
+}
+
+/*
+ follows prefix from tbl24 down to the table of level_end and returns it. create: missing
+ groups are allocated (filled from their parent entry) on the way; otherwise NULL if the path
+ stops early. path[l] = the entry at level l that points to the next level (l < level_end).
+ */
+uint32_t *_fib6_walk(FIB6 *fib, const uint8_t prefix[16], int level_end, bool create, uint32_t **path)
+{
+    FIB6_POOL *pool, *below;
+    uint32_t *tbl, *e, g;
+    size_t offset;
+
+    tbl = fib->tbl24;
+    e = &fib->tbl24[FIB6_INDEX24(prefix)];
+    pool = NULL;//pool of the table e is in, NULL for tbl24
+    for(int level = 0; level < level_end; level++)
+    {
+        below = FIB6_POOL_OF(fib, level + 1);
+        if(!(*e & FIB6_EXT))
+        {
+            if(!create)
+                return NULL;
+            offset = pool ? (size_t)(e - pool->entries) : 0;
+            if((g = _fib6_alloc_group(below, *e)) == FIB6_NO_ROUTE)
+                return NULL;
+            if(pool)//e and the new group share the 16-entry pool below level 1: it may have moved
+                e = &pool->entries[offset];
+            *e = FIB6_EXT | g;
+        }
+        if(path)
+            path[level] = e;
+        tbl = FIB6_GROUP(below, *e);
+        e = &tbl[_fib6_index(prefix, level + 1)];
+        pool = below;
+    }
+    return tbl;
+}
+
+//adds prefix/len -> next_hop, or changes the next hop of an existing rule
+bool fib6_insert(FIB6 *fib, const uint8_t prefix[16], uint8_t len, uint32_t next_hop)
+{
+    FIB6_RULE *rule;
+    uint8_t p[16];
+    uint32_t *tbl, first, span;
+    int level;
+
+    if(len > 128 || next_hop > FIB6_MAX_NEXT_HOP)
+    {
+        INDEX_ERROR;
+        return false;
+    }
+    _fib6_mask(p, prefix, len);
+    level = FIB6_LEVEL_OF(len);
+    if(!(tbl = _fib6_walk(fib, p, level, true, NULL)))
+        return false;
+    span = FIB6_LEVEL_END(level) - len;//bits of this level the prefix leaves open
+    first = _fib6_index(p, level) & ~((1U << span) - 1);
+    _fib6_set_range(fib, tbl, level, first, 1U << span, FIB6_ENTRY(next_hop, len), len, false);
+    if((rule = _fib6_find_rule(fib, p, len)))
+    {
+        rule->next_hop = next_hop;
+        return true;
+    }
+    rule = (FIB6_RULE*)Malloc(sizeof(FIB6_RULE));
+    memcpy(rule->key.prefix, p, 16);
+    rule->key.len = len;
+    rule->next_hop = next_hop;
+    keyed_ht_insert(fib->rules, rule);
+    fib->rule_count++;
+    return true;
+}
+
+//removes prefix/len; what it covered falls back to the longest shorter rule, if any
+bool fib6_delete(FIB6 *fib, const uint8_t prefix[16], uint8_t len)
+{
+    FIB6_RULE *rule, *cover;
+    uint32_t *tbl, *path[FIB6_LEVELS], first, span, entry;
+    uint8_t p[16];
+    int level;
+
+    if(len > 128)
+        return false;
+    _fib6_mask(p, prefix, len);
+    if(!(rule = _fib6_find_rule(fib, p, len)))
+    {
+        DELETE_ERROR;
+        return false;
+    }
+    cover = NULL;
+    for(int d = len - 1; d >= 0 && !cover; d--)
+        cover = _fib6_find_rule(fib, p, (uint8_t)d);
+    entry = cover ? FIB6_ENTRY(cover->next_hop, cover->key.len) : 0;
+    level = FIB6_LEVEL_OF(len);
+    if((tbl = _fib6_walk(fib, p, level, false, path)))
+    {
+        span = FIB6_LEVEL_END(level) - len;
+        first = _fib6_index(p, level) & ~((1U << span) - 1);
+        _fib6_set_range(fib, tbl, level, first, 1U << span, entry, len, true);
+        //bottom up: each fold may make the level above uniform
+        for(int l = level - 1; l >= 0 && _fib6_try_collapse(fib, path[l], l + 1); l--)
+            ;
+    }
+    keyed_ht_delete(fib->rules, &rule->key);
+    free(rule);
+    fib->rule_count--;
+    return true;
+}
+
+/*
+ ROUTE LINE: "addr/len [next_hop]" in any inet_pton() form (2001:db8::/32, ::/0 ...). a
+ missing length means /128, a missing next hop is left to the caller.
+ */
+bool fib6_parse_route(char *line, uint8_t prefix[16], uint8_t *len, uint32_t *next_hop)
+{
+    char addr[INET6_ADDRSTRLEN];
+    unsigned l, nh;
+    int n;
+
+    n = (int)strcspn(line, "/ \t\r\n");
+    if(n == 0 || n >= INET6_ADDRSTRLEN)
+        return false;
+    memcpy(addr, line, n);
+    addr[n] = '\0';
+    if(inet_pton(AF_INET6, addr, prefix) != 1)
+        return false;
+    line += n;
+    l = 128;
+    if(*line == '/')
+    {
+        if(sscanf(line + 1, "%u%n", &l, &n) != 1 || l > 128)
+            return false;
+        line += n + 1;
+    }
+    if(sscanf(line, "%u", &nh) == 1)
+        *next_hop = nh;
+    *len = (uint8_t)l;
+    return true;
+}
+
+//one route per line, lines without a next hop get their line number. returns the routes installed.
+int fib6_load(FIB6 *fib, char *file)
+{
+    FILE *fp;
+    char buffer[128];
+    uint8_t prefix[16], len;
+    uint32_t next_hop;
+    int line, installed;
+
+    fp = Fopen(file, "r");
+    line = installed = 0;
+    while(fgets(buffer, sizeof(buffer), fp))
+    {
+        next_hop = (uint32_t)line;
+        if(fib6_parse_route(buffer, prefix, &len, &next_hop))
+        {
+            if(fib6_insert(fib, prefix, len, next_hop))
+                installed++;
+            line++;
+        }
+    }
+    Fclose(fp);
+    return installed;
+}
+
+//groups in use plus the tbl24 pages that hold anything (the rest are never backed)
+size_t fib6_memory(FIB6 *fib)
+{
+    size_t bytes = 0, page_entries = 4096/sizeof(uint32_t);
+
+    for(size_t p = 0; p < FIB6_TBL24_SIZE; p += page_entries)
+        for(size_t i = p; i < p + page_entries; i++)
+            if(fib->tbl24[i])
+            {
+                bytes += 4096;
+                break;
+            }
+    for(int p = 0; p < 2; p++)
+        bytes += (size_t)(fib->pools[p].count - fib->pools[p].free_top)*fib->pools[p].group_size*sizeof(uint32_t);
+    return bytes;
+}
+
+void destroy_fib6(FIB6 *fib)
+{
+    for(int e = 0; e < fib->rules->entry_used; e++)
+        free(fib->rules->entries[e].satellite);
+    free_ht(fib->rules);
+    for(int p = 0; p < 2; p++)
+    {
+        free(fib->pools[p].free_groups);
+        free(fib->pools[p].entries);
+    }
+    free(fib->tbl24);
+    free(fib);
+}
+#endif /* fib6_h */
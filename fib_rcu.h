@@ -0,0 +1,228 @@
+/* IPv4 FORWARDING TABLE WITH LOCK-FREE READERS: DOUBLE-BUFFERED DIR-24-8, RCU-STYLE PUBLISH */
+
+#ifndef fib_rcu_h
+#define fib_rcu_h
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "wrappers.h"
+#include "fib.h"
+
+/*
+ data-plane threads look up while the control plane changes routes. readers never lock and
+ never write shared data besides their own slot: every batch sees ONE complete table, either
+ all of the updates of a publish or none of them.
+
+ two full FIB copies: readers use active, the writer edits the other (the shadow).
+   fib_rcu_insert/delete: applied to the shadow at once and logged.
+   fib_rcu_publish: active = shadow, then a grace period, then the log is replayed on the old
+   copy, which is the new shadow. several updates can share one publish.
+ grace period (quiescent-state based): a reader stores the publish version it started under
+ in its slot before loading active and clears it when the batch is done. after switching
+ active, the writer waits until no slot holds an older version: nobody is left on the old copy.
+
+ the cost is memory (two tables) and applying each update twice, both on the control plane.
+ */
+#define FIB_RCU_MAX_READERS 64
+#define FIB_RCU_OFFLINE 0 //reader slot value between batches
+
+typedef struct fib_rcu_reader
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong version;//version seen at read_begin, OFFLINE between batches
+}FIB_RCU_READER;
+
+typedef struct fib_update
+{
+    uint32_t prefix;
+    uint32_t next_hop;
+    uint8_t len;
+    bool remove;
+}FIB_UPDATE;
+
+typedef struct fib_rcu
+{
+    FIB *copies[2];
+    _Atomic(FIB*) active;
+    atomic_ulong version;//publishes so far + 1 (0 is OFFLINE)
+    FIB_RCU_READER readers[FIB_RCU_MAX_READERS];
+    atomic_int reader_count;
+    pthread_mutex_t writer;//control-plane threads take turns; readers never touch it
+    FIB_UPDATE *log;//applied to the shadow, not yet to the active copy
+    int log_count, log_cap;
+}FIB_RCU;
+
+FIB_RCU *create_fib_rcu(uint32_t tbl8_groups);
+int fib_rcu_register_reader(FIB_RCU *fr);
+FIB *fib_rcu_read_begin(FIB_RCU *fr, int reader);
+void fib_rcu_read_end(FIB_RCU *fr, int reader);
+void fib_rcu_lookup_bulk(FIB_RCU *fr, int reader, const uint32_t *addrs, uint32_t *next_hops, int n);
+bool fib_rcu_insert(FIB_RCU *fr, uint32_t prefix, uint8_t len, uint32_t next_hop);
+bool fib_rcu_delete(FIB_RCU *fr, uint32_t prefix, uint8_t len);
+void fib_rcu_publish(FIB_RCU *fr);
+int fib_rcu_load(FIB_RCU *fr, char *file);
+void destroy_fib_rcu(FIB_RCU *fr);
+FIB *_fib_rcu_shadow(FIB_RCU *fr);
+void _fib_rcu_log(FIB_RCU *fr, uint32_t prefix, uint8_t len, uint32_t next_hop, bool remove);
+void _fib_rcu_synchronize(FIB_RCU *fr);
+FIB *_fib_rcu_switch(FIB_RCU *fr);
+
+FIB_RCU *create_fib_rcu(uint32_t tbl8_groups)
+{
+    FIB_RCU *fr = (FIB_RCU*)Malloc_aligned(CACHE_LINE_SIZE, sizeof(FIB_RCU));
+
+    fr->copies[0] = create_fib(tbl8_groups);
+    fr->copies[1] = create_fib(tbl8_groups);
+    atomic_init(&fr->active, fr->copies[0]);
+    atomic_init(&fr->version, 1);
+    for(int i = 0; i < FIB_RCU_MAX_READERS; i++)
+        atomic_init(&fr->readers[i].version, FIB_RCU_OFFLINE);
+    atomic_init(&fr->reader_count, 0);
+    pthread_mutex_init(&fr->writer, NULL);
+    fr->log_cap = 64;
+    fr->log = (FIB_UPDATE*)Malloc(fr->log_cap*sizeof(FIB_UPDATE));
+    fr->log_count = 0;
+    return fr;
+}
+
+//one slot per data-plane thread, -1 when all are taken
+int fib_rcu_register_reader(FIB_RCU *fr)
+{
+    int reader = atomic_fetch_add(&fr->reader_count, 1);
+
+    if(reader >= FIB_RCU_MAX_READERS)
+    {
+        atomic_fetch_sub(&fr->reader_count, 1);
+        INDEX_ERROR;
+        return -1;
+    }
+    return reader;
+}
+
+/*
+ the slot store and the load of active are both seq_cst, as are the writer's switch and its
+ scan of the slots: either the writer sees this reader's version, or the reader sees the new
+ active. the table returned stays intact until the matching fib_rcu_read_end().
+ */
+FIB *fib_rcu_read_begin(FIB_RCU *fr, int reader)
+{
+    atomic_store(&fr->readers[reader].version, atomic_load(&fr->version));
+    return atomic_load(&fr->active);
+}
+
+void fib_rcu_read_end(FIB_RCU *fr, int reader)
+{
+    atomic_store_explicit(&fr->readers[reader].version, FIB_RCU_OFFLINE, memory_order_release);
+}
+
+//one batch, one snapshot
+void fib_rcu_lookup_bulk(FIB_RCU *fr, int reader, const uint32_t *addrs, uint32_t *next_hops, int n)
+{
+    fib_lookup_bulk(fib_rcu_read_begin(fr, reader), addrs, next_hops, n);
+    fib_rcu_read_end(fr, reader);
+}
+
+FIB *_fib_rcu_shadow(FIB_RCU *fr)
+{
+    return atomic_load(&fr->active) == fr->copies[0] ? fr->copies[1] : fr->copies[0];
+}
+
+void _fib_rcu_log(FIB_RCU *fr, uint32_t prefix, uint8_t len, uint32_t next_hop, bool remove)
+{
+    if(fr->log_count == fr->log_cap)
+    {
+        fr->log_cap *= 2;
+        fr->log = (FIB_UPDATE*)Realloc(fr->log, fr->log_cap*sizeof(FIB_UPDATE));
+    }
+    fr->log[fr->log_count].prefix = prefix;
+    fr->log[fr->log_count].len = len;
+    fr->log[fr->log_count].next_hop = next_hop;
+    fr->log[fr->log_count].remove = remove;
+    fr->log_count++;
+}
+
+//invisible to readers until fib_rcu_publish()
+bool fib_rcu_insert(FIB_RCU *fr, uint32_t prefix, uint8_t len, uint32_t next_hop)
+{
+    bool success;
+
+    pthread_mutex_lock(&fr->writer);
+    if((success = fib_insert(_fib_rcu_shadow(fr), prefix, len, next_hop)))
+        _fib_rcu_log(fr, prefix, len, next_hop, false);
+    pthread_mutex_unlock(&fr->writer);
+    return success;
+}
+
+bool fib_rcu_delete(FIB_RCU *fr, uint32_t prefix, uint8_t len)
+{
+    bool success;
+
+    pthread_mutex_lock(&fr->writer);
+    if((success = fib_delete(_fib_rcu_shadow(fr), prefix, len)))
+        _fib_rcu_log(fr, prefix, len, 0, true);
+    pthread_mutex_unlock(&fr->writer);
+    return success;
+}
+
+//waits until every reader that could hold the previous active copy has finished its batch
+void _fib_rcu_synchronize(FIB_RCU *fr)
+{
+    unsigned long v = atomic_fetch_add(&fr->version, 1) + 1, seen;
+    int readers = atomic_load(&fr->reader_count);
+
+    for(int i = 0; i < readers && i < FIB_RCU_MAX_READERS; i++)
+        while((seen = atomic_load(&fr->readers[i].version)) != FIB_RCU_OFFLINE && seen < v)
+            sched_yield();//a batch is short: let the reader finish it
+}
+
+void fib_rcu_publish(FIB_RCU *fr)
+{
+    pthread_mutex_lock(&fr->writer);
+    if(fr->log_count > 0)
+        _fib_rcu_switch(fr);
+    pthread_mutex_unlock(&fr->writer);
+}
+
+//writer lock held: active = shadow, grace period, then the old copy replays the log. returns the old copy
+FIB *_fib_rcu_switch(FIB_RCU *fr)
+{
+    FIB *old;
+
+    old = atomic_load(&fr->active);
+    atomic_store(&fr->active, _fib_rcu_shadow(fr));
+    _fib_rcu_synchronize(fr);
+    //nobody reads old any more: bring it level, it is the next shadow
+    for(int i = 0; i < fr->log_count; i++)
+    {
+        if(fr->log[i].remove)
+            fib_delete(old, fr->log[i].prefix, fr->log[i].len);
+        else
+            fib_insert(old, fr->log[i].prefix, fr->log[i].len, fr->log[i].next_hop);
+    }
+    fr->log_count = 0;
+    return old;
+}
+
+//route file (fib_load() format) loaded like a publish: into the shadow, which is then made
+//active, then into the old copy once no reader is left on it. visible on return, together
+//with any updates not published yet; safe while readers look up.
+int fib_rcu_load(FIB_RCU *fr, char *file)
+{
+    int installed;
+
+    pthread_mutex_lock(&fr->writer);
+    installed = fib_load(_fib_rcu_shadow(fr), file);
+    fib_load(_fib_rcu_switch(fr), file);
+    pthread_mutex_unlock(&fr->writer);
+    return installed;
+}
+
+//readers must be gone
+void destroy_fib_rcu(FIB_RCU *fr)
+{
+    destroy_fib(fr->copies[0]);
+    destroy_fib(fr->copies[1]);
+    pthread_mutex_destroy(&fr->writer);
+    free(fr->log);
+    free(fr);
+}
+#endif /* fib_rcu_h */
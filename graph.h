@@ -7,6 +7,10 @@ and is widely used in networking. Former has its use cases.*/
 #include "queue.h"
 #include "stack.h"
 #include "heap.h"
+#include "dary_heap.h"
+#include "pairing_heap.h"
+#include "radix_heap.h"
+#include "bloom_filter.h"
 
 /***************************************************************/
 typedef enum {MATRIX=1,ADJACENCY_LIST=2} GRAPH_IMPLEMENTATION_TYPE;
@@ -68,6 +72,7 @@ typedef struct vertex
     int d;
     struct vertex *pi;
     int kids;
+    struct pairing_node *handle;//DIJKSTRA with decrease-key: its node while queued
 }VERTEX;
 
 typedef struct
@@ -87,11 +92,21 @@ typedef struct
     int **matrix;
     int size;
     /*********************************/
+    //optional: vertices inserted so far, hashed with filter_hash (equal under compare => equal hash)
+    BLOOM_FILTER *filter;
+    uint64_t (*filter_hash)(void *data);
     WEIGHTED w;
     GRAPH_TYPE d;
     GRAPH_IMPLEMENTATION_TYPE i_type;
 }GRAPH;
 
+//lazy DIJKSTRA: a queued copy of the distance, not the vertex, is what the array heap orders
+typedef struct dijkstra_entry
+{
+    int d;
+    VERTEX *v;
+}DIJKSTRA_ENTRY;
+
 GRAPH *create_graph(GRAPH_IMPLEMENTATION_TYPE i_type,
                     GRAPH_TYPE g_type,
                     WEIGHTED w_type, int size,
@@ -109,6 +124,7 @@ void depth_first_graph_traversal(GRAPH *g);
 void breadth_first_graph_traversal(GRAPH *g);
 void delete_graph(GRAPH *g);
 bool add_to_arc_edge_set(GRAPH *g);
+void graph_attach_filter(GRAPH *g, BLOOM_FILTER *bf, uint64_t (*hash)(void *data));
 
 //MATRIX API
 bool insert_g_matrix(GRAPH *g, void *data_in);
@@ -169,6 +185,8 @@ GRAPH *create_graph(GRAPH_IMPLEMENTATION_TYPE i_type, GRAPH_TYPE g_type, WEIGHTE
     }
     g->compare = compare;
     g->process = process;
+    g->filter = NULL;
+    g->filter_hash = NULL;
     g->w = w_type;
     g->d = g_type;
     g->i_type = i_type;
@@ -183,6 +201,8 @@ bool insert_to_graph(GRAPH *g, void *data_in)
         success = insert_g_matrix(g, data_in);
     else
         success = insert_g_list(g, data_in);
+    if(success && g->filter)
+        bloom_add(g->filter, g->filter_hash(data_in));
     return success;
 }
 
@@ -199,6 +219,8 @@ int delete_from_graph(GRAPH *g, void *data_out)
 bool search_graph(GRAPH *g, void *data_out)
 {
   bool found = false;
+  if(g->filter && !bloom_may_contain(g->filter, g->filter_hash(data_out)))
+    return false;
   if(g->i_type == MATRIX)
     found = search_g_matrix(g, data_out);
   else
@@ -211,6 +233,8 @@ void* retrieve_graph(GRAPH *g, void *data_out)
 {
   void *data = NULL;
   
+  if(g->filter && !bloom_may_contain(g->filter, g->filter_hash(data_out)))
+    return NULL;
   if(g->i_type == MATRIX)
     data = retrieve_g_matrix(g, data_out);
   else
@@ -291,6 +315,9 @@ void breadth_first_graph_traversal(GRAPH *g)
 
 void delete_graph(GRAPH *g)
 {
+    if(g->filter)
+        destroy_bloom_filter(g->filter);
+    g->filter = NULL;
     if(g->i_type == MATRIX)
         delete_matrix_graph(g);
     else
@@ -302,6 +329,15 @@ void delete_graph(GRAPH *g)
     }
 }
 
+//same contract as ht_attach_filter(): the graph owns bf, which must hold every vertex already in g.
+void graph_attach_filter(GRAPH *g, BLOOM_FILTER *bf, uint64_t (*hash)(void *data))
+{
+    if(g->filter && g->filter != bf)
+        destroy_bloom_filter(g->filter);
+    g->filter = bf;
+    g->filter_hash = hash;
+}
+
 /************** MATRIX API ******************/
 bool insert_g_matrix(GRAPH *g, void *data_in)
 {
@@ -747,9 +783,9 @@ bool search_g_list(GRAPH *g, void *target)
         loc = loc->next;
     }
     if(!loc || (g->compare(target, loc->data) != 0))
-        return true;
-    else
         return false;
+    else
+        return true;
 }
 
 void *retrieve_g_list(GRAPH *g, void *target)
@@ -1542,6 +1578,142 @@ int mst_compare2(void *a, void *b)
         return 0;
 }
 
+int dijkstra_entry_compare(void *a, void *b)
+{
+    int a1 = ((DIJKSTRA_ENTRY*)a)->d, b1 = ((DIJKSTRA_ENTRY*)b)->d;
+    
+    return a1 < b1 ? -1 : a1 > b1;
+}
+
+/*
+ DIJKSTRA on a d-ary heap without decrease-key: every improvement queues a new entry (at most one
+ per arc) and stale entries, whose vertex is already final, are skipped when they come out.
+ O((V+E)log(E)), no printing: distances in v->d, predecessors in v->pi.
+ */
+void dijkstra_dary(GRAPH *g, int d)
+{
+    DARY_HEAP *Q;
+    DIJKSTRA_ENTRY *entries, *e;
+    VERTEX *u;
+    ARC *a;
+    int arcs = 0, used = 0;
+    
+    for(u = g->source; u; u = u->next)
+    {
+        u->d = INT_MAX;
+        u->pi = NULL;
+        u->in_msp = 0;
+        for(a = u->adj_list; a; a = a->next)
+            arcs++;
+    }
+    if(!g->source)
+        return;
+    entries = (DIJKSTRA_ENTRY*)Malloc(((size_t)arcs + 1)*sizeof(DIJKSTRA_ENTRY));
+    Q = create_dary_heap(d, g->count, dijkstra_entry_compare);
+    g->source->d = 0;
+    entries[used].d = 0;
+    entries[used].v = g->source;
+    dary_heap_insert(Q, &entries[used++]);
+    while((e = (DIJKSTRA_ENTRY*)dary_heap_get_min(Q)))
+    {
+        u = e->v;
+        if(u->in_msp)
+            continue;//stale
+        u->in_msp = 1;
+        for(a = u->adj_list; a; a = a->next)
+        {
+            if(!a->dest->in_msp && a->dest->d > u->d + a->weight)
+            {
+                a->dest->d = u->d + a->weight;
+                a->dest->pi = u;
+                entries[used].d = a->dest->d;
+                entries[used].v = a->dest;
+                dary_heap_insert(Q, &entries[used++]);
+            }
+        }
+    }
+    destroy_dary_heap(Q);
+    free(entries);
+}
+
+//DIJKSTRA on a pairing heap: one node per vertex, relaxations are decrease-keys
+void dijkstra_pairing(GRAPH *g)
+{
+    PAIRING_HEAP *Q;
+    VERTEX *u;
+    ARC *a;
+    
+    for(u = g->source; u; u = u->next)
+    {
+        u->d = INT_MAX;
+        u->pi = NULL;
+        u->in_msp = 0;
+        u->handle = NULL;
+    }
+    if(!g->source)
+        return;
+    Q = create_pairing_heap(mst_compare2, NULL);
+    g->source->d = 0;
+    g->source->handle = pairing_heap_insert(Q, g->source);
+    while((u = (VERTEX*)pairing_heap_get_min(Q)))
+    {
+        u->in_msp = 1;
+        u->handle = NULL;
+        for(a = u->adj_list; a; a = a->next)
+        {
+            if(!a->dest->in_msp && a->dest->d > u->d + a->weight)
+            {
+                a->dest->d = u->d + a->weight;
+                a->dest->pi = u;
+                if(a->dest->handle)
+                    pairing_heap_decrease_key(Q, a->dest->handle);
+                else
+                    a->dest->handle = pairing_heap_insert(Q, a->dest);
+            }
+        }
+    }
+    destroy_pairing_heap(Q);
+}
+
+//DIJKSTRA on a radix heap: extracted distances never decrease, weights must be non-negative
+void dijkstra_radix(GRAPH *g)
+{
+    RADIX_HEAP *Q;
+    VERTEX *u;
+    ARC *a;
+    uint32_t d;
+    void *data;
+    
+    for(u = g->source; u; u = u->next)
+    {
+        u->d = INT_MAX;
+        u->pi = NULL;
+        u->in_msp = 0;
+    }
+    if(!g->source)
+        return;
+    Q = create_radix_heap();
+    g->source->d = 0;
+    radix_heap_insert(Q, 0, g->source);
+    while(radix_heap_get_min(Q, &d, &data))
+    {
+        u = (VERTEX*)data;
+        if(u->in_msp)
+            continue;//stale: queued again with a shorter distance
+        u->in_msp = 1;
+        for(a = u->adj_list; a; a = a->next)
+        {
+            if(!a->dest->in_msp && a->dest->d > u->d + a->weight)
+            {
+                a->dest->d = u->d + a->weight;
+                a->dest->pi = u;
+                radix_heap_insert(Q, (uint32_t)a->dest->d, a->dest);
+            }
+        }
+    }
+    destroy_radix_heap(Q);
+}
+
 void dijkstra(GRAPH *g)
 {
     HEAP_ADT* Q;
@@ -5,10 +5,12 @@
 
 #ifndef hash_tables_h
 #define hash_tables_h
+#include "wrappers.h"
+#include "bloom_filter.h"
 
 typedef enum {DIRECT_ADDRESSING=1,OPEN_ADDRESSING=2,LINEAR_PROBING,QUADRATIC_PROBING,DOUBLE_HASHING} PROBING_TYPE;
 typedef enum {DIRECT=1,DIVISION,MULTIPLICATION,UNIVERSAL} HASHING_FUNCTION_TYPE; //direct = key == idx, no hashing, several other methods
-typedef enum {NONE=1,ARRAY=2,BUCKET=3,CHAINING=4} COLLISION_RESULTION;
+typedef enum {NONE=1,ARRAY=2,BUCKET=3,CHAINING=4,KEYED=5} COLLISION_RESULTION;
 
 typedef struct chain_node
 {
@@ -16,23 +18,128 @@ typedef struct chain_node
     struct chain_node *next;
 }CHAIN_NODE;
 
+#define CHAIN_BLOCK_NODES 256
 
+//overflow nodes are carved out of blocks owned by the table, never malloc'd one by one
+typedef struct chain_block
+{
+    struct chain_block *next;
+    CHAIN_NODE nodes[CHAIN_BLOCK_NODES];
+}CHAIN_BLOCK;
+
+typedef struct chain_arena
+{
+    CHAIN_BLOCK *blocks;//newest block first
+    CHAIN_NODE *free_list;//nodes released by deletes
+    int used;//nodes handed out from the newest block
+    int block_count;
+}CHAIN_ARENA;
+
+//one slot of the chained table: primary entry stored inline, overflow chain from the arena
 typedef struct chain
 {
-    CHAIN_NODE *primary_area;
+    void *primary_area;
     CHAIN_NODE *overflow_area;
-    int (*compare)(void *arg1, void *arg2);
-    int (*compare_keys)(void *arg1, int data_key);
     int count;
     
 }CHAIN;
 
+#define BUCKET_SLOTS 4 //slots per bucket so that one bucket == one cache line
+
+/*
+ ONE BUCKET == ONE CACHE LINE (64 bytes):
+ occupied bitmap: bit i set when slot i holds an entry.
+ tags: high byte of the hash per slot, compared before the key to reject quickly.
+ overflow: index (not pointer) of the next bucket in the slab's overflow area, -1 if none.
+ */
+typedef struct ht_bucket
+{
+    uint8_t occupied;
+    uint8_t tags[BUCKET_SLOTS];
+    int     overflow;
+    int     keys[BUCKET_SLOTS];
+    void    *satellite[BUCKET_SLOTS];
+}HT_BUCKET;
+
+/*
+ GENERIC KEYS (KEYED mode): the table gets the key out of the satellite itself, so keys can be
+ 64-bit integers, strings, byte ranges or composite structs instead of a caller-derived int.
+ get_key: the key of a satellite (a pointer into it, or to something it owns).
+ hash: 64 bits, computed ONCE per operation and cached in the entry; a lookup compares cached
+ hashes first and calls equal() only when they match, growth rehashes from the cache alone.
+ */
+typedef struct ht_key_ops
+{
+    const void *(*get_key)(void *data);
+    uint64_t (*hash)(const void *key);
+    bool (*equal)(const void *key1, const void *key2);
+}HT_KEY_OPS;
+
+typedef struct ht_entry
+{
+    void *satellite;
+    uint64_t hash;
+    int next;//next entry of the chain, -1 if none. also links free entries
+}HT_ENTRY;
+
+#define KEYED_MAX_LOAD 1 //entries per chain head before the heads double
+
+/*
+ TABLE HEALTH. two kinds of numbers:
+ - structural (ht_get_report): slots, entries, load factor, chain-length histogram. computed on
+   demand by walking the table, always available.
+ - counters (HT_STATS): probes per insert and per lookup as histograms, hit count, overflow
+   events, overflow-area growth. compiled in only with -DHT_STATS, the default hot path does
+   nothing extra. a probe is one slot (ARRAY/NONE), one bucket (BUCKET) or one entry compared
+   (CHAINING). BUCKET/CHAINING never rehash: resize_count counts doublings of the overflow slab.
+ -DHT_TRACE brings back the per-operation printouts ("inserted at ...").
+ */
+#define HT_HIST 16 //histogram bins 0..14, bin 15 is "15 or more"
+
+typedef struct ht_stats
+{
+    uint64_t inserts;
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t insert_probes[HT_HIST];
+    uint64_t lookup_probes[HT_HIST];
+    uint64_t overflow_events;//BUCKET: new overflow bucket linked, CHAINING: entry went to the overflow chain
+    int resize_count;
+    int cur_probes;//probes of the operation in progress
+}HT_COUNTERS;
+
+typedef struct ht_report
+{
+    int slots;
+    long entries;
+    double load_factor;//entries per slot (per bucket slot for BUCKET)
+    long chain_length[HT_HIST];//slots by entries (CHAINING) or buckets (BUCKET) chained off them
+    int max_chain;
+    bool counters_enabled;
+    HT_COUNTERS counters;
+}HT_REPORT;
+
 typedef struct hash_table
 {
     void **ary;
-    void ***bht;
+    HT_BUCKET *bht;//ONE SLAB: [0, size) primary area, [size, size + overflow_cap) overflow area
     int  size;
     int  bucket_size;
+    int  overflow_cap;
+    int  overflow_used;
+    int  overflow_free;//head of list of released overflow buckets, -1 if none
+    CHAIN *chains;//CHAINING: contiguous array of slots
+    CHAIN_ARENA arena;
+    BLOOM_FILTER *filter;//optional, keys inserted so far: definite misses never reach the table
+    HT_COUNTERS stats;//updated only with -DHT_STATS
+    const HT_KEY_OPS *key_ops;//KEYED: heads[hash & (size-1)] -> entries[] chained by index
+    int *heads;
+    HT_ENTRY *entries;
+    int entry_cap;
+    int entry_used;
+    int entry_free;
+    int count;
+    int (*compare)(void *arg1, void *arg2);
     void (*process)(void *arg1, void *arg2);
     COLLISION_RESULTION c_type;
     int (*hash_function)(int m, int k, int i);
@@ -49,7 +156,13 @@ bool insert_ht(HASH_TABLE *ht, void *data_in, int idx);
 bool search_ht(HASH_TABLE *ht, void *target, int key);
 bool delete_ht(HASH_TABLE *ht, void *target, int key);
 void *retrieve_ht(HASH_TABLE *ht, void *target, int key);
+void retrieve_ht_batch(HASH_TABLE *ht, void *targets[], int keys[], int n, void *out[]);
 bool free_ht(HASH_TABLE *ht);
+void ht_attach_filter(HASH_TABLE *ht, BLOOM_FILTER *bf);
+void ht_get_report(HASH_TABLE *ht, HT_REPORT *r);
+void ht_stats_json(HASH_TABLE *ht, FILE *fp);
+void ht_reset_stats(HASH_TABLE *ht);
+void _ht_stat_record(HT_COUNTERS *s, bool insert, bool hit);
 //DIRECT API
 bool direct_addressing(HASH_TABLE *ht, void *data_in, int idx);
 bool direct_search(HASH_TABLE *ht, int idx);
@@ -67,23 +180,45 @@ bool array_ht_search(HASH_TABLE *ht, int key);//SEARCH == RETRIEVE hopefully O(1
 void *array_ht_retrieve(HASH_TABLE *ht, int key);//target = NULL for non-chain
 //BUCKET
 void create_table_with_buckets(HASH_TABLE *ht);
+uint32_t bucket_hash(int key);
+int _bucket_new_overflow(HASH_TABLE *ht);
 bool bucket_ht_insert(HASH_TABLE *ht, void *data_in, int key);
 bool bucket_ht_search(HASH_TABLE *ht, void *data_in, int key);
 bool bucket_ht_delete(HASH_TABLE *ht, int key);
 void *bucket_ht_retrieve(HASH_TABLE *ht, int key);
+void *_bucket_ht_retrieve_hashed(HASH_TABLE *ht, int key, uint32_t h);
 bool free_ht_buckets(HASH_TABLE *ht);
 //CHAIN
 void create_chained_table(HASH_TABLE *ht, int (*compare)(void *arg1, void *arg2));
-CHAIN* create_chain(int (*compare)(void *arg1, void *arg2));
+CHAIN_NODE *chain_arena_alloc(CHAIN_ARENA *arena);
+void chain_arena_release(CHAIN_ARENA *arena, CHAIN_NODE *node);
+size_t chain_ht_memory(HASH_TABLE *ht);
 bool chain_ht_insert(HASH_TABLE *ht, void *data_in, int key);
 bool chain_ht_delete(HASH_TABLE *ht, void *target, int key);
 bool chain_ht_search(HASH_TABLE *ht, void *target, int key);
 void *chain_ht_retrieve(HASH_TABLE *ht, void *target, int key);
 bool free_ht_chains(HASH_TABLE *ht);
-void add_to_chain(CHAIN *list, CHAIN_NODE *pre, void *data_in);
-bool delete_chain(CHAIN *list, CHAIN_NODE *pre, CHAIN_NODE *cur);
-bool search_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target);
-void *retrieve_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target);
+//KEYED
+HASH_TABLE *create_keyed_hash_table(int m, const HT_KEY_OPS *key_ops, void (*process)(void *arg1, void *arg2));
+bool keyed_ht_insert(HASH_TABLE *ht, void *data_in);
+bool keyed_ht_search(HASH_TABLE *ht, const void *key);
+void *keyed_ht_retrieve(HASH_TABLE *ht, const void *key);
+void *_keyed_ht_retrieve_hashed(HASH_TABLE *ht, const void *key, uint64_t h);
+bool keyed_ht_delete(HASH_TABLE *ht, const void *key);
+bool free_ht_keyed(HASH_TABLE *ht);
+int _keyed_find(HASH_TABLE *ht, const void *key, uint64_t h, int **link);
+void _keyed_grow(HASH_TABLE *ht);
+uint64_t ht_hash_u64(uint64_t x);
+uint64_t ht_hash_bytes(const void *data, size_t len, uint64_t seed);
+uint64_t ht_hash_combine(uint64_t h, uint64_t v);
+uint64_t ht_u64_hash(const void *key);
+bool ht_u64_equal(const void *key1, const void *key2);
+uint64_t ht_str_hash(const void *key);
+bool ht_str_equal(const void *key1, const void *key2);
+void add_to_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE *pre, void *data_in);
+bool delete_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE *pre, CHAIN_NODE *cur);
+bool search_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target);
+void *retrieve_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target);
 
 #define MACHINE_WORD_SIZE 8
 #define HASHING_METHODS 2
@@ -91,6 +226,30 @@ void *retrieve_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *targ
 #define C2 9
 #define HASH_TABLE_FULL printf("ERROR: HASH TABLE IS FULL!!\n");
 #define BUCKET_FULL printf("ERROR: BUCKET IS FULL!!\n");
+#define HT_BATCH 32 //keys whose memory accesses are overlapped by retrieve_ht_batch
+#define HT_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+
+#ifdef HT_STATS
+#define HT_STAT_BEGIN(ht) ((ht)->stats.cur_probes = 0)
+#define HT_STAT_PROBE(ht) ((ht)->stats.cur_probes++)
+#define HT_STAT_OVERFLOW(ht) ((ht)->stats.overflow_events++)
+#define HT_STAT_RESIZE(ht) ((ht)->stats.resize_count++)
+#define HT_STAT_INSERT(ht, ok) _ht_stat_record(&(ht)->stats, true, (ok))
+#define HT_STAT_LOOKUP(ht, hit) _ht_stat_record(&(ht)->stats, false, (hit))
+#else
+#define HT_STAT_BEGIN(ht) ((void)0)
+#define HT_STAT_PROBE(ht) ((void)0)
+#define HT_STAT_OVERFLOW(ht) ((void)0)
+#define HT_STAT_RESIZE(ht) ((void)0)
+#define HT_STAT_INSERT(ht, ok) ((void)0)
+#define HT_STAT_LOOKUP(ht, hit) ((void)0)
+#endif
+
+#ifdef HT_TRACE
+#define HT_LOG(...) printf(__VA_ARGS__)
+#else
+#define HT_LOG(...) ((void)0)
+#endif
 
 HASH_TABLE* create_hash_table(int m,
                               int bucket_size,
@@ -106,7 +265,16 @@ HASH_TABLE* create_hash_table(int m,
     ht->size = m;
     ht->process = process;
     ht->c_type = c_type;
-    ht->ary = (void**)calloc(m, sizeof(void*));
+    ht->ary = NULL;
+    ht->bht = NULL;
+    ht->chains = NULL;
+    ht->filter = NULL;
+    ht->key_ops = NULL;
+    ht->heads = NULL;
+    ht->entries = NULL;
+    memset(&ht->stats, 0, sizeof(HT_COUNTERS));
+    if(c_type == NONE || c_type == ARRAY)//BUCKET and CHAINING own their storage
+        ht->ary = (void**)calloc(m, sizeof(void*));
 
     if(c_type == NONE)//DIRECT 1:1
     {
@@ -127,52 +295,87 @@ HASH_TABLE* create_hash_table(int m,
         ht->bucket_size = bucket_size;
         create_table_with_buckets(ht);
     }
-    else//COLLISION RESOLVED WITH CHAINING
+    else if(c_type == CHAINING)//COLLISION RESOLVED WITH CHAINING
     {
         create_chained_table(ht, compare);
     }
+    //KEYED: storage is set up by create_keyed_hash_table()
     return ht;
 }
 
-CHAIN* create_chain(int (*compare)(void *arg1, void *arg2))
+//Just draw it out and then implementation is very easy.
+void create_chained_table(HASH_TABLE *ht, int (*compare)(void *arg1, void *arg2))
 {
-    CHAIN *list  = (CHAIN*)malloc(sizeof(CHAIN));
-    list->overflow_area = NULL;
-    list->primary_area = NULL;
-    list->count = 0;
-    list->compare = compare;
-    
-    return list;
+    //ARRAY OF SLOTS: primary entry inline, overflow chain (linked list of application data) from the arena.
+    //calloc leaves every slot empty, no per-slot allocation.
+    ht->chains = (CHAIN*)Calloc(ht->size, sizeof(CHAIN));
+    ht->compare = compare;
+    ht->arena.blocks = NULL;
+    ht->arena.free_list = NULL;
+    ht->arena.used = CHAIN_BLOCK_NODES;//forces a block on first use
+    ht->arena.block_count = 0;
 }
 
-//Just draw it out and then implementation is very easy.
-void create_chained_table(HASH_TABLE *ht, int (*compare)(void *arg1, void *arg2))
+/* O(1): reuse a released node, else bump-allocate from the newest block */
+CHAIN_NODE *chain_arena_alloc(CHAIN_ARENA *arena)
 {
-    //ARRAY OF POINTERS TO VOID: TO A LINKED LIST OF APPLICATION DATA.
+    CHAIN_NODE *node;
+    CHAIN_BLOCK *block;
     
-    for(int i = 0; i < ht->size; i++)
+    if(arena->free_list)
     {
-        //each entry in the hash_table will have a pointer to void that
-        //points to a linked list (chain)
-        ht->ary[i] = create_chain(compare);
+        node = arena->free_list;
+        arena->free_list = node->next;
+        return node;
     }
-    
+    if(arena->used == CHAIN_BLOCK_NODES)
+    {
+        block = (CHAIN_BLOCK*)Malloc(sizeof(CHAIN_BLOCK));
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->used = 0;
+        arena->block_count++;
+    }
+    node = &arena->blocks->nodes[arena->used];
+    arena->used++;
+    return node;
+}
+
+void chain_arena_release(CHAIN_ARENA *arena, CHAIN_NODE *node)
+{
+    node->next = arena->free_list;
+    arena->free_list = node;
+}
+
+//bytes held by a chained table: header, slot array and arena blocks.
+size_t chain_ht_memory(HASH_TABLE *ht)
+{
+    return sizeof(HASH_TABLE) + ht->size*sizeof(CHAIN) + ht->arena.block_count*sizeof(CHAIN_BLOCK);
 }
 
+//one aligned allocation for all buckets; a full bucket links into the overflow area by index.
 void create_table_with_buckets(HASH_TABLE *ht)
 {
-    ht->bht = (void***)calloc(ht->size, sizeof(void**));
+    int total;
     
-    for(int i = 0; i < ht->size; i++)
-    {
-        ht->bht[i] = (void**)calloc(ht->bucket_size, sizeof(void*));
-    }
+    //anything beyond one cache line per bucket is served by the overflow chain
+    if(ht->bucket_size <= 0 || ht->bucket_size > BUCKET_SLOTS)
+        ht->bucket_size = BUCKET_SLOTS;
+    ht->overflow_cap = ht->size/4 + 1;
+    ht->overflow_used = 0;
+    ht->overflow_free = -1;
+    total = ht->size + ht->overflow_cap;
+    ht->bht = (HT_BUCKET*)Malloc_aligned(CACHE_LINE_SIZE, total*sizeof(HT_BUCKET));
+    memset(ht->bht, 0, total*sizeof(HT_BUCKET));
+    for(int i = 0; i < total; i++)
+        ht->bht[i].overflow = -1;
 }
 
 /********************** DIRECT HT APIS *********************/
 //direct addressing
 bool direct_addressing(HASH_TABLE *ht, void *data_in, int idx)
 {
+    HT_STAT_PROBE(ht);
     ht->ary[idx] = data_in;
     
     return true;
@@ -184,6 +387,7 @@ void* direct_retrieve(HASH_TABLE *ht, int idx)
     
     if(ht->rt_hf != NULL)
         idx = ht->rt_hf(idx);
+    HT_STAT_PROBE(ht);
     data_out = ht->ary[idx];
     return data_out;
 
@@ -191,7 +395,7 @@ void* direct_retrieve(HASH_TABLE *ht, int idx)
 
 bool direct_search(HASH_TABLE *ht, int idx)
 {
-    
+    HT_STAT_PROBE(ht);
     if(ht->ary[idx])
         return true;
     else
@@ -245,7 +449,7 @@ int multiplication_method(int m, int key)
 /*######### WITH OPEN ADDRESSING################# */
 int division_method_open_addressing(int m, int k, int i)
 {
-    printf("probe i %d\n", i);
+    HT_LOG("probe i %d\n", i);
     return ((k+i)%m);
 }
 
@@ -361,8 +565,9 @@ void set_hash_function(HASH_TABLE *ht, HASHING_FUNCTION_TYPE h_type, PROBING_TYP
 /********************* ADT APIS ***************************/
 bool insert_ht(HASH_TABLE *ht, void *data_in, int key)
 {
-    bool sucess;
+    bool sucess = false;//a collision type with no case below fails
     
+    HT_STAT_BEGIN(ht);
     switch(ht->c_type)
     {
         case 1://NONE - no collisionS
@@ -377,14 +582,26 @@ bool insert_ht(HASH_TABLE *ht, void *data_in, int key)
         case 4: //CHAIN
             sucess = chain_ht_insert(ht, data_in, key);
             break;
+        case 5: //KEYED: the key comes from data_in, idx is ignored
+            sucess = keyed_ht_insert(ht, data_in);
+            break;
     }
+    if(sucess && ht->filter && ht->c_type != KEYED)//KEYED maintains its own from the cached hash
+        bloom_add(ht->filter, bloom_hash_int(key));
+    HT_STAT_INSERT(ht, sucess);
     return sucess;
 }
 
 bool search_ht(HASH_TABLE *ht, void *data, int key)
 {
-    bool found;
+    bool found = false;
     
+    HT_STAT_BEGIN(ht);
+    if(ht->filter && ht->c_type != KEYED && !bloom_may_contain(ht->filter, bloom_hash_int(key)))
+    {
+        HT_STAT_LOOKUP(ht, false);
+        return false;
+    }
     switch(ht->c_type)
     {
         case 1://NONE - no collisionS
@@ -394,12 +611,16 @@ bool search_ht(HASH_TABLE *ht, void *data, int key)
             found = array_ht_search(ht, key);
              break;
         case 3://BUCKET
-            found = bucket_ht_insert(ht, data, key);
+            found = bucket_ht_search(ht, data, key);
             break;
         case 4: //CHAIN
             found = chain_ht_search(ht, data, key);
             break;
+        case 5: //KEYED
+            found = keyed_ht_search(ht, ht->key_ops->get_key(data));
+            break;
     }
+    HT_STAT_LOOKUP(ht, found);
     return found;
 }
 
@@ -421,6 +642,9 @@ bool delete_ht(HASH_TABLE *ht, void *target, int key)
         case 4: //CHAIN
             removed = chain_ht_delete(ht, target, key);
             break;
+        case 5: //KEYED
+            removed = keyed_ht_delete(ht, ht->key_ops->get_key(target));
+            break;
     }
     return removed;
 
@@ -428,8 +652,14 @@ bool delete_ht(HASH_TABLE *ht, void *target, int key)
 
 void *retrieve_ht(HASH_TABLE *ht, void *target, int key)
 {
-    void *data_out;
+    void *data_out = NULL;
     
+    HT_STAT_BEGIN(ht);
+    if(ht->filter && ht->c_type != KEYED && !bloom_may_contain(ht->filter, bloom_hash_int(key)))
+    {
+        HT_STAT_LOOKUP(ht, false);
+        return NULL;
+    }
     switch(ht->c_type)
     {
         case 1://NONE - no collisionS
@@ -444,16 +674,105 @@ void *retrieve_ht(HASH_TABLE *ht, void *target, int key)
         case 4: //CHAIN
             data_out = chain_ht_retrieve(ht, target, key);
             break;
+        case 5: //KEYED
+            data_out = keyed_ht_retrieve(ht, ht->key_ops->get_key(target));
+            break;
     }
+    HT_STAT_LOOKUP(ht, data_out != NULL);
     return data_out;
     
 }
 
-//typedef enum {NONE=1,ARRAY=2,BUCKET=3,CHAINING=4} COLLISION_RESULTION;
+/*
+ BATCHED LOOKUP: out[i] = retrieve_ht(ht, targets[i], keys[i]) (targets may be NULL except for CHAINING).
+ one lookup at a time stalls on a cache miss before the next one starts. per group of HT_BATCH keys:
+ 1) hash every key and prefetch its slot/bucket, 2) (CHAINING, KEYED) prefetch what the slots point
+ to, 3) resolve; by then most lines are on their way or already in cache.
+ */
+void retrieve_ht_batch(HASH_TABLE *ht, void *targets[], int keys[], int n, void *out[])
+{
+    uint32_t h[HT_BATCH];
+    uint64_t kh[HT_BATCH];
+    const void *k[HT_BATCH];
+    int idx[HT_BATCH];
+    CHAIN *c;
+    CHAIN_NODE *pre, *cur;
+    int len;
+    
+    for(int base = 0; base < n; base += HT_BATCH)
+    {
+        len = (n - base < HT_BATCH) ? n - base : HT_BATCH;
+        switch(ht->c_type)
+        {
+            case 1://NONE
+                for(int i = 0; i < len; i++)
+                    out[base+i] = direct_retrieve(ht, keys[base+i]);
+                break;
+            case 2://ARRAY: the first probe is where the key lands without collisions
+                for(int i = 0; i < len; i++)
+                    HT_PREFETCH(&ht->ary[ht->hash_function(ht->size, keys[base+i], 0)]);
+                for(int i = 0; i < len; i++)
+                    out[base+i] = array_ht_retrieve(ht, keys[base+i]);
+                break;
+            case 3://BUCKET
+                for(int i = 0; i < len; i++)
+                {
+                    h[i] = bucket_hash(keys[base+i]);
+                    HT_PREFETCH(&ht->bht[h[i] % ht->size]);
+                }
+                for(int i = 0; i < len; i++)
+                    out[base+i] = _bucket_ht_retrieve_hashed(ht, keys[base+i], h[i]);
+                break;
+            case 4://CHAIN
+                for(int i = 0; i < len; i++)
+                {
+                    idx[i] = (int)((unsigned)keys[base+i] % ht->size);
+                    HT_PREFETCH(&ht->chains[idx[i]]);
+                }
+                for(int i = 0; i < len; i++)
+                {
+                    c = &ht->chains[idx[i]];
+                    if(c->primary_area)
+                        HT_PREFETCH(c->primary_area);
+                    if(c->overflow_area)
+                        HT_PREFETCH(c->overflow_area);
+                }
+                for(int i = 0; i < len; i++)
+                {
+                    c = &ht->chains[idx[i]];
+                    if(c->primary_area && ht->compare(c->primary_area, targets[base+i]) == 0)
+                        out[base+i] = c->primary_area;
+                    else
+                        out[base+i] = retrieve_chain(ht, c, &pre, &cur, targets[base+i]);
+                }
+                break;
+            case 5://KEYED: keys come from the targets; the hash is computed once, here
+                for(int i = 0; i < len; i++)
+                {
+                    k[i] = ht->key_ops->get_key(targets[base+i]);
+                    kh[i] = ht->key_ops->hash(k[i]);
+                    HT_PREFETCH(&ht->heads[kh[i] & (ht->size - 1)]);
+                }
+                for(int i = 0; i < len; i++)
+                {
+                    idx[i] = ht->heads[kh[i] & (ht->size - 1)];
+                    if(idx[i] != -1)
+                        HT_PREFETCH(&ht->entries[idx[i]]);
+                }
+                for(int i = 0; i < len; i++)
+                    out[base+i] = idx[i] != -1 ? _keyed_ht_retrieve_hashed(ht, k[i], kh[i]) : NULL;
+                break;
+        }
+    }
+}
+
+//typedef enum {NONE=1,ARRAY=2,BUCKET=3,CHAINING=4,KEYED=5} COLLISION_RESULTION;
 bool free_ht(HASH_TABLE *ht)
 {
     bool success = false;
     
+    if(ht->filter)
+        destroy_bloom_filter(ht->filter);
     switch (ht->c_type) {
         case 1:
         case 2:
@@ -467,11 +786,129 @@ bool free_ht(HASH_TABLE *ht)
         case 4:
             success = free_ht_chains(ht);
             break;
+        case 5:
+            success = free_ht_keyed(ht);
+            break;
     }
     
     return success;
 }
 
+/*
+ put a Bloom filter in front of search_ht/retrieve_ht: keys it has never seen are rejected
+ without touching the table. the table owns bf from here on (free_ht destroys it).
+ bf must already hold every key in the table: attach an empty one before the first insert,
+ or build it in bulk from the keys with bloom_add_bulk(). insert_ht keeps it up to date.
+ */
+void ht_attach_filter(HASH_TABLE *ht, BLOOM_FILTER *bf)
+{
+    if(ht->filter && ht->filter != bf)
+        destroy_bloom_filter(ht->filter);
+    ht->filter = bf;
+}
+
+void _ht_stat_record(HT_COUNTERS *s, bool insert, bool hit)
+{
+    int bin = s->cur_probes < HT_HIST - 1 ? s->cur_probes : HT_HIST - 1;
+    
+    if(insert)
+    {
+        s->inserts++;
+        s->insert_probes[bin]++;
+    }
+    else
+    {
+        s->lookups++;
+        s->lookup_probes[bin]++;
+        if(hit)
+            s->hits++;
+    }
+}
+
+void ht_reset_stats(HASH_TABLE *ht)
+{
+    int resize_count = ht->stats.resize_count;//a property of the table, not of the workload
+    
+    memset(&ht->stats, 0, sizeof(HT_COUNTERS));
+    ht->stats.resize_count = resize_count;
+}
+
+//walks the whole table: O(slots + entries), meant for tuning runs, not the hot path.
+void ht_get_report(HASH_TABLE *ht, HT_REPORT *r)
+{
+    int len, capacity;
+    
+    memset(r, 0, sizeof(HT_REPORT));
+    r->slots = ht->size;
+    capacity = ht->size;
+    for(int i = 0; i < ht->size; i++)
+    {
+        switch(ht->c_type)
+        {
+            case 3://BUCKET: length = buckets in the chain, entries = set bits
+                len = 0;
+                for(int idx = i; idx != -1; idx = ht->bht[idx].overflow)
+                {
+                    r->entries += __builtin_popcount(ht->bht[idx].occupied);
+                    len++;
+                }
+                break;
+            case 4://CHAINING
+                len = ht->chains[i].count;
+                r->entries += len;
+                break;
+            case 5://KEYED
+                len = 0;
+                for(int e = ht->heads[i]; e != -1; e = ht->entries[e].next)
+                    len++;
+                r->entries += len;
+                break;
+            default://NONE, ARRAY: a slot holds zero or one entry
+                len = ht->ary[i] != NULL;
+                r->entries += len;
+                break;
+        }
+        r->chain_length[len < HT_HIST - 1 ? len : HT_HIST - 1]++;
+        if(len > r->max_chain)
+            r->max_chain = len;
+    }
+    if(ht->c_type == BUCKET)
+        capacity *= ht->bucket_size;
+    r->load_factor = capacity ? (double)r->entries/capacity : 0;
+#ifdef HT_STATS
+    r->counters_enabled = true;
+#endif
+    r->counters = ht->stats;
+}
+
+void ht_stats_json(HASH_TABLE *ht, FILE *fp)
+{
+    HT_REPORT r;
+    const char *modes[] = {"", "NONE", "ARRAY", "BUCKET", "CHAINING", "KEYED"};
+    
+    ht_get_report(ht, &r);
+    fprintf(fp, "{\"mode\": \"%s\", \"slots\": %d, \"entries\": %ld, \"load_factor\": %.4f, \"max_chain\": %d,\n",
+            modes[ht->c_type], r.slots, r.entries, r.load_factor, r.max_chain);
+    fprintf(fp, " \"chain_length\": [");
+    for(int i = 0; i < HT_HIST; i++)
+        fprintf(fp, "%ld%s", r.chain_length[i], i < HT_HIST - 1 ? ", " : "],\n");
+    fprintf(fp, " \"counters_enabled\": %s", r.counters_enabled ? "true" : "false");
+    if(r.counters_enabled)
+    {
+        fprintf(fp, ",\n \"inserts\": %llu, \"lookups\": %llu, \"hits\": %llu, \"overflow_events\": %llu, \"resize_count\": %d,\n",
+                (unsigned long long)r.counters.inserts, (unsigned long long)r.counters.lookups,
+                (unsigned long long)r.counters.hits, (unsigned long long)r.counters.overflow_events,
+                r.counters.resize_count);
+        fprintf(fp, " \"insert_probes\": [");
+        for(int i = 0; i < HT_HIST; i++)
+            fprintf(fp, "%llu%s", (unsigned long long)r.counters.insert_probes[i], i < HT_HIST - 1 ? ", " : "],\n");
+        fprintf(fp, " \"lookup_probes\": [");
+        for(int i = 0; i < HT_HIST; i++)
+            fprintf(fp, "%llu%s", (unsigned long long)r.counters.lookup_probes[i], i < HT_HIST - 1 ? ", " : "]");
+    }
+    fprintf(fp, "}\n");
+}
+
 
 /********************** ARRAY HT APIS *********************/
 /*
@@ -484,9 +921,10 @@ bool array_ht_insert(HASH_TABLE *ht, void *data_in, int key)
     for(int i = 0; i < ht->size; i++)
     {
         idx = ht->hash_function(ht->size, key, i);
+        HT_STAT_PROBE(ht);
         if(!ht->ary[idx])//found NULL SLOT
         {
-            printf("inserted at %d\n", idx);
+            HT_LOG("inserted at %d\n", idx);
             ht->ary[idx] = data_in;
             i = ht->size;
             found = true;
@@ -509,6 +947,7 @@ bool array_ht_search(HASH_TABLE *ht, int key)
     for(int i = 0; i < ht->size; i++)
     {
         idx = ht->hash_function(ht->size, key, i);
+        HT_STAT_PROBE(ht);
         if(ht->ary[idx])
         {
             i = ht->size;
@@ -527,6 +966,7 @@ bool array_ht_delete(HASH_TABLE *ht, int key)
     for(int i = 0; i < ht->size; i++)
     {
         idx = ht->hash_function(ht->size, key, i);
+        HT_STAT_PROBE(ht);
         if(ht->ary[idx])
         {
             ht->ary[idx] = NULL;
@@ -546,6 +986,7 @@ void *array_ht_retrieve(HASH_TABLE *ht, int key)
     for(int i = 0; i < ht->size; i++)
     {
         idx = ht->hash_function(ht->size, key, i);
+        HT_STAT_PROBE(ht);
         if(ht->ary[idx])
         {
             data_out = ht->ary[idx];
@@ -556,117 +997,180 @@ void *array_ht_retrieve(HASH_TABLE *ht, int key)
 }
 
 /********************** BUCKET HT APIS *********************/
+/*
+ BUCKETED HASHING (like disk buckets): h(key) picks a primary bucket, a full bucket
+ links to a bucket in the overflow area. several entries may share a key, retrieve
+ and delete act on the first one found along the chain.
+ */
+//murmur3 finalizer: every bit of the key affects the index and the tag.
+uint32_t bucket_hash(int key)
+{
+    uint32_t h = (uint32_t)key;
+    
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+//pop a released overflow bucket or take the next unused one, doubling the area when exhausted.
+//the slab may move, so callers must re-derive bucket pointers afterwards.
+int _bucket_new_overflow(HASH_TABLE *ht)
+{
+    HT_BUCKET *slab;
+    int idx, old_total, new_total;
+    
+    if(ht->overflow_free != -1)
+    {
+        idx = ht->overflow_free;
+        ht->overflow_free = ht->bht[idx].overflow;
+        ht->bht[idx].overflow = -1;
+        return idx;
+    }
+    if(ht->overflow_used == ht->overflow_cap)
+    {
+        old_total = ht->size + ht->overflow_cap;
+        ht->overflow_cap *= 2;
+        new_total = ht->size + ht->overflow_cap;
+        slab = (HT_BUCKET*)Malloc_aligned(CACHE_LINE_SIZE, new_total*sizeof(HT_BUCKET));
+        memcpy(slab, ht->bht, old_total*sizeof(HT_BUCKET));
+        memset(slab + old_total, 0, (new_total - old_total)*sizeof(HT_BUCKET));
+        for(int i = old_total; i < new_total; i++)
+            slab[i].overflow = -1;
+        free(ht->bht);
+        ht->bht = slab;
+        HT_STAT_RESIZE(ht);
+    }
+    idx = ht->size + ht->overflow_used;
+    ht->overflow_used++;
+    return idx;
+}
+
 bool bucket_ht_insert(HASH_TABLE *ht, void *data_in, int key)
 {
-    bool success = false;
+    HT_BUCKET *b;
+    uint32_t h;
+    uint8_t full;
+    int idx, last, slot;
     
-    if(!ht->bht[key][0])
+    h = bucket_hash(key);
+    full = (uint8_t)((1 << ht->bucket_size) - 1);
+    //first bucket along the chain with a free slot
+    last = -1;
+    idx = h % ht->size;
+    HT_STAT_PROBE(ht);
+    while(idx != -1 && ht->bht[idx].occupied == full)
     {
-        ht->bht[key][0] = data_in;
-        printf("inserted at [%d][%d]\n", key, 0);
-        success = true;
+        last = idx;
+        idx = ht->bht[idx].overflow;
+        HT_STAT_PROBE(ht);
     }
-    else
+    if(idx == -1)//every bucket in the chain is full
     {
-        for(int i = 1; i < ht->bucket_size; i++)
-        {
-            if(!ht->bht[key][i])
-            {
-                ht->bht[key][i] = data_in;
-                printf("inserted in bucket [%d][%d]\n", key, i);
-                success = true;
-                i = ht->bucket_size;
-            }
-            
-        }//if this bucket is full, we have to probe next bucket... until exhausted all buckets.
+        idx = _bucket_new_overflow(ht);
+        ht->bht[last].overflow = idx;
+        HT_STAT_OVERFLOW(ht);
     }
-    return success;
+    b = &ht->bht[idx];
+    slot = __builtin_ctz(~b->occupied & full);
+    b->tags[slot] = (uint8_t)(h >> 24);
+    b->keys[slot] = key;
+    b->satellite[slot] = data_in;
+    b->occupied |= (1 << slot);
+    HT_LOG("inserted in bucket [%d][%d]\n", idx, slot);
+    return true;
 }
 
+//data_in == NULL matches any entry with this key
 bool bucket_ht_search(HASH_TABLE *ht, void *data_in, int key)
 {
-    bool success = false;
+    HT_BUCKET *b;
+    uint32_t h;
+    uint8_t tag;
     
-    if(ht->bht[key][0] == data_in)
-        return true;
-    else
-    {   //search bucket
-        for(int i = 1; i < ht->bucket_size; i++)
+    h = bucket_hash(key);
+    tag = (uint8_t)(h >> 24);
+    for(int idx = h % ht->size; idx != -1; idx = b->overflow)
+    {
+        b = &ht->bht[idx];
+        HT_STAT_PROBE(ht);
+        for(int i = 0; i < ht->bucket_size; i++)
         {
-            if(ht->bht[key][i] == data_in)
-            {
-                success = true;
-                i = ht->bucket_size;
-            }
-            
+            if((b->occupied & (1 << i)) && b->tags[i] == tag && b->keys[i] == key
+               && (!data_in || b->satellite[i] == data_in))
+                return true;
         }
     }
-    return success;
+    return false;
 }
 
 void *bucket_ht_retrieve(HASH_TABLE *ht, int key)
 {
-    void *data_out = NULL;
+    return _bucket_ht_retrieve_hashed(ht, key, bucket_hash(key));
+}
+
+//h == bucket_hash(key), computed ahead by the caller (batched lookups)
+void *_bucket_ht_retrieve_hashed(HASH_TABLE *ht, int key, uint32_t h)
+{
+    HT_BUCKET *b;
+    uint8_t tag;
     
-    if(ht->bht[key][0])
-        return ht->bht[key][0];
-    else
-    {   //search bucket
-        for(int i = 1; i < ht->bucket_size; i++)
+    tag = (uint8_t)(h >> 24);
+    for(int idx = h % ht->size; idx != -1; idx = b->overflow)
+    {
+        b = &ht->bht[idx];
+        HT_STAT_PROBE(ht);
+        for(int i = 0; i < ht->bucket_size; i++)
         {
-            if(ht->bht[key][i])
-            {
-                return ht->bht[key];
-            }
-            
+            if((b->occupied & (1 << i)) && b->tags[i] == tag && b->keys[i] == key)
+                return b->satellite[i];
         }
-        
     }
-    return data_out;
-
+    return NULL;
 }
 
 bool bucket_ht_delete(HASH_TABLE *ht, int key)
 {
-    bool success = false;
+    HT_BUCKET *b;
+    uint32_t h;
+    uint8_t tag;
+    int pre;
     
-    if(ht->bht[key][0])
+    h = bucket_hash(key);
+    tag = (uint8_t)(h >> 24);
+    pre = -1;
+    for(int idx = h % ht->size; idx != -1; pre = idx, idx = b->overflow)
     {
-        ht->bht[key][0] = NULL;
-        return true;
-    }
-    else
-    {
-        for(int i = 1; i < ht->bucket_size; i++)
+        b = &ht->bht[idx];
+        for(int i = 0; i < ht->bucket_size; i++)
         {
-            if(!ht->bht[key][i])
+            if((b->occupied & (1 << i)) && b->tags[i] == tag && b->keys[i] == key)
             {
-                if(ht->bht[key][i])
+                b->occupied &= ~(1 << i);
+                b->satellite[i] = NULL;
+                if(!b->occupied && pre != -1)//empty overflow bucket: unlink and release
                 {
-                    ht->bht[key][i] = NULL;
-                    return true;
+                    ht->bht[pre].overflow = b->overflow;
+                    b->overflow = ht->overflow_free;
+                    ht->overflow_free = idx;
                 }
+                return true;
             }
-            
         }
-        
     }
-    return success;
+    return false;
 }
 
 bool free_ht_buckets(HASH_TABLE *ht)
 {
-    bool success = false;
-    
-    for(int i = 0; i < ht->size; i++)
-    {
-        free(ht->bht[i]);//free buckets
-    }
-    free(ht->bht);//free array of buckets
+    free(ht->bht);//one slab holds every bucket
     ht->bht = NULL;
+    free(ht->ary);
     free(ht);
     
-    return success;
+    return true;
 }
 
 
@@ -674,30 +1178,30 @@ bool free_ht_buckets(HASH_TABLE *ht)
 bool chain_ht_insert(HASH_TABLE *ht, void *data_in, int key)
 {
     CHAIN *c;
-    CHAIN_NODE *pre, *cur, *pnew;
+    CHAIN_NODE *pre, *cur;
     bool success;
     
-    key = key % ht->size;
+    key = (int)((unsigned)key % ht->size);
     success = false;
-    c = (CHAIN*)ht->ary[key];
+    c = &ht->chains[key];
+    HT_STAT_PROBE(ht);
+    if(c->primary_area && ht->compare(c->primary_area, data_in) == 0)
+        return false;//no duplicates
+    if(search_chain(ht, c, &pre, &cur, data_in))
+        return false;
     if(!c->primary_area)
     {
-        printf("[%d]: inserted at primary area!\n", key);
-        CHAIN_NODE *pnew = (CHAIN_NODE*)malloc(sizeof(CHAIN_NODE));
-        pnew->satellite = data_in;
-        c->primary_area = pnew;
+        HT_LOG("[%d]: inserted at primary area!\n", key);
+        c->primary_area = data_in;
         c->count++;
         success = true;
     }
     else
     {   //go to overflow
-        printf("[%d]: inserted at overflow!\n", key);
-        if(!search_chain(c, &pre, &cur, data_in))//no duplicates
-        {
-            add_to_chain(c, pre, data_in);
-            success = true;
-        }
-        
+        HT_LOG("[%d]: inserted at overflow!\n", key);
+        HT_STAT_OVERFLOW(ht);
+        add_to_chain(ht, c, pre, data_in);
+        success = true;
     }
     return success;
 }
@@ -706,19 +1210,14 @@ bool chain_ht_search(HASH_TABLE *ht, void *data_in, int key)
 {
     CHAIN *c;
     CHAIN_NODE *pre, *cur;
-    bool found;
     
-    found = false;
-    c = (CHAIN*)ht->ary[key];
-    
-    if(c->primary_area)
-    {
-        if(c->compare(c->primary_area->satellite, data_in) == 0)
-            found = true;
-    }
-    else //search the overflow area
-        found = search_chain(c, &pre, &cur, data_in);
-    return found;
+    key = (int)((unsigned)key % ht->size);
+    c = &ht->chains[key];
+    HT_STAT_PROBE(ht);
+    if(c->primary_area && ht->compare(c->primary_area, data_in) == 0)
+        return true;
+    //search the overflow area
+    return search_chain(ht, c, &pre, &cur, data_in);
 }
 
 void *chain_ht_retrieve(HASH_TABLE *ht, void *target, int key)
@@ -727,24 +1226,18 @@ void *chain_ht_retrieve(HASH_TABLE *ht, void *target, int key)
     CHAIN_NODE *pre, *cur;
     void *data_out = NULL;
     
-    key = key % ht->size;
-    c = (CHAIN*)ht->ary[key];
-    if(c->primary_area)
+    key = (int)((unsigned)key % ht->size);
+    c = &ht->chains[key];
+    HT_STAT_PROBE(ht);
+    if(c->primary_area && ht->compare(c->primary_area, target) == 0)
     {
-        if(c->compare(c->primary_area->satellite, target) == 0)
-        {
-            printf("found in primary area of [%d]!\n", key);
-            return c->primary_area->satellite;
-        }
-        else
-        {   //search this chain in the overflow
-            data_out = retrieve_chain(c, &pre, &cur, target);
-            if(data_out)
-            {
-                printf("found in overflow area of [%d]!\n", key);
-            }
-        }
+        HT_LOG("found in primary area of [%d]!\n", key);
+        return c->primary_area;
     }
+    //search this chain in the overflow
+    data_out = retrieve_chain(ht, c, &pre, &cur, target);
+    if(data_out)
+        HT_LOG("found in overflow area of [%d]!\n", key);
     return data_out;
 }
 
@@ -755,64 +1248,44 @@ bool chain_ht_delete(HASH_TABLE *ht, void *target, int key)
     bool removed;
     
     removed = false;
-    key = key % ht->size;
-    c = (CHAIN*)ht->ary[key];
-    if(c->primary_area)
-    {
-        if(c->compare(c->primary_area->satellite, target) == 0)
-        {   //don't move from overflow here. just leave this NULL.
-            //don't free anything here
-            printf("deleting node from primary area [%d]\n", key);
-            c->primary_area = NULL;
-            c->count--;
-            removed  = true;
-        }
+    key = (int)((unsigned)key % ht->size);
+    c = &ht->chains[key];
+    if(c->primary_area && ht->compare(c->primary_area, target) == 0)
+    {   //don't move from overflow here. just leave this NULL.
+        HT_LOG("deleting node from primary area [%d]\n", key);
+        c->primary_area = NULL;
+        c->count--;
+        removed  = true;
     }
-    else
+    else if(search_chain(ht, c, &pre, &cur, target))
     {
-        if(search_chain(c, &pre, &cur, target))
-        {
-            printf("deleting node from overflow area [%d]\n", key);
-            delete_chain(c, pre, cur);
-            c->count--;
-            removed = true;
-        }
-
+        HT_LOG("deleting node from overflow area [%d]\n", key);
+        removed = delete_chain(ht, c, pre, cur);
     }
     
     return removed;
 }
 
+//slots and overflow nodes live in a handful of allocations: no walk over the chains.
 bool free_ht_chains(HASH_TABLE *ht)
 {
-    bool success = false;
-    CHAIN *c;
-    CHAIN_NODE *pre, *cur;
+    CHAIN_BLOCK *pre, *cur;
     
-    for(int i = 0; i < ht->size; i++)
+    cur = ht->arena.blocks;
+    while(cur)
     {
-        c = (CHAIN*)ht->ary[i];
-        if(c->primary_area)
-            free(c->primary_area);
-        if(c->overflow_area)
-        {
-            cur = c->overflow_area;
-            while(cur)
-            {
-                pre = cur;
-                cur = cur->next;
-                free(pre);
-            }
-        }
-        success = true;
+        pre = cur;
+        cur = cur->next;
+        free(pre);
     }
+    free(ht->chains);
     free(ht);
-    return success;
+    return true;
 }
 
-void add_to_chain(CHAIN *list, CHAIN_NODE *pre, void *data_in)
+void add_to_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE *pre, void *data_in)
 {
-    CHAIN_NODE *pnew = (CHAIN_NODE*)malloc(sizeof(CHAIN_NODE));
+    CHAIN_NODE *pnew = chain_arena_alloc(&ht->arena);
     pnew->satellite = data_in;
     
     if(!pre)//empty or start
@@ -829,7 +1302,7 @@ void add_to_chain(CHAIN *list, CHAIN_NODE *pre, void *data_in)
     list->count++;
 }
 
-bool search_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target)
+bool search_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target)
 {
     bool found;
     
@@ -838,68 +1311,239 @@ bool search_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target)
     if(list->overflow_area)
     {
         *cur = list->overflow_area;
-        while(*cur && (list->compare(target, (*cur)->satellite) > 0))
+        HT_STAT_PROBE(ht);
+        while(*cur && (ht->compare(target, (*cur)->satellite) > 0))
         {
             *pre = *cur;
             *cur = (*cur)->next;
+            HT_STAT_PROBE(ht);
         }
-        if(*cur && (list->compare(target, (*cur)->satellite) == 0))
+        if(*cur && (ht->compare(target, (*cur)->satellite) == 0))
             found = true;
     }
     return found;
 }
 
 
-//retrieve_chain(c, &pre, &cur, target);
+//retrieve_chain(ht, c, &pre, &cur, target);
 /*
  Given chaining strucutre,
  once we index USING h(key) into the array, we must search the primary area
  or overflow chain. we identifiy what we are looking for based on the application key
  and not h(key).
  */
-void *retrieve_chain(CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target)
+void *retrieve_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE **pre, CHAIN_NODE **cur, void *target)
 {
     void *data_out = NULL;
     
-    *pre = NULL;
-    if(list->overflow_area)
+    if(search_chain(ht, list, pre, cur, target))
+        data_out = (*cur)->satellite;
+    return data_out;
+}
+
+bool delete_chain(HASH_TABLE *ht, CHAIN *list, CHAIN_NODE *pre, CHAIN_NODE *cur)
+{
+    //in overflow, we hand nodes back to the arena.
+    if(!pre)//delete at front
+        list->overflow_area = cur->next;
+    else//delete in the middle or the end
+        pre->next = cur->next;
+    chain_arena_release(&ht->arena, cur);
+    list->count--;
+    return true;
+}
+
+/********************** KEYED HT APIS *********************/
+HASH_TABLE *create_keyed_hash_table(int m, const HT_KEY_OPS *key_ops, void (*process)(void *arg1, void *arg2))
+{
+    HASH_TABLE *ht;
+    int size = 1;
+    
+    while(size < m)//power of 2: the index is hash & (size - 1)
+        size <<= 1;
+    ht = create_hash_table(size, 0, process, NULL, NULL, OPEN_ADDRESSING, DIVISION, KEYED);
+    ht->key_ops = key_ops;
+    ht->compare = NULL;//equality is key_ops->equal
+    ht->heads = (int*)Malloc(size*sizeof(int));
+    memset(ht->heads, 0xff, size*sizeof(int));//-1: empty chain
+    ht->entry_cap = size;
+    ht->entries = (HT_ENTRY*)Malloc(ht->entry_cap*sizeof(HT_ENTRY));
+    ht->entry_used = 0;
+    ht->entry_free = -1;
+    ht->count = 0;
+    return ht;
+}
+
+//entry holding key, -1 if none. *link is left on the link that points at it (or the chain's end).
+int _keyed_find(HASH_TABLE *ht, const void *key, uint64_t h, int **link)
+{
+    HT_ENTRY *e;
+    
+    *link = &ht->heads[h & (ht->size - 1)];
+    while(**link != -1)
     {
-        *cur = list->overflow_area;
-        while(*cur && (list->compare(target, (*cur)->satellite) > 0))
-        {
-            *pre = *cur;
-            *cur = (*cur)->next;
-        }
-        if(*cur && (list->compare(target, (*cur)->satellite) == 0))
+        e = &ht->entries[**link];
+        HT_STAT_PROBE(ht);
+        if(e->hash == h && ht->key_ops->equal(key, ht->key_ops->get_key(e->satellite)))
+            return **link;
+        *link = &e->next;
+    }
+    return -1;
+}
+
+//doubles the heads and relinks every entry by its cached hash: no key is touched or rehashed.
+void _keyed_grow(HASH_TABLE *ht)
+{
+    int *heads, new_size, next;
+    
+    new_size = 2*ht->size;
+    heads = (int*)Malloc(new_size*sizeof(int));
+    memset(heads, 0xff, new_size*sizeof(int));
+    for(int i = 0; i < ht->size; i++)
+    {
+        for(int e = ht->heads[i]; e != -1; e = next)
         {
-            data_out = (*cur)->satellite;
+            next = ht->entries[e].next;
+            ht->entries[e].next = heads[ht->entries[e].hash & (new_size - 1)];
+            heads[ht->entries[e].hash & (new_size - 1)] = e;
         }
     }
-    return data_out;
+    free(ht->heads);
+    ht->heads = heads;
+    ht->size = new_size;
+    HT_STAT_RESIZE(ht);
 }
 
-bool delete_chain(CHAIN *list, CHAIN_NODE *pre, CHAIN_NODE *cur)
+bool keyed_ht_insert(HASH_TABLE *ht, void *data_in)
 {
-    bool removed = false;
+    const void *key;
+    uint64_t h;
+    int *link, e;
     
-    //in overflow, we do delete nodes.
-    if(!pre)//delete at front
+    key = ht->key_ops->get_key(data_in);
+    h = ht->key_ops->hash(key);
+    if(_keyed_find(ht, key, h, &link) != -1)
+        return false;//no duplicates
+    if(ht->entry_free != -1)
     {
-        list->overflow_area = list->overflow_area->next;
-        if(list->count == 1)
-        {
-            list->overflow_area = NULL;
+        e = ht->entry_free;
+        ht->entry_free = ht->entries[e].next;
+    }
+    else
+    {
+        if(ht->entry_used == ht->entry_cap)
+        {   //entries are linked by index, but link points into the array: re-find it after the move
+            ht->entry_cap *= 2;
+            ht->entries = (HT_ENTRY*)Realloc(ht->entries, ht->entry_cap*sizeof(HT_ENTRY));
+            _keyed_find(ht, key, h, &link);
         }
-        free(pre);
-        removed = true;
+        e = ht->entry_used++;
     }
-    else{//delete in the middle or the end
-        
-        pre->next = pre->next->next;
-        free(cur);
-        removed = true;
+    ht->entries[e].satellite = data_in;
+    ht->entries[e].hash = h;
+    ht->entries[e].next = -1;
+    *link = e;//append at the chain's end
+    ht->count++;
+    if(ht->filter)
+        bloom_add(ht->filter, h);
+    if(ht->count > KEYED_MAX_LOAD*ht->size)
+        _keyed_grow(ht);
+    return true;
+}
+
+bool keyed_ht_search(HASH_TABLE *ht, const void *key)
+{
+    return keyed_ht_retrieve(ht, key) != NULL;
+}
+
+void *keyed_ht_retrieve(HASH_TABLE *ht, const void *key)
+{
+    return _keyed_ht_retrieve_hashed(ht, key, ht->key_ops->hash(key));
+}
+
+//h is key_ops->hash(key), already computed (retrieve_ht_batch)
+void *_keyed_ht_retrieve_hashed(HASH_TABLE *ht, const void *key, uint64_t h)
+{
+    int *link, e;
+    
+    if(ht->filter && !bloom_may_contain(ht->filter, h))
+        return NULL;
+    e = _keyed_find(ht, key, h, &link);
+    return e != -1 ? ht->entries[e].satellite : NULL;
+}
+
+bool keyed_ht_delete(HASH_TABLE *ht, const void *key)
+{
+    int *link, e;
+    
+    e = _keyed_find(ht, key, ht->key_ops->hash(key), &link);
+    if(e == -1)
+        return false;
+    *link = ht->entries[e].next;
+    ht->entries[e].satellite = NULL;
+    ht->entries[e].next = ht->entry_free;
+    ht->entry_free = e;
+    ht->count--;
+    return true;
+}
+
+bool free_ht_keyed(HASH_TABLE *ht)
+{
+    free(ht->heads);
+    free(ht->entries);
+    free(ht);
+    return true;
+}
+
+/*
+ HASH AND EQUALITY HELPERS for the usual key types. composite keys: hash each field and fold
+ with ht_hash_combine() (or ht_hash_bytes() over a packed struct without padding).
+ */
+//splitmix64 finalizer
+uint64_t ht_hash_u64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+//FNV-1a over the bytes, finished by the 64-bit mixer so the low bits (the index) are good
+uint64_t ht_hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    
+    for(size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
     }
-    list->count--;
-    return removed;
+    return ht_hash_u64(h);
+}
+
+uint64_t ht_hash_combine(uint64_t h, uint64_t v)
+{
+    return ht_hash_u64(h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+uint64_t ht_u64_hash(const void *key)
+{
+    return ht_hash_u64(*(const uint64_t*)key);
+}
+
+bool ht_u64_equal(const void *key1, const void *key2)
+{
+    return *(const uint64_t*)key1 == *(const uint64_t*)key2;
+}
+
+uint64_t ht_str_hash(const void *key)
+{
+    return ht_hash_bytes(key, strlen((const char*)key), 0);
+}
+
+bool ht_str_equal(const void *key1, const void *key2)
+{
+    return strcmp((const char*)key1, (const char*)key2) == 0;
 }
 #endif /* hashing_tables_h */
@@ -55,35 +55,31 @@ typedef struct dheap
 
 //ADT POINTER-BASED HEAP
 //for kicks but has applications.
-//draw out like a mesh and figure out how to move around with ptrs.
+/*
+ was a mesh of malloc'd nodes (parent, children and neighbour pointers, 48 bytes a node plus the
+ allocator's header) navigated with a LEVEL array. the tree is always complete, so a node's place
+ is its level order number n (root 1): the path from the root to n is the bits of n below its
+ leading 1 (0 left, 1 right), its parent is n/2 and its children 2n, 2n+1. the last node is
+ number count. nodes live in a pool of blocks addressed by that number (32 bits), so a node is
+ just its data pointer and growing the heap never moves one.
+ */
+#define PHEAP_BLOCK_BITS 10
+#define PHEAP_BLOCK_NODES (1 << PHEAP_BLOCK_BITS)
+
 typedef struct heap_node
 {
     void *data;
-    struct heap_node *left;
-    struct heap_node *right;
-    struct heap_node *parent;
-    struct heap_node *left_neighbor;
-    struct heap_node *right_neighbor;
 }HNODE;
 
-typedef struct level
-{
-    int n;
-    bool full;
-    int count;
-}LEVEL;
-
 typedef struct pheap
 {
-    int max_size;
-    LEVEL *ary;
-    int current_level;
+    uint32_t max_size;//nodes the pool holds without a new block
     int (*compare)(void *arg1, void *arg2);
     void (*process)(void *data);
-    void (*swap)(void *arg1, void *arg2);
-    HNODE *root;
-    HNODE *last;//LEFT MOST LAST LEAF
-    int count;
+    void (*swap)(void *arg1, void *arg2);//unused: nodes move data pointers, elements stay put
+    HNODE **blocks;
+    uint32_t block_count;
+    uint32_t count;
 }PHEAP; //node, pointer based, heap
 
 typedef enum {MAX=1, MIN} HEAP_TYPE;
@@ -115,14 +111,9 @@ void destroy_dynamic_heap_array(DHEAP *heap);
 
 /***** ADT POINTER-BASED HEAP -- USE MAX HEAP ****/
 PHEAP* create_pointer_based_heap(int size, int (*compare)(void *arg1, void *arg2), void (*process)(void *data), void (*swap)(void *arg1, void *arg2));
-HNODE* _preheap_up(PHEAP *heap, HNODE *root, HNODE *new_node);
-void print_pheap_ary(PHEAP *heap);
-void heap_breath_first_insertion(PHEAP *heap, HNODE *root, HNODE *child);
-void bft_verify_max_heap(PHEAP *heap, HNODE *root, HNODE *child);
+HNODE* _pheap_node(PHEAP *heap, uint32_t n);
 void pointer_based_heap_breath_first_traversal(PHEAP *root);
-LEVEL* set_levels_array(int n);
 bool pointer_based_heap_insert(PHEAP *heap, void *data_in);
-bool level_i_full(LEVEL *ary, int i);
 void pointer_based_heap_get_root(PHEAP *heap);
 bool pointer_based_heap_delete(PHEAP *heap);
 HNODE* heap_breath_first_last_node(PHEAP *tree);
@@ -417,7 +408,7 @@ bool dheap_insert(DHEAP *heap, void *data_in)
         //realloc extend or
         puts("realloc\n");
         heap->max_size = heap->max_size + heap->realloc_amt;
-        heap->ary = (void**)realloc(heap->ary, heap->max_size);
+        heap->ary = (void**)Realloc(heap->ary, heap->max_size*sizeof(void*));
     }
     heap->count++;
     heap->last++;
@@ -465,7 +456,7 @@ void _dreheap_down(DHEAP *heap, int parent_idx)
     
     last = heap->last;
     left_child_idx = 2*parent_idx + 1;
-    if(left_child_idx)// IF LEFT SUBTREE
+    if(left_child_idx <= last)// IF LEFT SUBTREE
     {
         left_child_data = heap->ary[left_child_idx];
         right_child_idx = 2*parent_idx + 2;
@@ -510,148 +501,58 @@ void destroy_dynamic_heap_array(DHEAP *heap)
 
 /***********************************************************/
 /******** FINE GRAINED MEMORY CONTROL... *******************/
-/* must this be a tree structure or an array of structs.....*/
-/*
- 
- solution:
- each node has pointer to parent and left, right neightbors, and left, right children.
- 
- have an array of levels. for each level Li, we compute n, and count. a level is full when count == n
- 
- to determine where to insert, if level
- */
-
 #define HEAP_SIZE_EXCEED printf("HEAP SIZE EXCEEDED!!!!!!!!");
 
-LEVEL* set_levels_array(int n)
-{
-    LEVEL *ary;
-    int levels;
-    
-    ary = (LEVEL*)calloc(n, sizeof(LEVEL));
-    levels = floor(log2(n))+1;//from 0 to levels-1
-    
-    for(int i =0 ; i < levels; i++)
-    {
-        ary[i].n = (int)pow(2, i);
-        ary[i].full = false;
-        ary[i].count = 0;
-    }
-  return ary;
-}
-
-bool level_i_full(LEVEL *ary, int i)
-{
-    if(ary[i].count == ary[i].n)
-    {
-        ary[i].full = true;
-        return true;
-    }
-    else
-        return false;
-}
-
 PHEAP* create_pointer_based_heap(int size, int (*compare)(void *arg1, void *arg2), void (*process)(void *data), void (*swap)(void *arg1, void *arg2))
 {
     PHEAP *heap = (PHEAP*)Malloc(sizeof(PHEAP));
     
-    //FORCE SIZE TO A POWER OF 2
-    heap->max_size = size;//(int)pow(2, ceil(log2(size))) - 1;
     heap->count = 0;
-    heap->root = NULL;
-    heap->last = NULL;
     heap->compare = compare;
     heap->process = process;
     heap->swap = swap;
-    heap->ary = set_levels_array(size);
+    //blocks for size nodes up front (number 0 is unused), more as the heap grows
+    heap->block_count = (uint32_t)(((int64_t)(size > 0 ? size : 0) + PHEAP_BLOCK_NODES)/PHEAP_BLOCK_NODES);
+    heap->blocks = (HNODE**)Malloc(heap->block_count*sizeof(HNODE*));
+    for(uint32_t i = 0; i < heap->block_count; i++)
+        heap->blocks[i] = (HNODE*)Malloc(PHEAP_BLOCK_NODES*sizeof(HNODE));
+    heap->max_size = heap->block_count*PHEAP_BLOCK_NODES - 1;
     return heap;
 }
 
+//node number n, level order from the root at 1
+HNODE* _pheap_node(PHEAP *heap, uint32_t n)
+{
+    return &heap->blocks[n >> PHEAP_BLOCK_BITS][n & (PHEAP_BLOCK_NODES - 1)];
+}
+
 bool pointer_based_heap_insert(PHEAP *heap, void *data_in)
 {
-    HNODE *new_node;
-    HNODE *left_i_1;
-    HNODE *reheap_up;
-    bool correct_loc;
-    
-    new_node = (HNODE*)Malloc(sizeof(HNODE));
-    new_node->data = data_in;
-    new_node->left = NULL;
-    new_node->right = NULL;
-    new_node->left_neighbor = NULL;
-    //new_node->right_neighbor = NULL;//DON'T NEED TO DO THIS
+    uint32_t n, parent;
     
-    if(heap->count == 0)//L0
+    if(heap->count == UINT32_MAX - 1)
     {
-        heap->root = new_node;
-        //heap->root->left_neighbor = heap->root->right_neighbor = NULL;
-        new_node->parent = NULL;
-        heap->ary[0].count = 1;
-        heap->ary[0].full = true;
-        heap->current_level = 1;
+        HEAP_SIZE_EXCEED;
+        return false;
     }
-    else //1) FIND LEFT MOST LEFT TO INSERT NEW NODE.
+    //the last block ends at node UINT32_MAX: max_size never wraps before the check above
+    if(heap->count == heap->max_size)
     {
-        //TEST CURRENT LEVEL FULL
-        if(level_i_full(heap->ary, heap->current_level))
-            heap->current_level++;//go to next level
-        
-        //TRAVERSE ALL THE WAY DOWN TO LEFT DOWN TO LEVEL i - 1
-        left_i_1 = heap->root;
-        for(int level = 0; level < heap->current_level - 1; level++)
-        {
-            left_i_1 = left_i_1->left;
-        }
-        //TEST THE CHILDREN
-        //MOVE HORIZONTALLY ACROSS NEIGHBORS UNTIL YOU FIND ONE WITH A NIL CHILD.
-        while((left_i_1->left && left_i_1->right) && left_i_1 != NULL)
-        {
-            left_i_1 = left_i_1->right_neighbor;
-        }
-        //FOUND A NEIGHBOR WITH NIL CHILD
-        if(!left_i_1->left)//LEFT CHILD
-        {
-            heap->ary[heap->current_level].count++;
-            left_i_1->left = new_node;
-            new_node->parent = left_i_1;
-            if(heap->ary[heap->current_level].count == 1)//EDGE LEFT CHILD
-                new_node->left_neighbor = NULL;
-            else//INTERNAL LEFT CHILD
-                new_node->left_neighbor = left_i_1->left_neighbor->right;//NIL
-            new_node->right_neighbor = left_i_1->right;
-        }
-        else //if(!left_i_1->right)//RIGHT CHILD
-        {
-            heap->ary[heap->current_level].count++;
-            left_i_1->right = new_node; //*
-            new_node->parent = left_i_1;
-            new_node->left_neighbor = left_i_1->left;
-            //should not have to do this --
-            new_node->left_neighbor->right_neighbor = new_node;//JUST UPDATE HERE
-            //pointer for left neighbor should be updated as parent's right pointer changes.
-            if(heap->ary[heap->current_level].count == heap->ary[heap->current_level].n)//EDGE RIGHT CHILD
-                new_node->right_neighbor = NULL;
-            else//INTERNAL RIGHT CHILD
-                new_node->right_neighbor = left_i_1->right_neighbor->left;
-         }
-        // 2) VERIFY HEAP PROPERTY CLIMBING UP THE TREE WITH PARENT POINTERS
-        reheap_up = new_node;
-        correct_loc = false;
-        while(!correct_loc && reheap_up->parent)
-        {
-            //FOR MAX HEAP, IF CHILD DATA > PARENT DATA SWAP
-            if(heap->compare(reheap_up->data, reheap_up->parent->data) > 0)
-            {
-                heap->swap(reheap_up->data, reheap_up->parent->data);
-                reheap_up = reheap_up->parent;
-            }
-            else
-                correct_loc = true;
-        }//new data at correct location.
+        heap->blocks = (HNODE**)Realloc(heap->blocks, (heap->block_count + 1)*sizeof(HNODE*));
+        heap->blocks[heap->block_count++] = (HNODE*)Malloc(PHEAP_BLOCK_NODES*sizeof(HNODE));
+        heap->max_size += PHEAP_BLOCK_NODES;
     }
-    heap->last = new_node;
-    heap->count++;
-
+    //the new last node; climb its path while the parent is smaller (MAX HEAP), moving the hole up
+    n = ++heap->count;
+    while(n > 1)
+    {
+        parent = n >> 1;
+        if(heap->compare(data_in, _pheap_node(heap, parent)->data) <= 0)
+            break;
+        _pheap_node(heap, n)->data = _pheap_node(heap, parent)->data;
+        n = parent;
+    }
+    _pheap_node(heap, n)->data = data_in;
     return true;
 }
 
@@ -659,141 +560,56 @@ void pointer_based_heap_get_root(PHEAP *heap)
 {
     if(heap->count != 0)
     {
-        heap->process(heap->root->data);
+        heap->process(_pheap_node(heap, 1)->data);
         pointer_based_heap_delete(heap);
     }
 }
 
+//removes the root: the last node's data goes down from the root's place to where it fits
 bool pointer_based_heap_delete(PHEAP *heap)
 {
-    HNODE *last;
-    HNODE *reheap_down;
-    HNODE *largest_child;
-    bool correct_loc;
-    int working_level;
-    
-    //1) FIND LEFT MOST LEFT LEAF
-    //ENSURE CURRENT LEVEL IS CORRECT
-    if(level_i_full(heap->ary, heap->current_level))
-        heap->current_level++;//go to next level
-    
-    //WE NEED WORK ON FIRST NON-EMPTY LEVEL
-    if(heap->ary[heap->current_level].count > 0)
-        working_level = heap->current_level;
-    else
-        working_level = heap->current_level - 1;
-    
-    //printf("cl: %d\n", heap->current_level);
-    //2) USE BREATH FIRST SEARCH TO FIND LAST NODE IN THE TREE
-    //actually, no.
-    last = heap->last;
-    
-    //2) SWAP DATA WITH ROOT LAST NODE
-    heap->swap(heap->root->data, last->data);
+    uint32_t n = 1, child, last;
+    void *data;
     
-    //4) DELETE LAST NODE AND RESET ANY POINTERS TO NIL WHICH SHOULD BE
-    if(heap->count > 1) //IF NOT ONLY NODE
-    {
-        
-        //RESET PARENT POINTER TO CHILD
-        //IS LAST A LEFT OR RIGHT CHILD?
-        if(!last->parent->right) //LEFT CHILD
-        {
-            if(heap->ary[working_level].count == 1)//edge node -- not enough to determine left edge node
-            {
-                heap->last = last->parent->right_neighbor;//update the last poiter
-                while(heap->last->right_neighbor)
-                {
-                    heap->last = heap->last->right_neighbor; //****
-                }
-                last->parent->left = NULL;//set parent->last to NIL
-            }
-            else//internal left node --
-            {
-                heap->last = last->left_neighbor;
-                last->left_neighbor->right_neighbor = NULL;//left neighbor's right neighbor pointer
-                last->parent->left = NULL;//reset parent left pointer
-            }
-        }
-        else//RIGHT CHILD
-        {
-            heap->last = last->left_neighbor;
-            //same pointers to reset for an edge or internal node
-            last->left_neighbor->right_neighbor = NULL;//left neighbor's right neighbor pointer
-            last->parent->right = NULL;//reset parent left pointer
-            
-        }
-        heap->ary[working_level].count--;
-        free(last);
-        //5) FROM THE ROOT, REHEAP DOWN.... SWAPING DATA AS NEEDED TO KEEP HEAP PROPERTY.
-        //complete
-        //this can be done recursibely as well....
-        if(heap->count >= 2)//delted othe only child
-        {
-            reheap_down = heap->root;
-            correct_loc = false;
-            while(!correct_loc)
-            {
-                //IF THERE ARE CHILDREN, DETERMINE ONE WITH LARGEST KEY
-                if(reheap_down->left)
-                {
-                    if(reheap_down->right)
-                    {
-                        if(heap->compare(reheap_down->right->data, reheap_down->left->data) > 0)
-                            largest_child = reheap_down->right;
-                    }
-                    largest_child = reheap_down->left;
-                    
-                    if(heap->compare(reheap_down->data, largest_child->data) < 0)
-                    {
-                        heap->swap(reheap_down->data, largest_child->data);
-                        //go down the tree=: recursive call... with left or right as root.
-                        if(largest_child == reheap_down->left)
-                            reheap_down = reheap_down->left;
-                        else
-                            reheap_down = reheap_down->right;
-                    }
-                    else
-                        correct_loc = true;
-                }
-                else
-                    correct_loc = true;
-              }
-        }
-        
-    }
-    else //nothing to reset, delete the root.
+    if(heap->count == 0)
+        return false;
+    last = heap->count--;
+    data = _pheap_node(heap, last)->data;
+    //children of n are 2n and 2n + 1; compare in 64 bits, 2n overflows 32 near the top
+    while((uint64_t)n*2 <= heap->count)
     {
-        heap->ary[working_level].count--;
-        heap->last = NULL;
-        free(last);
-        heap->root = NULL;
+        child = n*2;
+        if(child < heap->count && heap->compare(_pheap_node(heap, child + 1)->data, _pheap_node(heap, child)->data) > 0)
+            child++;
+        if(heap->compare(data, _pheap_node(heap, child)->data) >= 0)
+            break;
+        _pheap_node(heap, n)->data = _pheap_node(heap, child)->data;
+        n = child;
     }
-    heap->count--;
+    if(heap->count)
+        _pheap_node(heap, n)->data = data;
     return true;
 }
 
+//level order is node number order: no queue
 void pointer_based_heap_breath_first_traversal(PHEAP *heap)
 {
-    QUEUE *q;
-    HNODE *cur;
+    for(uint32_t n = 1; n <= heap->count; n++)
+        heap->process(_pheap_node(heap, n)->data);
+}
 
-    q = create_queue_adt(NULL);
-    enqueue_queue_adt(q, heap->root);
-    while(!is_queue_empty_queue_adt(q))
-    {
-        cur =  (HNODE*)deque_queue_adt(q);
-        heap->process(cur->data);
-        if(cur->left)
-            enqueue_queue_adt(q, cur->left);
-        if(cur->right)
-            enqueue_queue_adt(q, cur->right);
-    }
+//LEFT MOST LAST LEAF, NULL if empty
+HNODE* heap_breath_first_last_node(PHEAP *heap)
+{
+    return heap->count ? _pheap_node(heap, heap->count) : NULL;
 }
 
 void destroy_pointer_based_heap(PHEAP *heap)
 {
-   free(heap);
+    for(uint32_t i = 0; i < heap->block_count; i++)
+        free(heap->blocks[i]);
+    free(heap->blocks);
+    free(heap);
 }
 
 /******** HEAP ADT as we have seen the signature of ADTs...
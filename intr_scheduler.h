@@ -0,0 +1,279 @@
+/* INTERRUPT DISPATCH SCHEDULER: PENDING BITMAP, PER-LEVEL FIFOS, MASKING, NESTING */
+
+#ifndef intr_scheduler_h
+#define intr_scheduler_h
+#include <limits.h>
+#include "wrappers.h"
+#include "heap.h"
+#include "typed_heap.h"
+
+/*
+ the INTR heaps answer "highest priority pending" in O(log n). a dispatcher with a bounded set of
+ levels can do it in O(1), like an interrupt controller:
+   levels 0..INTR_LEVELS-1, higher is more urgent. bit l of pending is set while level l has a
+   request queued; its requests wait in a FIFO, so equal priorities are served in arrival order.
+   highest dispatchable level = 63 - clz(pending & enabled & above), where enabled holds the
+   levels not masked one by one, and above keeps the levels over both the priority threshold
+   and the priority of the handler running now (only a higher level may nest).
+   intr_disable()/intr_enable() stop and restart all dispatching, like cli/sti.
+ priorities outside 0..INTR_LEVELS-1 go to a heap (TYPED_HEAP, FIFO on ties through a sequence
+ number) and compete with the bitmap's best on every dispatch: the bitmap is the fast path, the
+ heap keeps any int priority legal. threshold and nesting apply to them too; per-level masks do not.
+ dispatch: intr_dispatch_begin() takes the request and pushes its priority as the running level,
+ intr_dispatch_end() is the end of interrupt. intr_service() runs the handler over everything
+ dispatchable; a handler that calls intr_service() again lets higher levels preempt it.
+ */
+#define INTR_LEVELS 64
+#define INTR_MAX_NESTING 128
+#define INTR_IDLE INT_MIN //running priority with no handler active
+
+typedef struct intr_fifo
+{
+    INTR **ary;
+    int head;
+    int count;
+    int size;//power of 2
+}INTR_FIFO;
+
+typedef struct intr_pending
+{
+    INTR *intr;
+    uint64_t seq;
+}INTR_PENDING;
+
+#define INTR_PENDING_LESS(a, b) ((a)->intr->priority > (b)->intr->priority || \
+                                 ((a)->intr->priority == (b)->intr->priority && (a)->seq < (b)->seq))
+TYPED_HEAP(INTR_FALLBACK_HEAP, intr_fallback, INTR_PENDING, INTR_PENDING_LESS, 4)
+
+typedef struct intr_stats
+{
+    uint64_t raised;
+    uint64_t dispatched;
+    uint64_t nested;//dispatched while another handler was running
+    uint64_t fallback;//requests that went through the heap
+    int max_depth;
+    uint64_t per_level[INTR_LEVELS];//dispatched per bitmap level
+}INTR_STATS;
+
+typedef struct intr_scheduler
+{
+    uint64_t pending;//bit l: FIFO l not empty
+    uint64_t enabled;//bit l: level l not masked
+    int threshold;//only priorities above it are dispatched
+    bool disabled;
+    INTR_FIFO fifos[INTR_LEVELS];
+    INTR_FALLBACK_HEAP *fallback;
+    uint64_t seq;
+    int running[INTR_MAX_NESTING];//priorities of the active handlers, innermost last
+    int depth;
+    void (*handler)(INTR *intr, void *context);
+    void *context;
+    INTR_STATS stats;
+}INTR_SCHEDULER;
+
+INTR_SCHEDULER *create_intr_scheduler(void (*handler)(INTR *intr, void *context), void *context);
+void intr_raise(INTR_SCHEDULER *s, INTR *intr);
+INTR *intr_dispatch_begin(INTR_SCHEDULER *s);
+void intr_dispatch_end(INTR_SCHEDULER *s);
+int intr_service(INTR_SCHEDULER *s);
+int intr_highest_pending(INTR_SCHEDULER *s);
+void intr_mask_level(INTR_SCHEDULER *s, int level);
+void intr_unmask_level(INTR_SCHEDULER *s, int level);
+void intr_set_threshold(INTR_SCHEDULER *s, int threshold);
+void intr_disable(INTR_SCHEDULER *s);
+void intr_enable(INTR_SCHEDULER *s);
+void print_intr_stats(INTR_SCHEDULER *s);
+void destroy_intr_scheduler(INTR_SCHEDULER *s);
+uint64_t _intr_levels_above(int priority);
+int _intr_floor(INTR_SCHEDULER *s);
+
+INTR_SCHEDULER *create_intr_scheduler(void (*handler)(INTR *intr, void *context), void *context)
+{
+    INTR_SCHEDULER *s = (INTR_SCHEDULER*)Calloc(1, sizeof(INTR_SCHEDULER));
+
+    s->enabled = ~0ULL;
+    s->threshold = INTR_IDLE;
+    s->fallback = create_intr_fallback(16);
+    s->handler = handler;
+    s->context = context;
+    return s;
+}
+
+void intr_raise(INTR_SCHEDULER *s, INTR *intr)
+{
+    INTR_FIFO *f;
+    INTR_PENDING p;
+    int level = intr->priority;
+
+    s->stats.raised++;
+    if(level < 0 || level >= INTR_LEVELS)
+    {
+        p.intr = intr;
+        p.seq = s->seq++;
+        intr_fallback_insert(s->fallback, p);
+        s->stats.fallback++;
+        return;
+    }
+    f = &s->fifos[level];
+    if(f->count == f->size)
+    {
+        //unroll the ring into a doubled array
+        INTR **ary = (INTR**)Malloc((f->size ? f->size*2 : 8)*sizeof(INTR*));
+        for(int i = 0; i < f->count; i++)
+            ary[i] = f->ary[(f->head + i) & (f->size - 1)];
+        free(f->ary);
+        f->ary = ary;
+        f->head = 0;
+        f->size = f->size ? f->size*2 : 8;
+    }
+    f->ary[(f->head + f->count) & (f->size - 1)] = intr;
+    f->count++;
+    s->pending |= 1ULL << level;
+}
+
+//bitmap levels strictly above priority
+uint64_t _intr_levels_above(int priority)
+{
+    if(priority < 0)
+        return ~0ULL;
+    if(priority >= INTR_LEVELS - 1)
+        return 0;
+    return ~((2ULL << priority) - 1);
+}
+
+//a request must be above this to be dispatched: the threshold or the running handler
+int _intr_floor(INTR_SCHEDULER *s)
+{
+    int running = s->depth ? s->running[s->depth - 1] : INTR_IDLE;
+
+    return running > s->threshold ? running : s->threshold;
+}
+
+//priority of the request intr_dispatch_begin() would take, INTR_IDLE if none
+int intr_highest_pending(INTR_SCHEDULER *s)
+{
+    uint64_t ready;
+    INTR_PENDING *top;
+    int floor = _intr_floor(s), best = INTR_IDLE;
+
+    if(s->disabled)
+        return INTR_IDLE;
+    ready = s->pending & s->enabled & _intr_levels_above(floor);
+    if(ready)
+        best = 63 - __builtin_clzll(ready);
+    top = intr_fallback_peek(s->fallback);
+    if(top && top->intr->priority > floor && top->intr->priority > best)
+        best = top->intr->priority;
+    return best;
+}
+
+INTR *intr_dispatch_begin(INTR_SCHEDULER *s)
+{
+    INTR_FIFO *f;
+    INTR_PENDING p;
+    INTR *intr = NULL;
+    int best = intr_highest_pending(s);
+
+    if(best == INTR_IDLE || s->depth == INTR_MAX_NESTING)
+        return NULL;
+    if(best >= 0 && best < INTR_LEVELS)
+    {
+        f = &s->fifos[best];
+        intr = f->ary[f->head];
+        f->head = (f->head + 1) & (f->size - 1);
+        if(--f->count == 0)
+            s->pending &= ~(1ULL << best);
+        s->stats.per_level[best]++;
+    }
+    else
+    {
+        if(!intr_fallback_get_min(s->fallback, &p))
+            return NULL;
+        intr = p.intr;
+    }
+    s->stats.dispatched++;
+    s->stats.nested += s->depth > 0;
+    s->running[s->depth++] = best;
+    if(s->depth > s->stats.max_depth)
+        s->stats.max_depth = s->depth;
+    return intr;
+}
+
+//end of interrupt: the handler that began last is done
+void intr_dispatch_end(INTR_SCHEDULER *s)
+{
+    if(s->depth > 0)
+        s->depth--;
+}
+
+//runs the handler on every request that may run now; returns how many
+int intr_service(INTR_SCHEDULER *s)
+{
+    INTR *intr;
+    int served = 0;
+
+    while((intr = intr_dispatch_begin(s)))
+    {
+        if(s->handler)
+            s->handler(intr, s->context);
+        intr_dispatch_end(s);
+        served++;
+    }
+    return served;
+}
+
+void intr_mask_level(INTR_SCHEDULER *s, int level)
+{
+    if(level < 0 || level >= INTR_LEVELS)
+    {
+        INDEX_ERROR;
+        return;
+    }
+    s->enabled &= ~(1ULL << level);
+}
+
+void intr_unmask_level(INTR_SCHEDULER *s, int level)
+{
+    if(level < 0 || level >= INTR_LEVELS)
+    {
+        INDEX_ERROR;
+        return;
+    }
+    s->enabled |= 1ULL << level;
+}
+
+//INTR_IDLE lets every priority through
+void intr_set_threshold(INTR_SCHEDULER *s, int threshold)
+{
+    s->threshold = threshold;
+}
+
+void intr_disable(INTR_SCHEDULER *s)
+{
+    s->disabled = true;
+}
+
+void intr_enable(INTR_SCHEDULER *s)
+{
+    s->disabled = false;
+}
+
+void print_intr_stats(INTR_SCHEDULER *s)
+{
+    printf("raised: %llu, dispatched: %llu, nested: %llu, through the heap: %llu, max depth: %d\n",
+           (unsigned long long)s->stats.raised, (unsigned long long)s->stats.dispatched,
+           (unsigned long long)s->stats.nested, (unsigned long long)s->stats.fallback, s->stats.max_depth);
+    for(int l = INTR_LEVELS - 1; l >= 0; l--)
+        if(s->stats.per_level[l])
+            printf("  level %d: %llu\n", l, (unsigned long long)s->stats.per_level[l]);
+}
+
+//requests still queued are the caller's
+void destroy_intr_scheduler(INTR_SCHEDULER *s)
+{
+    for(int l = 0; l < INTR_LEVELS; l++)
+        free(s->fifos[l].ary);
+    destroy_intr_fallback(s->fallback);
+    free(s);
+}
+#endif /* intr_scheduler_h */
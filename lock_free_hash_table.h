@@ -0,0 +1,465 @@
+/* LOCK-FREE SPLIT-ORDERED HASH TABLE */
+
+#ifndef lock_free_hash_table_h
+#define lock_free_hash_table_h
+#include <stdatomic.h>
+#include "wrappers.h"
+#include "hash_table.h"
+
+/*
+ SPLIT-ORDERED LIST (Shalev & Shavit): every entry lives in ONE lock-free sorted linked list,
+ ordered by the bit-reversed hash. bucket b is just a shortcut into that list: a dummy node
+ with key reverse(b). doubling the table never moves an entry, new buckets are spliced in
+ lazily between their parent's entries (parent of b = b with its highest bit cleared).
+
+ list ops are Harris-Michael: delete marks the low bit of the node's next pointer (logical
+ delete), then unlinks it with a CAS. whoever unlinks the node retires it.
+ lookups never write: they start from the closest initialized bucket and skip marked nodes,
+ so they finish in a bounded number of steps (wait-free).
+
+ memory reclamation is epoch based: a retired node is freed only once every thread inside
+ an operation has moved two epochs past the one it was retired in.
+ a thread claims a slot in the table on first use; call lf_thread_done() before it exits.
+
+ entries sort on (reverse(h) | 1, key): the key breaks the tie of hashes differing only in
+ their top bit, so the 64-bit split-order key identifies the entry. keys are unique, so the
+ target argument of search/retrieve/delete is not compared (it is there to match HASH_TABLE).
+ */
+#define LF_SEGMENT_SIZE 1024
+#define LF_MAX_SEGMENTS 1024 //at most 1M buckets
+#define LF_MAX_LOAD 2 //entries per bucket before the bucket count doubles
+#define LF_MAX_THREADS 64
+#define LF_RETIRE_THRESHOLD 64 //retired nodes before a thread tries to advance the epoch
+
+typedef struct lf_node
+{
+    uint64_t so_key;//high word: bit-reversed hash, low bit set for entries. low word: the key
+    int key;
+    void *satellite;
+    _Atomic(uintptr_t) next;//low bit set == node logically deleted
+    struct lf_node *retired_next;//limbo list: next stays intact for readers still on the node
+}LF_NODE;
+
+typedef struct lf_thread
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_int in_use;
+    _Atomic(void*) owner;//address of the owning thread's lf_token
+    atomic_int active;//inside an operation
+    atomic_ulong epoch;//global epoch seen on entry
+    LF_NODE *limbo[3];//retired nodes, by epoch % 3
+    int limbo_count;
+}LF_THREAD;
+
+typedef struct lf_hash_table
+{
+    _Atomic(_Atomic(LF_NODE*)*) segments[LF_MAX_SEGMENTS];
+    atomic_int size;//bucket count, power of 2
+    atomic_int count;
+    atomic_ulong epoch;
+    LF_THREAD threads[LF_MAX_THREADS];
+}LF_HASH_TABLE;
+
+LF_HASH_TABLE *create_lf_hash_table(int m);
+bool lf_insert_ht(LF_HASH_TABLE *ht, void *data_in, int key);
+bool lf_search_ht(LF_HASH_TABLE *ht, void *target, int key);
+bool lf_delete_ht(LF_HASH_TABLE *ht, void *target, int key);
+void *lf_retrieve_ht(LF_HASH_TABLE *ht, void *target, int key);
+void lf_thread_done(LF_HASH_TABLE *ht);
+void destroy_lf_hash_table(LF_HASH_TABLE *ht);
+//INTERNALS
+uint32_t lf_reverse(uint32_t x);
+LF_THREAD *_lf_enter(LF_HASH_TABLE *ht);
+void _lf_exit(LF_HASH_TABLE *ht, LF_THREAD *t);
+void _lf_retire(LF_THREAD *t, LF_NODE *node);
+bool _lf_list_find(LF_THREAD *t, _Atomic(uintptr_t) *head, uint64_t so_key,
+                   _Atomic(uintptr_t) **prev_out, LF_NODE **cur_out);
+LF_NODE *_lf_list_insert(LF_THREAD *t, LF_NODE *bucket, LF_NODE *pnew);
+_Atomic(LF_NODE*) *_lf_bucket_slot(LF_HASH_TABLE *ht, int b, bool create);
+LF_NODE *_lf_get_bucket(LF_HASH_TABLE *ht, LF_THREAD *t, int b);
+LF_NODE *_lf_nearest_bucket(LF_HASH_TABLE *ht, int b);
+
+static _Thread_local LF_HASH_TABLE *lf_self_ht = NULL;
+static _Thread_local LF_THREAD *lf_self = NULL;
+static _Thread_local char lf_token;
+
+uint32_t lf_reverse(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+LF_HASH_TABLE *create_lf_hash_table(int m)
+{
+    LF_HASH_TABLE *ht;
+    LF_NODE *head;
+    int size;
+
+    ht = (LF_HASH_TABLE*)Malloc_aligned(CACHE_LINE_SIZE, sizeof(LF_HASH_TABLE));
+    memset(ht, 0, sizeof(LF_HASH_TABLE));
+    for(size = 2; size < m && size < LF_SEGMENT_SIZE*LF_MAX_SEGMENTS; size *= 2)
+        ;
+    atomic_init(&ht->size, size);
+    atomic_init(&ht->count, 0);
+    atomic_init(&ht->epoch, 0);
+    //bucket 0 is the head of the whole list and always exists
+    head = (LF_NODE*)Malloc(sizeof(LF_NODE));
+    head->so_key = 0;
+    head->key = 0;
+    head->satellite = NULL;
+    atomic_init(&head->next, 0);
+    atomic_store(_lf_bucket_slot(ht, 0, true), head);
+    return ht;
+}
+
+/******** EPOCHS ********/
+LF_THREAD *_lf_enter(LF_HASH_TABLE *ht)
+{
+    LF_THREAD *t;
+    LF_NODE *pre, *cur;
+    unsigned long e;
+    int expected;
+
+    /*
+     the cached slot only counts if this thread still holds it: a table freed without this
+     thread's lf_thread_done() can come back from malloc at the same address, zeroed, and
+     another thread may have claimed the slot there since.
+     */
+    if(lf_self_ht != ht || !atomic_load(&lf_self->in_use) || atomic_load(&lf_self->owner) != (void*)&lf_token)
+    {   //slot this thread already holds in ht (it switched tables), else claim a free one
+        lf_self = NULL;
+        for(int i = 0; i < LF_MAX_THREADS && !lf_self; i++)
+        {
+            if(atomic_load(&ht->threads[i].in_use) && atomic_load(&ht->threads[i].owner) == (void*)&lf_token)
+                lf_self = &ht->threads[i];
+        }
+        for(int i = 0; i < LF_MAX_THREADS && !lf_self; i++)
+        {
+            expected = 0;
+            if(atomic_compare_exchange_strong(&ht->threads[i].in_use, &expected, 1))
+            {
+                lf_self = &ht->threads[i];
+                atomic_store(&lf_self->owner, (void*)&lf_token);
+            }
+        }
+        if(!lf_self)
+        {
+            printf("ERROR: MORE THAN %d THREADS ON LOCK-FREE TABLE!!\n", LF_MAX_THREADS);
+            exit(101);
+        }
+        lf_self_ht = ht;
+    }
+    t = lf_self;
+    atomic_store(&t->active, 1);
+    e = atomic_load(&ht->epoch);
+    if(atomic_load(&t->epoch) != e)
+    {   //limbo[e % 3] holds nodes retired three or more epochs ago: nobody can still see them
+        cur = t->limbo[e % 3];
+        while(cur)
+        {
+            pre = cur;
+            cur = cur->retired_next;
+            free(pre);
+            t->limbo_count--;
+        }
+        t->limbo[e % 3] = NULL;
+        atomic_store(&t->epoch, e);
+    }
+    return t;
+}
+
+void _lf_exit(LF_HASH_TABLE *ht, LF_THREAD *t)
+{
+    unsigned long e;
+    bool all_caught_up;
+
+    if(t->limbo_count > LF_RETIRE_THRESHOLD)
+    {   //advance when every thread inside an operation has seen the current epoch
+        e = atomic_load(&ht->epoch);
+        all_caught_up = true;
+        for(int i = 0; i < LF_MAX_THREADS && all_caught_up; i++)
+        {
+            if(atomic_load(&ht->threads[i].active) && atomic_load(&ht->threads[i].epoch) != e)
+                all_caught_up = false;
+        }
+        if(all_caught_up)
+            atomic_compare_exchange_strong(&ht->epoch, &e, e + 1);
+    }
+    atomic_store(&t->active, 0);
+}
+
+//the node is already unlinked but readers may still be walking through it.
+void _lf_retire(LF_THREAD *t, LF_NODE *node)
+{
+    int idx = (int)(atomic_load(&t->epoch) % 3);
+
+    node->retired_next = t->limbo[idx];
+    t->limbo[idx] = node;
+    t->limbo_count++;
+}
+
+void lf_thread_done(LF_HASH_TABLE *ht)
+{
+    //limbo stays with the slot: the next thread to claim it (or destroy) frees it
+    if(lf_self_ht == ht)
+    {   //a stale slot (see _lf_enter()) is someone else's now: only forget it
+        if(atomic_load(&lf_self->owner) == (void*)&lf_token)
+        {
+            atomic_store(&lf_self->owner, NULL);
+            atomic_store(&lf_self->in_use, 0);
+        }
+        lf_self_ht = NULL;
+        lf_self = NULL;
+    }
+}
+
+/******** SORTED LOCK-FREE LIST ********/
+//stop at the first node at or past so_key, unlinking marked nodes on the way
+bool _lf_list_find(LF_THREAD *t, _Atomic(uintptr_t) *head, uint64_t so_key,
+                   _Atomic(uintptr_t) **prev_out, LF_NODE **cur_out)
+{
+    _Atomic(uintptr_t) *prev;
+    LF_NODE *cur;
+    uintptr_t next, expected;
+
+retry:
+    prev = head;
+    cur = (LF_NODE*)(atomic_load(prev) & ~(uintptr_t)1);
+    while(cur)
+    {
+        next = atomic_load(&cur->next);
+        if(next & 1)//cur is deleted: help unlink it
+        {
+            expected = (uintptr_t)cur;
+            if(!atomic_compare_exchange_strong(prev, &expected, next & ~(uintptr_t)1))
+                goto retry;
+            _lf_retire(t, cur);
+            cur = (LF_NODE*)(next & ~(uintptr_t)1);
+            continue;
+        }
+        if(cur->so_key >= so_key)
+            break;
+        prev = &cur->next;
+        cur = (LF_NODE*)next;
+    }
+    *prev_out = prev;
+    *cur_out = cur;
+    return cur && cur->so_key == so_key;
+}
+
+//returns pnew, or the node already holding its so_key (pnew is then left to the caller)
+LF_NODE *_lf_list_insert(LF_THREAD *t, LF_NODE *bucket, LF_NODE *pnew)
+{
+    _Atomic(uintptr_t) *prev;
+    LF_NODE *cur;
+    uintptr_t expected;
+
+    while(true)
+    {
+        if(_lf_list_find(t, &bucket->next, pnew->so_key, &prev, &cur))
+            return cur;
+        atomic_store_explicit(&pnew->next, (uintptr_t)cur, memory_order_relaxed);
+        expected = (uintptr_t)cur;
+        if(atomic_compare_exchange_strong(prev, &expected, (uintptr_t)pnew))
+            return pnew;
+    }
+}
+
+/******** BUCKETS ********/
+_Atomic(LF_NODE*) *_lf_bucket_slot(LF_HASH_TABLE *ht, int b, bool create)
+{
+    _Atomic(LF_NODE*) *seg, *expected;
+
+    seg = atomic_load(&ht->segments[b/LF_SEGMENT_SIZE]);
+    if(!seg)
+    {
+        if(!create)
+            return NULL;
+        seg = (_Atomic(LF_NODE*)*)Calloc(LF_SEGMENT_SIZE, sizeof(_Atomic(LF_NODE*)));
+        expected = NULL;
+        if(!atomic_compare_exchange_strong(&ht->segments[b/LF_SEGMENT_SIZE], &expected, seg))
+        {
+            free(seg);//another thread installed it first
+            seg = expected;
+        }
+    }
+    return &seg[b % LF_SEGMENT_SIZE];
+}
+
+//dummy node of bucket b, splicing it (and its missing ancestors) into the list if needed
+LF_NODE *_lf_get_bucket(LF_HASH_TABLE *ht, LF_THREAD *t, int b)
+{
+    _Atomic(LF_NODE*) *slot;
+    LF_NODE *dummy, *parent, *expected;
+
+    slot = _lf_bucket_slot(ht, b, true);
+    dummy = atomic_load(slot);
+    if(dummy)
+        return dummy;
+    parent = _lf_get_bucket(ht, t, b & ~(1u << (31 - __builtin_clz(b))));
+    dummy = (LF_NODE*)Malloc(sizeof(LF_NODE));
+    dummy->so_key = (uint64_t)lf_reverse(b) << 32;
+    dummy->key = b;
+    dummy->satellite = NULL;
+    expected = _lf_list_insert(t, parent, dummy);
+    if(expected != dummy)
+        free(dummy);//another thread spliced this bucket in
+    dummy = expected;
+    expected = NULL;
+    atomic_compare_exchange_strong(slot, &expected, dummy);
+    return dummy;
+}
+
+//read-only: closest initialized ancestor of bucket b (bucket 0 always is)
+LF_NODE *_lf_nearest_bucket(LF_HASH_TABLE *ht, int b)
+{
+    _Atomic(LF_NODE*) *slot;
+    LF_NODE *dummy;
+
+    while(true)
+    {
+        slot = _lf_bucket_slot(ht, b, false);
+        if(slot && (dummy = atomic_load(slot)))
+            return dummy;
+        b &= ~(1u << (31 - __builtin_clz(b)));
+    }
+}
+
+/******** DICTIONARY OPS ********/
+bool lf_insert_ht(LF_HASH_TABLE *ht, void *data_in, int key)
+{
+    LF_THREAD *t;
+    LF_NODE *pnew, *bucket;
+    uint32_t h;
+    int size, count;
+    bool inserted;
+
+    t = _lf_enter(ht);
+    h = bucket_hash(key);
+    size = atomic_load(&ht->size);
+    bucket = _lf_get_bucket(ht, t, h & (size - 1));
+    pnew = (LF_NODE*)Malloc(sizeof(LF_NODE));
+    pnew->so_key = ((uint64_t)(lf_reverse(h) | 1) << 32) | (uint32_t)key;
+    pnew->key = key;
+    pnew->satellite = data_in;
+    inserted = _lf_list_insert(t, bucket, pnew) == pnew;
+    if(inserted)
+    {
+        count = atomic_fetch_add(&ht->count, 1) + 1;
+        if(count > LF_MAX_LOAD*size && 2*size <= LF_SEGMENT_SIZE*LF_MAX_SEGMENTS)
+            atomic_compare_exchange_strong(&ht->size, &size, 2*size);//no entry moves
+    }
+    else
+        free(pnew);//never published, no duplicates
+    _lf_exit(ht, t);
+    return inserted;
+}
+
+//wait-free: no CAS, no helping, no bucket initialization. the key alone identifies the entry
+void *lf_retrieve_ht(LF_HASH_TABLE *ht, void *target, int key)
+{
+    LF_THREAD *t;
+    LF_NODE *cur;
+    uintptr_t next;
+    uint32_t h;
+    uint64_t so_key;
+    void *data_out = NULL;
+
+    (void)target;
+    t = _lf_enter(ht);
+    h = bucket_hash(key);
+    so_key = ((uint64_t)(lf_reverse(h) | 1) << 32) | (uint32_t)key;
+    cur = _lf_nearest_bucket(ht, h & (atomic_load(&ht->size) - 1));
+    while(cur && cur->so_key < so_key)
+        cur = (LF_NODE*)(atomic_load(&cur->next) & ~(uintptr_t)1);
+    if(cur && cur->so_key == so_key)
+    {
+        next = atomic_load(&cur->next);
+        if(!(next & 1))
+            data_out = cur->satellite;
+    }
+    _lf_exit(ht, t);
+    return data_out;
+}
+
+bool lf_search_ht(LF_HASH_TABLE *ht, void *target, int key)
+{
+    return lf_retrieve_ht(ht, target, key) != NULL;
+}
+
+//by key only, like retrieve
+bool lf_delete_ht(LF_HASH_TABLE *ht, void *target, int key)
+{
+    LF_THREAD *t;
+    LF_NODE *bucket, *cur;
+    _Atomic(uintptr_t) *prev;
+    uintptr_t next, expected;
+    uint32_t h;
+    uint64_t so_key;
+    bool removed = false;
+
+    (void)target;
+    t = _lf_enter(ht);
+    h = bucket_hash(key);
+    so_key = ((uint64_t)(lf_reverse(h) | 1) << 32) | (uint32_t)key;
+    bucket = _lf_get_bucket(ht, t, h & (atomic_load(&ht->size) - 1));
+    while(_lf_list_find(t, &bucket->next, so_key, &prev, &cur))
+    {
+        next = atomic_load(&cur->next);
+        if(next & 1)
+            continue;//being deleted by someone else: find() will help and re-check
+        //1) logical delete: only one thread can set the mark
+        if(!atomic_compare_exchange_strong(&cur->next, &next, next | 1))
+            continue;
+        removed = true;
+        atomic_fetch_sub(&ht->count, 1);
+        //2) physical delete, or leave it to the next find() over this node
+        expected = (uintptr_t)cur;
+        if(atomic_compare_exchange_strong(prev, &expected, next))
+            _lf_retire(t, cur);
+        else
+            _lf_list_find(t, &bucket->next, so_key, &prev, &cur);
+        break;
+    }
+    _lf_exit(ht, t);
+    return removed;
+}
+
+//no other thread may touch the table at this point.
+void destroy_lf_hash_table(LF_HASH_TABLE *ht)
+{
+    LF_NODE *pre, *cur;
+
+    for(int i = 0; i < LF_MAX_THREADS; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            cur = ht->threads[i].limbo[j];
+            while(cur)
+            {
+                pre = cur;
+                cur = cur->retired_next;
+                free(pre);
+            }
+        }
+    }
+    //every linked node, dummies included, hangs off bucket 0
+    cur = atomic_load(_lf_bucket_slot(ht, 0, false));
+    while(cur)
+    {
+        pre = cur;
+        cur = (LF_NODE*)(atomic_load(&cur->next) & ~(uintptr_t)1);
+        free(pre);
+    }
+    for(int i = 0; i < LF_MAX_SEGMENTS; i++)
+        free(atomic_load(&ht->segments[i]));
+    if(lf_self_ht == ht)
+    {
+        lf_self_ht = NULL;
+        lf_self = NULL;
+    }
+    free(ht);
+}
+#endif /* lock_free_hash_table_h */
@@ -8,7 +8,23 @@
 #include "stack.h"
 #include "graph.h"
 #include "heap.h"
+#include "dary_heap.h"
+#include "typed_heap.h"
+#include "multiqueue.h"
+#include "intr_scheduler.h"
+#include "timer_wheel.h"
+#include "topk.h"
+#include "ext_heap.h"
 #include "hash_table.h"
+#include "concurrent_hash_table.h"
+#include "lock_free_hash_table.h"
+#include "perfect_hash.h"
+#include "mmap_hash_table.h"
+#include "cache.h"
+#include "fib.h"
+#include "poptrie.h"
+#include "fib_rcu.h"
+#include "fib6.h"
 #include "bst.h"
 #include "sorting.h"
 
@@ -113,6 +129,46 @@ typedef struct employee
     //etc.
 }EMPLOYEE;
 
+//16-byte event record for the typed heap samples
+typedef struct event16
+{
+    int priority;
+    int id;
+    void *payload;
+}EVENT16;
+
+//TYPED HEAPS: one expansion per element type and order (typed_heap.h)
+#define INT_LESS(a, b) (*(a) < *(b))
+#define EVENT16_LESS(a, b) ((a)->priority < (b)->priority)
+TYPED_HEAP(INT_HEAP, int_heap, int, INT_LESS, 4)
+TYPED_HEAP(EVENT16_HEAP, event16_heap, EVENT16, EVENT16_LESS, 4)
+
+//one pending timeout for the timer samples
+typedef struct timeout
+{
+    uint64_t expires;
+    uint64_t fired_at;//0 until it fires
+    bool cancelled;
+    TIMER_NODE *handle;
+    TIMER_WHEEL *wheel;
+}TIMEOUT;
+
+//head of one sorted run in the heap-based k-way merge
+typedef struct run_head
+{
+    void **head;
+    void **end;
+}RUN_HEAD;
+
+//a prioritized record for the external-memory heap
+typedef struct ext_record
+{
+    uint64_t key;
+    uint32_t id;
+    uint32_t flags;
+    char payload[16];
+}EXT_RECORD;
+
 uint32_t PREFIX_BK[10];//GLOBAL
 
 //APPLICATION-SPECIFIC FUNTIONS
@@ -144,6 +200,32 @@ void h1_process(void *data);
 void sample_fixed_heap(char *intr_vector);
 void sample_dynamic_heap(char *intr_vector);
 void sample_ptrbased_heap(char *intr_vector);
+void int_process(void *data);
+void sample_pheap_footprint(int n);
+int h1_compare_min_first(void *arg1, void *arg2);
+void sample_dary_heap(int n, int holds);
+int int_compare(void *arg1, void *arg2);
+int int_compare_min_first(void *arg1, void *arg2);
+int event16_compare(void *arg1, void *arg2);
+int event16_compare_min_first(void *arg1, void *arg2);
+void sample_typed_heap(int n);
+GRAPH *random_weighted_digraph(int vertices, int out_degree, int max_weight, int *ids);
+void sample_pairing_heap(int vertices, int out_degree, int max_weight);
+void sample_radix_heap(int vertices, int out_degree, int max_weight, int events);
+void *mq_hold_workload(void *arg);
+void *mq_drain_workload(void *arg);
+void sample_multiqueue(int n, int ops_per_thread, int max_threads);
+void intr_sample_handler(INTR *intr, void *context);
+void sample_intr_scheduler(char *intr_vector, int n);
+void timeout_expire(void *arg);
+int timeout_compare_min_first(void *arg1, void *arg2);
+void sample_timer_wheel(int n, int max_timeout, int far);
+int run_head_compare(void *arg1, void *arg2);
+int qsort_int_compare(const void *arg1, const void *arg2);
+void sample_topk_and_merge(int n, int k, int runs);
+int ext_record_compare(void *arg1, void *arg2);
+int ext_record_compare_max_first(void *arg1, void *arg2);
+void sample_ext_heap(int n, int budget_mb);
 void sample_array_ht(void);
 ROUTE_24** testing_fwd_table_p24(int intf_count);
 IPv4_ADDR *addr_32_bit(uint8_t ip_addr[4], int prefix);
@@ -154,8 +236,30 @@ int hash_function(void *data);
 VIRTUAL_ADDRESS *create_test_va_array(int size);
 void sample_ht_array_with_collision_resol(char *symbol_table);
 void sample_hashed_table_with_bucket(char *symbol_table, int bucket_size);
+const char *sym_get_key(void *data);
+void sample_perfect_hash_symbol_table(char *symbol_table);
+void sample_keyed_hash_tables(char *symbol_table, int n);
 void sample_hashed_table_with_chaining(char *db_in);
+void sample_persistent_ht(char *db_in, char *ht_file);
+void sample_chained_table_insert_throughput(int n);
+void sample_concurrent_ht_scaling(int n_keys, int ops_per_thread, int max_threads);
+void sample_lf_ht_stress(int threads, int n_keys, int rounds);
+void *lf_hot_workload(void *arg);
+bool lf_ht_linearizable(int threads, int trials);
+const void *u64_self_key(void *data);
+void sample_ht_batch_lookup(int n);
+void sample_ht_stats(int n);
+uint64_t router_hash(void *data);
+void sample_bloom_filter_front_end(int n, char *vertex_file, char *links_file);
+void sample_cache_policies(int capacity, int ops, int threads);
 void sample_ht_with_route_fwd_table(char *in);
+uint32_t random_ipv4(void);
+void sample_fib_lpm(char *route_file, int n_prefixes, int n_lookups);
+void sample_fib_backends(char *route_file, int n_prefixes, int n_lookups);
+void *fib_rcu_reader_workload(void *arg);
+void sample_fib_rcu(char *route_file, int n_prefixes, int n_lookups, int readers, int publishes);
+void random_ipv6(uint8_t addr[16], const uint8_t prefix[16], uint8_t len);
+void sample_fib6_lpm(char *route_file, int n_prefixes, int n_lookups);
 void bstprocess(void *a);
 int bstcompare(void *data_in, void *root);
 void sample_bst(char *in);
@@ -171,6 +275,7 @@ void sample_sorting_algorithms(void);
 #define DATA_INPUT5 "sym_table_entries.in"
 #define DATA_INPUT6 "org_empl_db.in"
 #define DATA_INPUT7 "route_table_test.in"
+#define DATA_INPUT8 "route6_table_test.in"
 
 #define MAX_LINE 80
 #define FLUSH while(getchar() != '\n')
@@ -258,6 +363,26 @@ int main(int argc, const char * argv[])
     */
     //POINTER-BASED HEAP
     //sample_ptrbased_heap(DATA_INPUT4);
+    //PHEAP on its node pool: bytes per element and insert/drain time
+    //sample_pheap_footprint(10000000);
+    //INTERRUPT SCHEDULER: pending bitmap + per-level FIFOs, masking and nesting, vs a heap
+    //sample_intr_scheduler(DATA_INPUT4, 10000000);
+    //TIMER WHEEL: start/stop/expire millions of timeouts vs DHEAP as a timeout queue
+    //sample_timer_wheel(4000000, 1 << 16, 100);
+    //TOP-K of a stream (bounded heap, SIMD threshold filter) and a loser-tree k-way merge
+    //sample_topk_and_merge(20000000, 100, 64);
+    //EXTERNAL-MEMORY PRIORITY QUEUE: n 32-byte records through a budget_mb heap
+    //sample_ext_heap(20000000, 64);
+    //D-ARY HEAP: 4 or 8 children per cache line, vs the binary DHEAP on a 10M-event queue
+    //sample_dary_heap(10000000, 10000000);
+    //TYPED HEAP: elements inline, compare inlined, vs the void* heaps for int keys and 16-byte records
+    //sample_typed_heap(5000000);
+    //PAIRING HEAP: meld, handles, decrease-key; DIJKSTRA on it vs binary and 4-ary heaps
+    //sample_pairing_heap(500000, 8, 1000);
+    //RADIX HEAP: monotone integer keys, DIJKSTRA and an event queue vs the comparison heaps
+    //sample_radix_heap(500000, 8, 1000, 1000000);
+    //MULTIQUEUE: relaxed concurrent priority queue, throughput and rank error from 1 to 64 threads
+    //sample_multiqueue(1000000, 1000000, 64);
 
     //HASH TABLES:  ARRAYS, BUCKETS, & CHAINING
     //1) DIRECT ADDRESSING WITH PAGE TABLE
@@ -268,10 +393,24 @@ int main(int argc, const char * argv[])
     //sample_ht_array_with_collision_resol(DATA_INPUT5);
     //3) HASHED TABLE WITH BUCKET RESOLUTION
     //sample_hashed_table_with_bucket(DATA_INPUT5,3);
+    //sample_perfect_hash_symbol_table(DATA_INPUT5);
+    //sample_keyed_hash_tables(DATA_INPUT5, 1000000);
     //4) HASHED TABLE WITH CHAINING
     //sample_hashed_table_with_chaining(DATA_INPUT6);
+    //sample_persistent_ht(DATA_INPUT6, "org_empl_db.mht");
+    //sample_chained_table_insert_throughput(1000000);
+    //sample_concurrent_ht_scaling(1<<20, 2000000, 8);
+    //sample_lf_ht_stress(8, 100000, 5);
+    //sample_ht_batch_lookup(1<<22);
+    //sample_ht_stats(20000);//build with -DHT_STATS for the probe counters
+    //sample_bloom_filter_front_end(1000000, DATA_INPUT3, TOPOLOGY_LINKS);
+    //sample_cache_policies(10000, 2000000, 4);
     //5) sample route fwd table
     //sample_ht_with_route_fwd_table(DATA_INPUT7);
+    //sample_fib_lpm(DATA_INPUT7, 500000, 20000000);
+    //sample_fib_backends(DATA_INPUT7, 800000, 20000000);
+    //sample_fib_rcu(DATA_INPUT7, 500000, 20000000, 4, 500);
+    //sample_fib6_lpm(DATA_INPUT8, 200000, 20000000);
     //BINARY TREES
     //sample_bst(LINKED_LIST_INPUT);
     //SORTING
@@ -989,7 +1128,7 @@ void sample_ptrbased_heap(char *intr_vector)
 
     max_size = get_line_count(intr_vector);
     my_pheap =  create_pointer_based_heap(max_size, h1_compare, h1_process, h1_swap);
-    ivt = (INTR**)Malloc(sizeof(INTR*));
+    ivt = (INTR**)Malloc(max_size*sizeof(INTR*));
     create_interrupt_vector_array(intr_vector, ivt);
     for(int i = 0;  i < max_size; i++)
         pointer_based_heap_insert(my_pheap, ivt[i]);
@@ -1002,6 +1141,1099 @@ void sample_ptrbased_heap(char *intr_vector)
     destroy_pointer_based_heap(my_pheap);
 }
 
+void int_process(void *data)
+{
+    (void)data;
+}
+
+//the old PHEAP paid a 48-byte HNODE plus the allocator's header per element, and a LEVEL per slot
+void sample_pheap_footprint(int n)
+{
+    PHEAP *pheap;
+    int *keys, last, errors = 0;
+    size_t bytes;
+    clock_t start;
+    
+    keys = (int*)Malloc(n*sizeof(int));
+    for(int i = 0; i < n; i++)
+        keys[i] = rand();
+    start = clock();
+    pheap = create_pointer_based_heap(16, int_compare, int_process, NULL);
+    for(int i = 0; i < n; i++)
+        pointer_based_heap_insert(pheap, &keys[i]);
+    printf("PHEAP, %d ints: insert %.0f ms, ", n, 1000.0*(clock() - start)/CLOCKS_PER_SEC);
+    bytes = pheap->block_count*(PHEAP_BLOCK_NODES*sizeof(HNODE) + sizeof(HNODE*));
+    start = clock();
+    last = INT_MAX;
+    while(pheap->count)
+    {
+        int key = *(int*)_pheap_node(pheap, 1)->data;
+        errors += key > last;
+        last = key;
+        pointer_based_heap_delete(pheap);
+    }
+    printf("drain %.0f ms, %d out of order\n", 1000.0*(clock() - start)/CLOCKS_PER_SEC, errors);
+    printf("  %.1f bytes per element, was %zu + the allocator's header\n", (double)bytes/n, sizeof(void*)*6);
+    destroy_pointer_based_heap(pheap);
+    free(keys);
+}
+
+//reversed h1_compare: DHEAP is a max heap, this makes it pop the smallest priority first
+int h1_compare_min_first(void *arg1, void *arg2)
+{
+    return h1_compare(arg2, arg1);
+}
+
+/*
+ event-queue workload on INTR records (priority = due time):
+ insert n, pop n (checking the order), then refill and run holds: pop the earliest event and
+ push it back a random interval later, the steady state of a timer queue.
+ DHEAP is the binary baseline (recursive swaps, same algorithm as HEAP_ADT); d = 2 isolates the
+ gain from the hole-based reheap, d = 4 and 8 add the shallower, line-aligned tree.
+ */
+void sample_dary_heap(int n, int holds)
+{
+    INTR *events, *e;
+    DHEAP *dheap;
+    DARY_HEAP *heap;
+    void *out;
+    int d[] = {2, 4, 8}, last, errors;
+    double t_insert, t_pop, t_hold;
+    clock_t start;
+    
+    events = (INTR*)Malloc((size_t)n*sizeof(INTR));
+    for(int pass = 0; pass < 4; pass++)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            events[i].priority = rand() % (1 << 30);
+            events[i].description = NULL;
+        }
+        errors = 0;
+        if(pass == 0)
+        {
+            dheap = build_dynamic_array_heap_adt(n, n, MAX, DYNAMIC_ARRAY, h1_compare_min_first, h1_process);
+            start = clock();
+            for(int i = 0; i < n; i++)
+                dheap_insert(dheap, &events[i]);
+            t_insert = (double)(clock() - start)/CLOCKS_PER_SEC;
+            last = -1;
+            start = clock();
+            while(dheap_get_root(dheap, &out))
+            {
+                e = (INTR*)out;
+                errors += e->priority < last;
+                last = e->priority;
+            }
+            t_pop = (double)(clock() - start)/CLOCKS_PER_SEC;
+            for(int i = 0; i < n; i++)
+                dheap_insert(dheap, &events[i]);
+            start = clock();
+            for(int i = 0; i < holds; i++)
+            {
+                if(!dheap_get_root(dheap, &out))
+                    break;
+                e = (INTR*)out;
+                e->priority += 1 + rand() % (1 << 20);
+                dheap_insert(dheap, e);
+            }
+            t_hold = (double)(clock() - start)/CLOCKS_PER_SEC;
+            destroy_dynamic_heap_array(dheap);
+            printf("binary DHEAP: ");
+        }
+        else
+        {
+            heap = create_dary_heap(d[pass - 1], 1024, h1_compare);
+            start = clock();
+            for(int i = 0; i < n; i++)
+                dary_heap_insert(heap, &events[i]);
+            t_insert = (double)(clock() - start)/CLOCKS_PER_SEC;
+            last = -1;
+            start = clock();
+            while((e = (INTR*)dary_heap_get_min(heap)))
+            {
+                errors += e->priority < last;
+                last = e->priority;
+            }
+            t_pop = (double)(clock() - start)/CLOCKS_PER_SEC;
+            for(int i = 0; i < n; i++)
+                dary_heap_insert(heap, &events[i]);
+            start = clock();
+            for(int i = 0; i < holds; i++)
+            {
+                if(!(e = (INTR*)dary_heap_get_min(heap)))
+                    break;
+                e->priority += 1 + rand() % (1 << 20);
+                dary_heap_insert(heap, e);
+            }
+            t_hold = (double)(clock() - start)/CLOCKS_PER_SEC;
+            destroy_dary_heap(heap);
+            printf("%d-ary heap:   ", d[pass - 1]);
+        }
+        printf("insert %.0f ns, get min %.0f ns, hold %.0f ns per op, %d out of order\n",
+               t_insert/n*1e9, t_pop/n*1e9, t_hold/holds*1e9, errors);
+    }
+    free(events);
+}
+
+int int_compare(void *arg1, void *arg2)
+{
+    int a = *(int*)arg1, b = *(int*)arg2;
+    
+    return a < b ? -1 : a > b;
+}
+
+int int_compare_min_first(void *arg1, void *arg2)
+{
+    return int_compare(arg2, arg1);
+}
+
+int event16_compare(void *arg1, void *arg2)
+{
+    return int_compare(&((EVENT16*)arg1)->priority, &((EVENT16*)arg2)->priority);
+}
+
+int event16_compare_min_first(void *arg1, void *arg2)
+{
+    return event16_compare(arg2, arg1);
+}
+
+/*
+ n int keys, then n EVENT16 records, drained in priority order by each heap:
+   HEAP_ADT: pointers, build_min_heap + get_min (its insert is fixed-slot, so it is built).
+   DHEAP: pointers, binary, dheap_insert + dheap_get_root (max heap: reversed compare).
+   DARY_HEAP: pointers, 4-ary, insert + get_min.
+   TYPED_HEAP: the values themselves, 4-ary, insert + get_min, and build + get_min.
+ the pointer heaps point into one array in input order, so their compares also miss on it.
+ */
+void sample_typed_heap(int n)
+{
+    int *keys, key, last, errors;
+    EVENT16 *records, record;
+    void **ptrs, *out;
+    HEAP_ADT adt;
+    DHEAP *dheap;
+    DARY_HEAP *dary;
+    INT_HEAP *int_heap;
+    EVENT16_HEAP *event16_heap;
+    const char *names[] = {"HEAP_ADT build+pop", "DHEAP insert+pop", "DARY_HEAP insert+pop",
+                           "TYPED_HEAP insert+pop", "TYPED_HEAP build+pop"};
+    clock_t start;
+    
+    keys = (int*)Malloc((size_t)n*sizeof(int));
+    records = (EVENT16*)Malloc((size_t)n*sizeof(EVENT16));
+    ptrs = (void**)Malloc((size_t)n*sizeof(void*));
+    for(int i = 0; i < n; i++)
+    {
+        keys[i] = rand();
+        records[i].priority = keys[i];
+        records[i].id = i;
+        records[i].payload = &keys[i];
+    }
+    for(int records_pass = 0; records_pass < 2; records_pass++)
+    {
+        printf("%s:\n", records_pass ? "16-byte records" : "int keys");
+        for(int i = 0; i < n; i++)
+            ptrs[i] = records_pass ? (void*)&records[i] : (void*)&keys[i];
+        for(int h = 0; h < 5; h++)
+        {
+            last = INT_MIN;
+            errors = 0;
+            start = clock();
+            switch(h)
+            {
+                case 0:
+                    adt.compare = records_pass ? event16_compare : int_compare;
+                    adt.ary = (void**)Malloc((size_t)n*sizeof(void*));
+                    memcpy(adt.ary, ptrs, (size_t)n*sizeof(void*));
+                    adt.size = adt.count = n;
+                    build_min_heap(&adt);
+                    while(adt.size > 0)
+                    {
+                        key = *(int*)get_min(&adt);
+                        errors += key < last;
+                        last = key;
+                    }
+                    free(adt.ary);
+                    break;
+                case 1:
+                    dheap = build_dynamic_array_heap_adt(n, n, MAX, DYNAMIC_ARRAY,
+                                                         records_pass ? event16_compare_min_first : int_compare_min_first, h1_process);
+                    for(int i = 0; i < n; i++)
+                        dheap_insert(dheap, ptrs[i]);
+                    while(dheap_get_root(dheap, &out))
+                    {
+                        key = *(int*)out;
+                        errors += key < last;
+                        last = key;
+                    }
+                    destroy_dynamic_heap_array(dheap);
+                    break;
+                case 2:
+                    dary = create_dary_heap(4, 1024, records_pass ? event16_compare : int_compare);
+                    for(int i = 0; i < n; i++)
+                        dary_heap_insert(dary, ptrs[i]);
+                    while((out = dary_heap_get_min(dary)))
+                    {
+                        key = *(int*)out;
+                        errors += key < last;
+                        last = key;
+                    }
+                    destroy_dary_heap(dary);
+                    break;
+                default:
+                    if(records_pass)
+                    {
+                        event16_heap = create_event16_heap(1024);
+                        if(h == 3)
+                            for(int i = 0; i < n; i++)
+                                event16_heap_insert(event16_heap, records[i]);
+                        else
+                            event16_heap_build(event16_heap, records, n);
+                        while(event16_heap_get_min(event16_heap, &record))
+                        {
+                            errors += record.priority < last;
+                            last = record.priority;
+                        }
+                        destroy_event16_heap(event16_heap);
+                    }
+                    else
+                    {
+                        int_heap = create_int_heap(1024);
+                        if(h == 3)
+                            for(int i = 0; i < n; i++)
+                                int_heap_insert(int_heap, keys[i]);
+                        else
+                            int_heap_build(int_heap, keys, n);
+                        while(int_heap_get_min(int_heap, &key))
+                        {
+                            errors += key < last;
+                            last = key;
+                        }
+                        destroy_int_heap(int_heap);
+                    }
+                    break;
+            }
+            printf("  %-22s %.0f ns per element, %d out of order\n", names[h],
+                   (double)(clock() - start)/CLOCKS_PER_SEC/n*1e9, errors);
+        }
+    }
+    free(ptrs);
+    free(records);
+    free(keys);
+}
+
+/*
+ adjacency-list digraph with out_degree random arcs per vertex, weights 1..max_weight, plus the
+ arc i -> i+1 so every vertex is reachable from the source. ids[] holds the vertex data.
+ vertices go in by decreasing id, so insert_to_graph() always inserts in front; arcs are linked
+ in directly because add_arc_edge_to_graph() walks the vertex list, O(V) per arc.
+ */
+GRAPH *random_weighted_digraph(int vertices, int out_degree, int max_weight, int *ids)
+{
+    GRAPH *g;
+    VERTEX **index, *v;
+    ARC *a;
+    int i, dst;
+    
+    g = create_graph(ADJACENCY_LIST, DIRECTED, IS_WEIGHTED, vertices, int_compare, NULL);
+    for(i = vertices - 1; i >= 0; i--)
+    {
+        ids[i] = i;
+        insert_to_graph(g, &ids[i]);
+    }
+    index = (VERTEX**)Malloc((size_t)vertices*sizeof(VERTEX*));
+    for(v = g->source, i = 0; v; v = v->next, i++)
+        index[i] = v;
+    for(i = 0; i < vertices; i++)
+    {
+        for(int j = 0; j <= out_degree; j++)
+        {
+            dst = j == 0 ? (i + 1) % vertices : rand() % vertices;
+            a = (ARC*)Malloc(sizeof(ARC));
+            a->dest = index[dst];
+            a->weight = j == 0 ? max_weight : 1 + rand() % max_weight;
+            a->in_mst = false;
+            a->next = index[i]->adj_list;
+            index[i]->adj_list = a;
+            index[i]->out_degree++;
+            index[dst]->in_degree++;
+            g->arc_count++;
+        }
+    }
+    free(index);
+    return g;
+}
+
+int pairing_ids[] = {50, 20, 70, 10, 40, 60, 30};
+
+void sample_pairing_heap(int vertices, int out_degree, int max_weight)
+{
+    PAIRING_POOL *pool;
+    PAIRING_HEAP *h1, *h2;
+    PAIRING_NODE *handles[7];
+    GRAPH *g;
+    VERTEX *v;
+    int *ids, *dist, *p, mismatches;
+    const char *names[] = {"binary heap (lazy)", "4-ary heap (lazy)", "pairing heap (decrease-key)"};
+    clock_t start;
+    
+    //two heaps on one pool: meld, delete by handle, decrease-key
+    pool = create_pairing_pool();
+    h1 = create_pairing_heap(int_compare, pool);
+    h2 = create_pairing_heap(int_compare, pool);
+    for(int i = 0; i < 7; i++)
+        handles[i] = pairing_heap_insert(i % 2 ? h2 : h1, &pairing_ids[i]);
+    pairing_heap_meld(h1, h2);
+    pairing_heap_delete(h1, handles[4]);//40
+    pairing_ids[2] = 5;//70 -> 5
+    pairing_heap_decrease_key(h1, handles[2]);
+    printf("melded %d elements, drained:", h1->count);
+    while((p = (int*)pairing_heap_get_min(h1)))
+        printf(" %d", *p);
+    printf("\n");
+    destroy_pairing_heap(h2);
+    destroy_pairing_heap(h1);
+    destroy_pairing_pool(pool);
+    
+    ids = (int*)Malloc((size_t)vertices*sizeof(int));
+    dist = (int*)Malloc((size_t)vertices*sizeof(int));
+    g = random_weighted_digraph(vertices, out_degree, max_weight, ids);
+    printf("DIJKSTRA: %d vertices, %d arcs\n", g->count, g->arc_count);
+    for(int h = 0; h < 3; h++)
+    {
+        start = clock();
+        if(h < 2)
+            dijkstra_dary(g, h ? 4 : 2);
+        else
+            dijkstra_pairing(g);
+        printf("  %-28s %.0f ms", names[h], (double)(clock() - start)/CLOCKS_PER_SEC*1e3);
+        mismatches = 0;
+        for(v = g->source; v; v = v->next)
+        {
+            if(h == 0)
+                dist[*(int*)v->data] = v->d;
+            else
+                mismatches += dist[*(int*)v->data] != v->d;
+        }
+        printf(h ? ", %d distances differ\n" : "\n", mismatches);
+    }
+    delete_graph(g);
+    free(g);
+    free(dist);
+    free(ids);
+}
+
+/*
+ DIJKSTRA on one random digraph with every queue, then a monotone event queue: events items
+ queued, and as many holds that pop the earliest and push it back up to 1000 ticks later.
+ */
+void sample_radix_heap(int vertices, int out_degree, int max_weight, int events)
+{
+    GRAPH *g;
+    VERTEX *v;
+    RADIX_HEAP *radix;
+    EVENT16_HEAP *typed;
+    DARY_HEAP *dary;
+    EVENT16 *records, record, *e;
+    uint32_t key;
+    void *data;
+    int *ids, *dist, mismatches, last, errors;
+    const char *names[] = {"binary heap (lazy)", "4-ary heap (lazy)", "pairing heap (decrease-key)", "radix heap (lazy)"};
+    clock_t start;
+    
+    ids = (int*)Malloc((size_t)vertices*sizeof(int));
+    dist = (int*)Malloc((size_t)vertices*sizeof(int));
+    g = random_weighted_digraph(vertices, out_degree, max_weight, ids);
+    printf("DIJKSTRA: %d vertices, %d arcs, weights 1..%d\n", g->count, g->arc_count, max_weight);
+    for(int h = 0; h < 4; h++)
+    {
+        start = clock();
+        if(h < 2)
+            dijkstra_dary(g, h ? 4 : 2);
+        else if(h == 2)
+            dijkstra_pairing(g);
+        else
+            dijkstra_radix(g);
+        printf("  %-28s %.0f ms", names[h], (double)(clock() - start)/CLOCKS_PER_SEC*1e3);
+        mismatches = 0;
+        for(v = g->source; v; v = v->next)
+        {
+            if(h == 0)
+                dist[*(int*)v->data] = v->d;
+            else
+                mismatches += dist[*(int*)v->data] != v->d;
+        }
+        printf(h ? ", %d distances differ\n" : "\n", mismatches);
+    }
+    delete_graph(g);
+    free(g);
+    free(dist);
+    free(ids);
+    
+    records = (EVENT16*)Malloc((size_t)events*sizeof(EVENT16));
+    printf("EVENT QUEUE: %d events, %d holds\n", events, events);
+    for(int h = 0; h < 3; h++)
+    {
+        for(int i = 0; i < events; i++)
+        {
+            records[i].priority = rand() % 1000;
+            records[i].id = i;
+            records[i].payload = NULL;
+        }
+        last = errors = 0;
+        start = clock();
+        if(h == 0)
+        {
+            dary = create_dary_heap(4, events, event16_compare);
+            for(int i = 0; i < events; i++)
+                dary_heap_insert(dary, &records[i]);
+            for(int i = 0; i < events; i++)
+            {
+                e = (EVENT16*)dary_heap_get_min(dary);
+                errors += e->priority < last;
+                last = e->priority;
+                e->priority += 1 + rand() % 1000;
+                dary_heap_insert(dary, e);
+            }
+            destroy_dary_heap(dary);
+            printf("  4-ary DARY_HEAP of pointers  ");
+        }
+        else if(h == 1)
+        {
+            typed = create_event16_heap(events);
+            for(int i = 0; i < events; i++)
+                event16_heap_insert(typed, records[i]);
+            for(int i = 0; i < events; i++)
+            {
+                event16_heap_get_min(typed, &record);
+                errors += record.priority < last;
+                last = record.priority;
+                record.priority += 1 + rand() % 1000;
+                event16_heap_insert(typed, record);
+            }
+            destroy_event16_heap(typed);
+            printf("  4-ary TYPED_HEAP of records  ");
+        }
+        else
+        {
+            radix = create_radix_heap();
+            for(int i = 0; i < events; i++)
+                radix_heap_insert(radix, (uint32_t)records[i].priority, &records[i]);
+            for(int i = 0; i < events; i++)
+            {
+                radix_heap_get_min(radix, &key, &data);
+                errors += (int)key < last;
+                last = (int)key;
+                e = (EVENT16*)data;
+                e->priority = (int)key + 1 + rand() % 1000;
+                radix_heap_insert(radix, (uint32_t)e->priority, e);
+            }
+            destroy_radix_heap(radix);
+            printf("  RADIX_HEAP                   ");
+        }
+        printf("%.0f ns per event (queue + hold), %d out of order\n",
+               (double)(clock() - start)/CLOCKS_PER_SEC/events*1e9, errors);
+    }
+    free(records);
+}
+
+typedef struct mq_worker
+{
+    MULTIQUEUE *mq;//NULL: use single under global
+    MQ_HEAP *single;
+    pthread_mutex_t *global;
+    int ops;
+    unsigned int seed;
+    uint64_t *order;//drain: key removed with each ticket
+    atomic_int *ticket;
+}MQ_WORKER;
+
+//steady state of a scheduler: delete the earliest job, insert one a little later
+void *mq_hold_workload(void *arg)
+{
+    MQ_WORKER *w = (MQ_WORKER*)arg;
+    MQ_ENTRY entry;
+    uint64_t key;
+    void *data;
+    
+    for(int i = 0; i < w->ops; i++)
+    {
+        if(w->mq)
+        {
+            if(mq_delete_min(w->mq, &key, &data))
+                mq_insert(w->mq, key + 1 + rand_r(&w->seed) % 1000, data);
+        }
+        else
+        {
+            pthread_mutex_lock(w->global);
+            if(mq_heap_get_min(w->single, &entry))
+            {
+                entry.key += 1 + rand_r(&w->seed) % 1000;
+                mq_heap_insert(w->single, entry);
+            }
+            pthread_mutex_unlock(w->global);
+        }
+    }
+    return NULL;
+}
+
+//deletes until the queue is empty, logging each key under a global ticket order
+void *mq_drain_workload(void *arg)
+{
+    MQ_WORKER *w = (MQ_WORKER*)arg;
+    uint64_t key;
+    void *data;
+    
+    while(mq_delete_min(w->mq, &key, &data))
+        w->order[atomic_fetch_add(w->ticket, 1)] = key;
+    return NULL;
+}
+
+/*
+ throughput: n queued jobs, each thread runs ops_per_thread holds on one globally locked MQ_HEAP
+ and then on a MultiQueue with c = 2 (wall clock, Mops/s).
+ rank error: the keys 0..n-1 are drained by all threads. replaying the deletions in ticket order,
+ the rank error of a delete is how many smaller keys were still queued (0 for an exact queue),
+ counted with a Fenwick tree over the keys already removed.
+ */
+void sample_multiqueue(int n, int ops_per_thread, int max_threads)
+{
+    MULTIQUEUE *mq;
+    MQ_HEAP *single;
+    MQ_ENTRY entry;
+    MQ_WORKER *w;
+    pthread_t *tid;
+    pthread_mutex_t global;
+    struct timespec t0, t1;
+    atomic_int ticket;
+    uint64_t *order, *perm, hold;
+    int *fenwick, removed_below, rank, max_rank;
+    double secs[2], rank_sum;
+    
+    w = (MQ_WORKER*)Malloc(max_threads*sizeof(MQ_WORKER));
+    tid = (pthread_t*)Malloc(max_threads*sizeof(pthread_t));
+    order = (uint64_t*)Malloc((size_t)n*sizeof(uint64_t));
+    perm = (uint64_t*)Malloc((size_t)n*sizeof(uint64_t));
+    fenwick = (int*)Malloc(((size_t)n + 1)*sizeof(int));
+    pthread_mutex_init(&global, NULL);
+    for(int i = 0; i < n; i++)
+        perm[i] = i;
+    for(int i = n - 1; i > 0; i--)
+    {
+        int j = rand() % (i + 1);
+        hold = perm[i];
+        perm[i] = perm[j];
+        perm[j] = hold;
+    }
+    for(int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        mq = create_multiqueue(threads, 2);
+        single = create_mq_heap(n);
+        for(int i = 0; i < n; i++)
+        {
+            entry.key = perm[i];
+            entry.data = NULL;
+            mq_heap_insert(single, entry);
+            mq_insert(mq, perm[i], NULL);
+        }
+        for(int pass = 0; pass < 2; pass++)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for(int t = 0; t < threads; t++)
+            {
+                w[t].mq = pass ? mq : NULL;
+                w[t].single = single;
+                w[t].global = &global;
+                w[t].ops = ops_per_thread;
+                w[t].seed = t + 1;
+                pthread_create(&tid[t], NULL, mq_hold_workload, &w[t]);
+            }
+            for(int t = 0; t < threads; t++)
+                pthread_join(tid[t], NULL);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            secs[pass] = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+        }
+        destroy_mq_heap(single);
+        destroy_multiqueue(mq);
+        
+        //rank error of a full drain
+        mq = create_multiqueue(threads, 2);
+        for(int i = 0; i < n; i++)
+            mq_insert(mq, perm[i], NULL);
+        atomic_init(&ticket, 0);
+        for(int t = 0; t < threads; t++)
+        {
+            w[t].mq = mq;
+            w[t].order = order;
+            w[t].ticket = &ticket;
+            pthread_create(&tid[t], NULL, mq_drain_workload, &w[t]);
+        }
+        for(int t = 0; t < threads; t++)
+            pthread_join(tid[t], NULL);
+        memset(fenwick, 0, ((size_t)n + 1)*sizeof(int));
+        rank_sum = 0;
+        max_rank = 0;
+        for(int i = 0; i < atomic_load(&ticket); i++)
+        {
+            removed_below = 0;
+            for(int k = (int)order[i]; k > 0; k -= k & -k)
+                removed_below += fenwick[k];
+            rank = (int)order[i] - removed_below;
+            rank_sum += rank;
+            max_rank = rank > max_rank ? rank : max_rank;
+            for(int k = (int)order[i] + 1; k <= n; k += k & -k)
+                fenwick[k]++;
+        }
+        printf("%2d threads: locked heap %.2f Mops/s, MultiQueue %.2f Mops/s (%d heaps), rank error mean %.1f max %d over %d deletes\n",
+               threads, (double)threads*ops_per_thread/secs[0]/1e6, (double)threads*ops_per_thread/secs[1]/1e6,
+               mq->queue_count, rank_sum/atomic_load(&ticket), max_rank, atomic_load(&ticket));
+        destroy_multiqueue(mq);
+    }
+    pthread_mutex_destroy(&global);
+    free(fenwick);
+    free(perm);
+    free(order);
+    free(tid);
+    free(w);
+}
+
+//page faults take a machine check while they run: the nested dispatch preempts them
+void intr_sample_handler(INTR *intr, void *context)
+{
+    INTR_SCHEDULER *s = (INTR_SCHEDULER*)context;
+    static INTR machine_check = {18, "machine_check (raised by the page fault handler)"};
+    
+    printf("%*s%d:%.*s\n", 2*s->depth, "", intr->priority, (int)strcspn(intr->description, "\n"), intr->description);
+    if(intr->priority == 14)
+    {
+        intr_raise(s, &machine_check);
+        intr_service(s);//interrupts enabled inside the handler
+    }
+}
+
+void sample_intr_scheduler(char *intr_vector, int n)
+{
+    INTR_SCHEDULER *s;
+    DHEAP *dheap;
+    INTR **ivt, *requests, watchdog = {200, "watchdog (beyond the bitmap: heap)"}, *out;
+    int size;
+    uint64_t sum;
+    clock_t start;
+    
+    size = get_line_count(intr_vector);
+    ivt = (INTR**)Malloc(size*sizeof(INTR*));
+    create_interrupt_vector_array(intr_vector, ivt);
+    s = create_intr_scheduler(intr_sample_handler, NULL);
+    s->context = s;
+    for(int i = 0; i < size; i++)
+        intr_raise(s, ivt[i]);
+    intr_raise(s, &watchdog);
+    intr_raise(s, ivt[0]);//a second divide_by_zero queues behind the first
+    intr_mask_level(s, 3);
+    intr_set_threshold(s, 1);
+    puts("LEVEL 3 MASKED, THRESHOLD 1:");
+    intr_service(s);
+    puts("UNMASK 3, THRESHOLD OFF, DISABLED:");
+    intr_unmask_level(s, 3);
+    intr_set_threshold(s, INTR_IDLE);
+    intr_disable(s);
+    printf("served %d\n", intr_service(s));
+    puts("ENABLED:");
+    intr_enable(s);
+    intr_service(s);
+    print_intr_stats(s);
+    destroy_intr_scheduler(s);
+    
+    //throughput: raise and dispatch n requests over 64 levels, 16 pending at a time
+    requests = (INTR*)Malloc((size_t)n*sizeof(INTR));
+    for(int i = 0; i < n; i++)
+    {
+        requests[i].priority = rand() % INTR_LEVELS;
+        requests[i].description = NULL;
+    }
+    s = create_intr_scheduler(NULL, NULL);
+    sum = 0;
+    start = clock();
+    for(int i = 0; i < n; i++)
+    {
+        intr_raise(s, &requests[i]);
+        if(i % 16 == 15)
+            while((out = intr_dispatch_begin(s)))
+            {
+                sum += out->priority;
+                intr_dispatch_end(s);
+            }
+    }
+    printf("bitmap scheduler: %.1f ns per raise + dispatch (checksum %llu)\n",
+           (double)(clock() - start)/CLOCKS_PER_SEC/n*1e9, (unsigned long long)sum);
+    destroy_intr_scheduler(s);
+    dheap = build_dynamic_array_heap_adt(64, 64, MAX, DYNAMIC_ARRAY, h1_compare, h1_process);
+    sum = 0;
+    start = clock();
+    for(int i = 0; i < n; i++)
+    {
+        dheap_insert(dheap, &requests[i]);
+        if(i % 16 == 15)
+            while(dheap_get_root(dheap, (void**)&out))
+                sum += out->priority;
+    }
+    printf("binary DHEAP:     %.1f ns per raise + dispatch (checksum %llu)\n",
+           (double)(clock() - start)/CLOCKS_PER_SEC/n*1e9, (unsigned long long)sum);
+    destroy_dynamic_heap_array(dheap);
+    free(requests);
+    for(int i = 0; i < size; i++)
+    {
+        free(ivt[i]->description);
+        free(ivt[i]);
+    }
+    free(ivt);
+}
+
+void timeout_expire(void *arg)
+{
+    TIMEOUT *t = (TIMEOUT*)arg;
+    
+    t->fired_at = t->wheel->now;
+}
+
+//DHEAP pops its largest: earliest expiry first
+int timeout_compare_min_first(void *arg1, void *arg2)
+{
+    uint64_t a = ((TIMEOUT*)arg1)->expires, b = ((TIMEOUT*)arg2)->expires;
+    
+    return a > b ? -1 : a < b;
+}
+
+/*
+ n timeouts 1..max_timeout ticks out (far of them up to 2^25 ticks, beyond the wheel), every other
+ one stopped before it expires, then time advanced tick by tick until none is left.
+ the DHEAP baseline cannot remove an entry: a stop only marks it, and it is dropped when it
+ reaches the root.
+ */
+void sample_timer_wheel(int n, int max_timeout, int far)
+{
+    TIMEOUT *timeouts;
+    TIMER_WHEEL *w;
+    DHEAP *dheap;
+    TIMEOUT *t;
+    void *out;
+    uint64_t now, last = 0;
+    int wrong, fired;
+    double t_start, t_stop, t_run;
+    clock_t start;
+    
+    timeouts = (TIMEOUT*)Malloc((size_t)n*sizeof(TIMEOUT));
+    for(int i = 0; i < n; i++)
+    {
+        timeouts[i].expires = 1 + (i < far ? (uint64_t)rand() % (1 << 25) : (uint64_t)(rand() % max_timeout));
+        last = timeouts[i].expires > last ? timeouts[i].expires : last;
+    }
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            timeouts[i].fired_at = 0;
+            timeouts[i].cancelled = false;
+        }
+        fired = 0;
+        if(pass == 0)
+        {
+            w = create_timer_wheel(0);
+            start = clock();
+            for(int i = 0; i < n; i++)
+            {
+                timeouts[i].wheel = w;
+                timeouts[i].handle = timer_start(w, timeouts[i].expires, timeout_expire, &timeouts[i]);
+            }
+            t_start = (double)(clock() - start)/CLOCKS_PER_SEC;
+            start = clock();
+            for(int i = 1; i < n; i += 2)
+            {
+                timer_stop(w, timeouts[i].handle);
+                timeouts[i].cancelled = true;
+            }
+            t_stop = (double)(clock() - start)/CLOCKS_PER_SEC;
+            start = clock();
+            while(w->count)
+                fired += timer_wheel_tick(w);
+            t_run = (double)(clock() - start)/CLOCKS_PER_SEC;
+            printf("timer wheel: %llu cascades, ", (unsigned long long)w->cascaded);
+            destroy_timer_wheel(w);
+        }
+        else
+        {
+            dheap = build_dynamic_array_heap_adt(1024, 1024, MAX, DYNAMIC_ARRAY, timeout_compare_min_first, NULL);
+            start = clock();
+            for(int i = 0; i < n; i++)
+                dheap_insert(dheap, &timeouts[i]);
+            t_start = (double)(clock() - start)/CLOCKS_PER_SEC;
+            start = clock();
+            for(int i = 1; i < n; i += 2)
+                timeouts[i].cancelled = true;
+            t_stop = (double)(clock() - start)/CLOCKS_PER_SEC;
+            start = clock();
+            for(now = 1; dheap->count; now++)
+            {
+                while(dheap->count && ((TIMEOUT*)dheap->ary[0])->expires <= now)
+                {
+                    dheap_get_root(dheap, &out);
+                    t = (TIMEOUT*)out;
+                    if(!t->cancelled)
+                    {
+                        t->fired_at = now;
+                        fired++;
+                    }
+                }
+            }
+            t_run = (double)(clock() - start)/CLOCKS_PER_SEC;
+            printf("DHEAP (%d reallocs): ", dheap->max_size/1024 - 1);
+            destroy_dynamic_heap_array(dheap);
+        }
+        wrong = 0;
+        for(int i = 0; i < n; i++)
+            wrong += timeouts[i].cancelled ? timeouts[i].fired_at != 0 : timeouts[i].fired_at != timeouts[i].expires;
+        printf("start %.0f ns, stop %.0f ns per timer, %.0f ms to run %llu ticks, %d fired, %d wrong\n",
+               t_start/n*1e9, t_stop/(n/2)*1e9, t_run*1e3, (unsigned long long)last, fired, wrong);
+    }
+    free(timeouts);
+}
+
+int run_head_compare(void *arg1, void *arg2)
+{
+    return int_compare(*((RUN_HEAD*)arg1)->head, *((RUN_HEAD*)arg2)->head);
+}
+
+int qsort_int_compare(const void *arg1, const void *arg2)
+{
+    return int_compare((void*)arg1, (void*)arg2);
+}
+
+/*
+ top-K: the k smallest of n random ints, three ways: everything into DHEAP then k pops (what we
+ did), TOPK on pointers, TOPK_INT on the keys with the block filter.
+ merge: the same n ints cut into runs sorted runs, merged by a loser tree and by a binary heap of
+ run heads (get_min, advance the run, insert).
+ */
+void sample_topk_and_merge(int n, int k, int runs)
+{
+    int32_t *keys, *best;
+    int32_t *expected;
+    void **ptrs, **out, ***run_ptrs;
+    int *lengths, *p, last, errors, run_len;
+    DHEAP *dheap;
+    TOPK *topk;
+    TOPK_INT *topk_int;
+    LOSER_TREE *lt;
+    DARY_HEAP *heads;
+    RUN_HEAD *records, *r;
+    double secs;
+    clock_t start;
+    
+    k = k < n ? k : n;
+    keys = (int32_t*)Malloc((size_t)n*sizeof(int32_t));
+    ptrs = (void**)Malloc((size_t)n*sizeof(void*));
+    out = (void**)Malloc((size_t)(k > runs ? k : runs)*sizeof(void*));
+    best = (int32_t*)Malloc(k*sizeof(int32_t));
+    expected = (int32_t*)Malloc(k*sizeof(int32_t));
+    for(int i = 0; i < n; i++)
+    {
+        keys[i] = rand() - RAND_MAX/2;
+        ptrs[i] = &keys[i];
+    }
+    printf("TOP-%d SMALLEST OF %d:\n", k, n);
+    start = clock();
+    dheap = build_dynamic_array_heap_adt(n, n, MAX, DYNAMIC_ARRAY, int_compare_min_first, NULL);
+    for(int i = 0; i < n; i++)
+        dheap_insert(dheap, ptrs[i]);
+    for(int i = 0; i < k; i++)
+    {
+        dheap_get_root(dheap, &out[0]);
+        expected[i] = *(int32_t*)out[0];
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    destroy_dynamic_heap_array(dheap);
+    printf("  DHEAP, all n inserted:     %6.1f M elements/s\n", n/secs/1e6);
+    
+    start = clock();
+    topk = create_topk(k, int_compare_min_first);
+    for(int i = 0; i < n; i++)
+        topk_push(topk, ptrs[i]);
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    topk_result(topk, out);
+    errors = 0;
+    for(int i = 0; i < k; i++)
+        errors += *(int32_t*)out[i] != expected[i];
+    destroy_topk(topk);
+    printf("  TOPK (compare callback):   %6.1f M elements/s, %d differ\n", n/secs/1e6, errors);
+    
+    start = clock();
+    topk_int = create_topk_int(k, MIN);
+    for(int i = 0; i < n; i += 1 << 16)//as a stream of 64K-key chunks
+        topk_int_feed(topk_int, keys + i, n - i < (1 << 16) ? n - i : 1 << 16);
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("  TOPK_INT (block filter):   %6.1f M elements/s, %.2f%% skipped by the filter, ",
+           n/secs/1e6, 100.0*topk_int->filtered/n);
+    topk_int_result(topk_int, best, NULL);
+    errors = 0;
+    for(int i = 0; i < k; i++)
+        errors += best[i] != expected[i];
+    printf("%d differ\n", errors);
+    destroy_topk_int(topk_int);
+    
+    //k-way merge
+    run_len = (n + runs - 1)/runs;
+    run_ptrs = (void***)Malloc(runs*sizeof(void**));
+    lengths = (int*)Malloc(runs*sizeof(int));
+    for(int r0 = 0; r0 < runs; r0++)
+    {
+        int first = r0*run_len;
+        lengths[r0] = first >= n ? 0 : (n - first < run_len ? n - first : run_len);
+        if(lengths[r0])
+            qsort(keys + first, lengths[r0], sizeof(int32_t), qsort_int_compare);
+        run_ptrs[r0] = ptrs + (first < n ? first : 0);
+    }
+    printf("MERGE OF %d SORTED RUNS:\n", runs);
+    start = clock();
+    lt = create_loser_tree(run_ptrs, lengths, runs, int_compare);
+    last = INT_MIN;
+    errors = 0;
+    while((p = (int*)loser_tree_next(lt)))
+    {
+        errors += *p < last;
+        last = *p;
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    destroy_loser_tree(lt);
+    printf("  loser tree:                %6.1f M elements/s, %d out of order\n", n/secs/1e6, errors);
+    
+    records = (RUN_HEAD*)Malloc(runs*sizeof(RUN_HEAD));
+    start = clock();
+    heads = create_dary_heap(2, runs, run_head_compare);
+    for(int r0 = 0; r0 < runs; r0++)
+    {
+        records[r0].head = run_ptrs[r0];
+        records[r0].end = run_ptrs[r0] + lengths[r0];
+        if(lengths[r0])
+            dary_heap_insert(heads, &records[r0]);
+    }
+    last = INT_MIN;
+    errors = 0;
+    while((r = (RUN_HEAD*)dary_heap_peek(heads)))
+    {
+        p = (int*)*r->head;
+        errors += *p < last;
+        last = *p;
+        //advance the run in place: the next key of a sorted run is never smaller
+        if(++r->head < r->end)
+        {
+            dary_heap_replace_min(heads, r);
+        }
+        else
+            dary_heap_get_min(heads);
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    destroy_dary_heap(heads);
+    printf("  binary heap of run heads:  %6.1f M elements/s, %d out of order\n", n/secs/1e6, errors);
+    free(records);
+    free(lengths);
+    free(run_ptrs);
+    free(expected);
+    free(best);
+    free(out);
+    free(ptrs);
+    free(keys);
+}
+
+int ext_record_compare(void *arg1, void *arg2)
+{
+    uint64_t a = ((EXT_RECORD*)arg1)->key, b = ((EXT_RECORD*)arg2)->key;
+    
+    return a < b ? -1 : a > b;
+}
+
+//DHEAP is a max heap: reversed to pop the smallest key first
+int ext_record_compare_max_first(void *arg1, void *arg2)
+{
+    return ext_record_compare(arg2, arg1);
+}
+
+/*
+ n random records in, all out in key order, through EXT_HEAP with a budget_mb budget, then through
+ DHEAP holding everything in memory. checks the order and that every id came out once (xor and sum).
+ */
+void sample_ext_heap(int n, int budget_mb)
+{
+    EXT_HEAP *heap;
+    EXT_RECORD record, *out, *records;
+    DHEAP *dheap;
+    void *data;
+    uint64_t last, xor_in = 0, xor_out, sum_in = 0, sum_out;
+    int errors;
+    double secs;
+    clock_t start;
+    
+    printf("EXT_HEAP, %d records of %zu bytes (%.0f MB), %d MB budget:\n", n, sizeof(EXT_RECORD),
+           (double)n*sizeof(EXT_RECORD)/1e6, budget_mb);
+    if(!(heap = create_ext_heap(sizeof(EXT_RECORD), (size_t)budget_mb << 20, ext_record_compare, NULL)))
+        return;
+    memset(&record, 0, sizeof(record));
+    srand(1);
+    start = clock();
+    for(int i = 0; i < n; i++)
+    {
+        record.key = ((uint64_t)rand() << 31) ^ rand();
+        record.id = i;
+        xor_in ^= record.key;
+        sum_in += record.id;
+        ext_heap_insert(heap, &record);
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("  insert:  %6.2f M records/s\n", n/secs/1e6);
+    start = clock();
+    last = 0;
+    errors = 0;
+    xor_out = sum_out = 0;
+    while((out = (EXT_RECORD*)ext_heap_get_min(heap)))
+    {
+        errors += out->key < last;
+        last = out->key;
+        xor_out ^= out->key;
+        sum_out += out->id;
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("  get_min: %6.2f M records/s, %d out of order, %s\n", n/secs/1e6, errors,
+           xor_in == xor_out && sum_in == sum_out ? "every record once" : "RECORDS LOST OR DUPLICATED");
+    printf("  ");
+    print_ext_heap_stats(heap);
+    destroy_ext_heap(heap);
+    
+    //the same records, all in memory
+    records = (EXT_RECORD*)Malloc((size_t)n*sizeof(EXT_RECORD));
+    srand(1);
+    start = clock();
+    dheap = build_dynamic_array_heap_adt(n, n, MAX, DYNAMIC_ARRAY, ext_record_compare_max_first, NULL);
+    for(int i = 0; i < n; i++)
+    {
+        memset(&records[i], 0, sizeof(EXT_RECORD));
+        records[i].key = ((uint64_t)rand() << 31) ^ rand();
+        records[i].id = i;
+        dheap_insert(dheap, &records[i]);
+    }
+    last = 0;
+    errors = 0;
+    while(dheap_get_root(dheap, &data))
+    {
+        errors += ((EXT_RECORD*)data)->key < last;
+        last = ((EXT_RECORD*)data)->key;
+    }
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("DHEAP in memory (%.0f MB): %.2f M records/s in and out, %d out of order\n",
+           (double)n*(sizeof(EXT_RECORD) + sizeof(void*))/1e6, n/secs/1e6, errors);
+    destroy_dynamic_heap_array(dheap);
+    free(records);
+}
+
 IPv4_ADDR *addr_32_bit(uint8_t ip_addr[], int prefix)
 {
     IPv4_ADDR *ipv4_addr = (IPv4_ADDR*)malloc(sizeof(IPv4_ADDR));
@@ -1212,7 +2444,7 @@ void sample_hashed_table_with_bucket(char *symbol_table, int bucket_size)
 {
     printf("EXAMPLE WITH BUCKET RESOLUTION!!!!\n\n");
     HASH_TABLE *sym_table;
-    SYM *data_in, *data_out;
+    SYM *data_in = NULL, *data_out;
     FILE *fp;
     char buffer[MAX_LINE], *entry_name;
     long strLen;
@@ -1238,12 +2470,212 @@ void sample_hashed_table_with_bucket(char *symbol_table, int bucket_size)
     }
     Fclose(fp);
     puts("\nSAMPLE RETRIVAL");
-    data_out = retrieve_ht(sym_table, NULL, 2);
-    printf("%s:%d\n", data_out->name, data_out->hash_key);
+    if(data_in)//empty file: nothing to retrieve
+    {
+        data_out = retrieve_ht(sym_table, NULL, data_in->hash_key);//last entry read
+        if(data_out)
+            printf("%s:%d\n", data_out->name, data_out->hash_key);
+    }
     free_ht(sym_table);
 
 }
 
+const char *sym_get_key(void *data)
+{
+    return ((SYM*)data)->name;
+}
+
+const void *sym_name_key(void *data)
+{
+    return ((SYM*)data)->name;
+}
+
+//composite key: an IPv4 prefix is address AND length (10.0.0.0/8 != 10.0.0.0/16)
+typedef struct prefix_key
+{
+    uint32_t prefix;
+    uint8_t len;
+}PREFIX_KEY;
+
+typedef struct prefix_route
+{
+    PREFIX_KEY key;
+    int out_if;
+}PREFIX_ROUTE;
+
+typedef struct big_record
+{
+    uint64_t id;//does not fit an int
+    int payload;
+}BIG_RECORD;
+
+const void *prefix_route_key(void *data)
+{
+    return &((PREFIX_ROUTE*)data)->key;
+}
+
+uint64_t prefix_key_hash(const void *key)
+{
+    const PREFIX_KEY *k = (const PREFIX_KEY*)key;
+    
+    return ht_hash_combine(ht_hash_u64(k->prefix), k->len);
+}
+
+bool prefix_key_equal(const void *key1, const void *key2)
+{
+    const PREFIX_KEY *a = (const PREFIX_KEY*)key1, *b = (const PREFIX_KEY*)key2;
+    
+    return a->prefix == b->prefix && a->len == b->len;
+}
+
+const void *big_record_key(void *data)
+{
+    return &((BIG_RECORD*)data)->id;
+}
+
+//keys the caller no longer has to squeeze into an int: strings, composites and 64-bit ids.
+void sample_keyed_hash_tables(char *symbol_table, int n)
+{
+    HT_KEY_OPS sym_ops = {sym_name_key, ht_str_hash, ht_str_equal};
+    HT_KEY_OPS prefix_ops = {prefix_route_key, prefix_key_hash, prefix_key_equal};
+    HT_KEY_OPS big_ops = {big_record_key, ht_u64_hash, ht_u64_equal};
+    HASH_TABLE *ht;
+    SYM *data_in, *data_out;
+    PREFIX_ROUTE routes[3] = {{{0x0a000000, 8}, 1}, {{0x0a000000, 16}, 2}, {{0xc0a80100, 24}, 3}};
+    PREFIX_KEY lookup;
+    PREFIX_ROUTE *route;
+    BIG_RECORD *recs;
+    uint64_t id;
+    FILE *fp;
+    char buffer[MAX_LINE], *entry_name;
+    long strLen;
+    int found;
+    clock_t start;
+    
+    //1) symbol table keyed by the name itself: no hash_ascii_to_int
+    ht = create_keyed_hash_table(4, &sym_ops, NULL);
+    fp = Fopen(symbol_table, "r");
+    while(fgets(buffer, MAX_LINE, fp))
+    {
+        data_in = (SYM*)Malloc(sizeof(SYM));
+        entry_name = strtok(buffer, ":");
+        strLen = strlen(entry_name)+1;
+        data_in->name =  (char*)Malloc(sizeof(char)*strLen);
+        strncpy(data_in->name,entry_name, strLen);
+        data_in->hash_key = 0;
+        data_in->var_type = (int)strtol(strtok(NULL, ":"),(char**)NULL, 10);
+        data_in->var_scope = (int)strtol(strtok(NULL, ":"),(char**)NULL, 10);
+        insert_ht(ht, data_in, 0);
+    }
+    Fclose(fp);
+    data_out = (SYM*)keyed_ht_retrieve(ht, "frequency");
+    printf("frequency: %s\n", data_out ? "found" : "NOT FOUND");
+    for(int i = 0; i < ht->size; i++)
+        for(int e = ht->heads[i]; e != -1; e = ht->entries[e].next)
+        {
+            data_out = (SYM*)ht->entries[e].satellite;
+            free(data_out->name);
+            free(data_out);
+        }
+    free_ht(ht);
+    
+    //2) composite key
+    ht = create_keyed_hash_table(4, &prefix_ops, NULL);
+    for(int i = 0; i < 3; i++)
+        keyed_ht_insert(ht, &routes[i]);
+    lookup.prefix = 0x0a000000;
+    lookup.len = 16;
+    route = (PREFIX_ROUTE*)keyed_ht_retrieve(ht, &lookup);
+    printf("10.0.0.0/16 -> if %d\n", route ? route->out_if : -1);
+    free_ht(ht);
+    
+    //3) 64-bit ids, table starts tiny and grows from the cached hashes
+    recs = (BIG_RECORD*)Malloc(n*sizeof(BIG_RECORD));
+    for(int i = 0; i < n; i++)
+    {
+        recs[i].id = (uint64_t)i*0x100000001ULL;//low 32 bits alone would collide
+        recs[i].payload = i;
+    }
+    ht = create_keyed_hash_table(16, &big_ops, NULL);
+    start = clock();
+    for(int i = 0; i < n; i++)
+        keyed_ht_insert(ht, &recs[i]);
+    printf("%d 64-bit keys inserted in %.3fs, %d heads\n", n, (double)(clock() - start)/CLOCKS_PER_SEC, ht->size);
+    start = clock();
+    found = 0;
+    for(int i = 0; i < n; i++)
+    {
+        id = (uint64_t)(rand() % n)*0x100000001ULL;
+        found += keyed_ht_retrieve(ht, &id) != NULL;
+    }
+    printf("%d/%d random lookups found, %.1f Mlookups/s\n", found, n, n/((double)(clock() - start)/CLOCKS_PER_SEC)/1e6);
+    ht_stats_json(ht, stdout);
+    free_ht(ht);
+    free(recs);
+}
+
+//the symbol table never changes after load: build a perfect hash once, one probe per lookup.
+void sample_perfect_hash_symbol_table(char *symbol_table)
+{
+    printf("EXAMPLE WITH A STATIC PERFECT HASH!!!!\n\n");
+    PERFECT_HASH *sym_table, *loaded;
+    SYM **entries, *data_out;
+    FILE *fp;
+    char buffer[MAX_LINE], *entry_name;
+    long strLen;
+    int size, n, found;
+
+    size =  get_line_count(symbol_table);
+    entries = (SYM**)Malloc(size*sizeof(SYM*));
+    n = 0;
+    fp = Fopen(symbol_table, "r");
+    while(n < size && fgets(buffer, MAX_LINE, fp))
+    {
+        entries[n] = (SYM*)Malloc(sizeof(SYM));
+        entry_name = strtok(buffer, ":");
+        strLen = strlen(entry_name)+1;
+        entries[n]->name =  (char*)Malloc(sizeof(char)*strLen);
+        strncpy(entries[n]->name,entry_name, strLen);
+        entries[n]->hash_key = hash_ascii_to_int(entries[n]->name, size);
+        entries[n]->var_type = (int)strtol(strtok(NULL, ":"),(char**)NULL, 10);
+        entries[n]->var_scope = (int)strtol(strtok(NULL, ":"),(char**)NULL, 10);
+        n++;
+    }
+    Fclose(fp);
+    sym_table = build_perfect_hash((void**)entries, n, sym_get_key);
+    if(!sym_table)
+        return;
+    printf("%d keys, %u slots, %.2f bits/key of displacements (seed %u)\n", n, sym_table->m,
+           16.0*sym_table->r/n, sym_table->seed);
+    found = 0;
+    for(int i = 0; i < n; i++)
+    {
+        data_out = ph_retrieve(sym_table, entries[i]->name);
+        if(data_out == entries[i])
+            found++;
+        printf("%s -> slot %u\n", entries[i]->name, ph_index(sym_table, entries[i]->name));
+    }
+    printf("found %d/%d, missing key: %s\n", found, n, ph_retrieve(sym_table, "not_a_symbol") ? "FOUND?!" : "rejected");
+    //build once, ship the table, load it at startup
+    if(ph_save(sym_table, "sym_table.phf"))
+    {
+        loaded = ph_load("sym_table.phf", (void**)entries, (uint32_t)n, sym_get_key);
+        found = 0;
+        for(int i = 0; loaded && i < n; i++)
+            found += ph_retrieve(loaded, entries[i]->name) == entries[i];
+        printf("reloaded from sym_table.phf: found %d/%d\n", found, n);
+        if(loaded)
+            destroy_perfect_hash(loaded);
+    }
+    destroy_perfect_hash(sym_table);
+    for(int i = 0; i < n; i++)
+    {
+        free(entries[i]->name);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
 int chain_compare(void *a, void *b)
 {
     EMPLOYEE *c, *d;
@@ -1306,6 +2738,729 @@ void sample_hashed_table_with_chaining(char *db_in)
     free_ht(org_db);
 }
 
+//fixed-size, pointer-free image of an EMPLOYEE as it is stored in the file
+typedef struct employee_rec
+{
+    char first[32];
+    unsigned int EN;
+}EMPLOYEE_REC;
+
+//first run ingests db_in into ht_file; every later run only maps the file.
+void sample_persistent_ht(char *db_in, char *ht_file)
+{
+    printf("EXAMPLE PERSISTENT HASH TABLE OPENED WITH MMAP!!!!\n\n");
+    MMAP_HT *org_db;
+    EMPLOYEE_REC rec, orig, *data_out;
+    FILE *fp;
+    char buffer[MAX_LINE], *name;
+    int first_key = -1;
+    clock_t start;
+
+    start = clock();
+    org_db = mht_open(ht_file);
+    if(org_db)
+        printf("opened %s in %.3f ms: %llu live records\n", ht_file, 1000.0*(clock() - start)/CLOCKS_PER_SEC,
+               (unsigned long long)org_db->header->live);
+    else
+    {
+        org_db = mht_create(ht_file, get_line_count(db_in), sizeof(EMPLOYEE_REC), 0x9e3779b9);
+        if(!org_db)
+            return;
+        fp = Fopen(db_in, "r");
+        while(fgets(buffer, MAX_LINE, fp))
+        {
+            memset(&rec, 0, sizeof(rec));
+            name = strtok(buffer, ":");
+            strncpy(rec.first, name, sizeof(rec.first) - 1);
+            rec.EN = (unsigned int)strtol(strtok(NULL, ":"),(char**)NULL, 10);
+            mht_insert(org_db, rec.EN, &rec);
+        }
+        Fclose(fp);
+        mht_sync(org_db);
+        printf("ingested %s into %s: %llu records\n", db_in, ht_file, (unsigned long long)org_db->header->live);
+    }
+    //walk the slots to list what is in there, no copy out of the mapping
+    for(uint32_t s = 0; s < org_db->header->slot_count; s++)
+    {
+        for(uint64_t off = org_db->slots[s]; off; off = MHT_RECORD_AT(org_db, off)->next)
+        {
+            if(MHT_RECORD_AT(org_db, off)->flags & MHT_DEAD)
+                continue;
+            data_out = (EMPLOYEE_REC*)mht_retrieve(org_db, MHT_RECORD_AT(org_db, off)->key);
+            printf("%s:%u\n", data_out->first, data_out->EN);
+            if(first_key == -1)
+                first_key = (int)data_out->EN;
+        }
+    }
+    if(first_key != -1)
+    {
+        puts("UPDATE, DELETE, COMPACT:");
+        data_out = (EMPLOYEE_REC*)mht_retrieve(org_db, first_key);
+        orig = rec = *data_out;
+        strncpy(rec.first, "Renamed", sizeof(rec.first) - 1);
+        mht_insert(org_db, first_key, &rec);//appends a new version
+        data_out = (EMPLOYEE_REC*)mht_retrieve(org_db, first_key);
+        printf("%d is now %s, %llu dead records\n", first_key, data_out->first, (unsigned long long)org_db->header->dead);
+        mht_delete(org_db, first_key);
+        org_db = mht_compact(org_db);
+        printf("after compaction: %llu live, %llu dead, %d %s\n", (unsigned long long)org_db->header->live,
+               (unsigned long long)org_db->header->dead, first_key, mht_retrieve(org_db, first_key) ? "FOUND?!" : "gone");
+        mht_insert(org_db, first_key, &orig);//leave the file as we found it
+        mht_sync(org_db);
+    }
+    mht_close(org_db);
+}
+
+//insert throughput and memory held by a CHAINING table of n synthetic employees.
+void sample_chained_table_insert_throughput(int n)
+{
+    HASH_TABLE *org_db;
+    EMPLOYEE *ary;
+    clock_t start;
+    double secs;
+    
+    ary = (EMPLOYEE*)Malloc(n*sizeof(EMPLOYEE));
+    for(int i = 0; i < n; i++)
+    {
+        ary[i].first = NULL;
+        ary[i].EN = ((unsigned int)i*2654435761u) >> 1;//scattered, positive employee numbers
+    }
+    start = clock();
+    org_db = create_hash_table(n, 0, NULL, chain_compare, NULL, OPEN_ADDRESSING, DIVISION, CHAINING);
+    for(int i = 0; i < n; i++)
+        insert_ht(org_db, &ary[i], ary[i].EN);
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("%d inserts in %.3f s: %.0f inserts/s\n", n, secs, n/secs);
+    printf("table memory: %zu bytes, %.1f bytes/entry (%d arena blocks)\n",
+           chain_ht_memory(org_db), (double)chain_ht_memory(org_db)/n, org_db->arena.block_count);
+    free_ht(org_db);
+    free(ary);
+}
+
+const void *u64_self_key(void *data)
+{
+    return data;
+}
+
+//one-at-a-time retrieve_ht vs retrieve_ht_batch over random keys, BUCKET, CHAINING and KEYED tables.
+void sample_ht_batch_lookup(int n)
+{
+    HASH_TABLE *ht;
+    EMPLOYEE *ary;
+    COLLISION_RESULTION modes[] = {BUCKET, CHAINING, KEYED};
+    const char *names[] = {"BUCKET", "CHAINING", "KEYED"};
+    HT_KEY_OPS u64_ops = {u64_self_key, ht_u64_hash, ht_u64_equal};
+    uint64_t *ids;
+    void **targets, **out;
+    int *keys, found;
+    clock_t start;
+    double single, batch;
+    
+    ary = (EMPLOYEE*)Malloc(n*sizeof(EMPLOYEE));
+    keys = (int*)Malloc(n*sizeof(int));
+    targets = (void**)Malloc(n*sizeof(void*));
+    out = (void**)Malloc(n*sizeof(void*));
+    ids = (uint64_t*)Malloc(n*sizeof(uint64_t));
+    for(int i = 0; i < n; i++)
+    {
+        ary[i].first = NULL;
+        ary[i].EN = i;
+        ids[i] = i;
+    }
+    for(int i = 0; i < n; i++)//random lookup order
+    {
+        keys[i] = rand() % n;
+        targets[i] = &ary[keys[i]];
+    }
+    for(int m = 0; m < 3; m++)
+    {
+        if(modes[m] == KEYED)//satellites are the 64-bit ids themselves
+        {
+            ht = create_keyed_hash_table(n, &u64_ops, NULL);
+            for(int i = 0; i < n; i++)
+            {
+                insert_ht(ht, &ids[i], 0);
+                targets[i] = &ids[keys[i]];
+            }
+        }
+        else
+        {
+            ht = create_hash_table(modes[m] == BUCKET ? n/BUCKET_SLOTS : n, BUCKET_SLOTS, NULL, chain_compare, NULL,
+                                   OPEN_ADDRESSING, DIVISION, modes[m]);
+            for(int i = 0; i < n; i++)
+                insert_ht(ht, &ary[i], ary[i].EN);
+        }
+        start = clock();
+        found = 0;
+        for(int i = 0; i < n; i++)
+            found += retrieve_ht(ht, targets[i], keys[i]) != NULL;
+        single = (double)(clock() - start)/CLOCKS_PER_SEC;
+        start = clock();
+        retrieve_ht_batch(ht, targets, keys, n, out);
+        batch = (double)(clock() - start)/CLOCKS_PER_SEC;
+        for(int i = 0; i < n; i++)
+            found -= out[i] != NULL;
+        printf("%s: single %.1f Mlookups/s, batch of %d %.1f Mlookups/s%s\n", names[m],
+               n/single/1e6, HT_BATCH, n/batch/1e6, found ? " MISMATCH!" : "");
+        free_ht(ht);
+    }
+    free(out);
+    free(ids);
+    free(targets);
+    free(keys);
+    free(ary);
+}
+
+//table health as JSON, the same keys through BUCKET and CHAINING: random keys, then
+//keys that are all multiples of the table size (the worst case for key % size).
+void sample_ht_stats(int n)
+{
+    HASH_TABLE *ht;
+    EMPLOYEE *ary;
+    COLLISION_RESULTION modes[] = {BUCKET, CHAINING};
+    int size;
+    
+    ary = (EMPLOYEE*)Malloc(n*sizeof(EMPLOYEE));
+    for(int skewed = 0; skewed < 2; skewed++)
+    {
+        for(int m = 0; m < 2; m++)
+        {
+            size = modes[m] == BUCKET ? n/BUCKET_SLOTS : n;
+            for(int i = 0; i < n; i++)
+            {
+                ary[i].first = NULL;
+                ary[i].EN = skewed ? (unsigned int)i*size : (unsigned int)rand();
+            }
+            ht = create_hash_table(size, BUCKET_SLOTS, NULL, chain_compare, NULL, OPEN_ADDRESSING, DIVISION, modes[m]);
+            for(int i = 0; i < n; i++)
+                insert_ht(ht, &ary[i], ary[i].EN);
+            for(int i = 0, j; i < n; i++)
+            {
+                j = rand() % n;
+                retrieve_ht(ht, &ary[j], ary[j].EN);
+            }
+            printf("%s keys: ", skewed ? "multiple-of-size" : "random");
+            ht_stats_json(ht, stdout);
+            free_ht(ht);
+        }
+    }
+    free(ary);
+}
+
+typedef struct cache_worker
+{
+    SHARDED_CACHE *cache;
+    HASH_TABLE *store;
+    int universe;
+    int ops;
+    unsigned int seed;
+}CACHE_WORKER;
+
+//skewed key: a few keys are hot, most are cold
+int skewed_key(unsigned int *seed, int universe)
+{
+    double u = (double)rand_r(seed)/RAND_MAX;
+    
+    return (int)(universe*u*u*u*u) % universe;
+}
+
+//read-through: the cache in front of retrieve_ht on the backing table
+void *cache_read_through_workload(void *arg)
+{
+    CACHE_WORKER *w = (CACHE_WORKER*)arg;
+    void *data_out;
+    int key;
+    
+    for(int i = 0; i < w->ops; i++)
+    {
+        key = skewed_key(&w->seed, w->universe);
+        if(!(data_out = sharded_cache_get(w->cache, key)))
+        {
+            data_out = retrieve_ht(w->store, NULL, key);
+            sharded_cache_put(w->cache, key, data_out);
+        }
+    }
+    return NULL;
+}
+
+//hit ratio of each policy on a skewed workload with a one-off scan every 10*capacity ops,
+//then the sharded cache from several threads.
+void sample_cache_policies(int capacity, int ops, int threads)
+{
+    HASH_TABLE *store;
+    EMPLOYEE *ary;
+    CACHE *cache;
+    SHARDED_CACHE *sc;
+    CACHE_WORKER *w;
+    pthread_t *tid;
+    CACHE_POLICY policies[] = {CACHE_LRU, CACHE_CLOCK, CACHE_2Q};
+    uint64_t hits, misses, evictions;
+    unsigned int seed;
+    int universe, key, scan;
+    void *data_out;
+    clock_t start;
+    
+    universe = 10*capacity;
+    ary = (EMPLOYEE*)Malloc(universe*sizeof(EMPLOYEE));
+    store = create_hash_table(universe, 0, NULL, NULL, NULL, DIRECT_ADDRESSING, DIRECT, NONE);
+    for(int i = 0; i < universe; i++)
+    {
+        ary[i].first = NULL;
+        ary[i].EN = i;
+        insert_ht(store, &ary[i], i);
+    }
+    for(int p = 0; p < 3; p++)
+    {
+        cache = create_cache(capacity, policies[p], NULL);
+        seed = 1;
+        scan = universe;
+        start = clock();
+        for(int i = 0; i < ops; i++)
+        {
+            if(i % universe < capacity/2)//scan burst: keys never seen again
+                key = scan++;
+            else
+                key = skewed_key(&seed, universe);
+            if(!(data_out = cache_get(cache, key)))
+            {
+                data_out = key < universe ? retrieve_ht(store, NULL, key) : NULL;
+                cache_put(cache, key, data_out);
+            }
+        }
+        print_cache_stats(cache);
+        printf("    %.1f Mops/s\n", ops/((double)(clock() - start)/CLOCKS_PER_SEC)/1e6);
+        destroy_cache(cache);
+    }
+    
+    sc = create_sharded_cache(capacity, 16, CACHE_2Q, NULL);
+    w = (CACHE_WORKER*)Malloc(threads*sizeof(CACHE_WORKER));
+    tid = (pthread_t*)Malloc(threads*sizeof(pthread_t));
+    for(int t = 0; t < threads; t++)
+    {
+        w[t].cache = sc;
+        w[t].store = store;
+        w[t].universe = universe;
+        w[t].ops = ops/threads;
+        w[t].seed = t + 1;
+        pthread_create(&tid[t], NULL, cache_read_through_workload, &w[t]);
+    }
+    for(int t = 0; t < threads; t++)
+        pthread_join(tid[t], NULL);
+    sharded_cache_totals(sc, &hits, &misses, &evictions);
+    printf("sharded 2Q, %d threads x 16 shards: hit ratio %.3f, %llu evictions\n", threads,
+           (double)hits/(hits + misses), (unsigned long long)evictions);
+    destroy_sharded_cache(sc);
+    free(tid);
+    free(w);
+    free_ht(store);
+    free(ary);
+}
+
+//consistent with gcompare: routers are equal when their addresses are
+uint64_t router_hash(void *data)
+{
+    return bloom_hash_int((int)((ROUTER*)data)->ip_addr);
+}
+
+//mostly-miss lookups on a chained table (chains ~8 long) with and without a 1% Bloom filter,
+//then the same filter in front of the router graph.
+void sample_bloom_filter_front_end(int n, char *vertex_file, char *links_file)
+{
+    HASH_TABLE *plain, *filtered;
+    BLOOM_FILTER *bf, *half;
+    EMPLOYEE *ary, *miss, unknown;
+    GRAPH *g;
+    ROUTER **nodes, stranger;
+    uint64_t *hashes;
+    int found, fp, size;
+    clock_t start;
+    double t_plain, t_filtered;
+    
+    ary = (EMPLOYEE*)Malloc(n*sizeof(EMPLOYEE));
+    miss = (EMPLOYEE*)Malloc(n*sizeof(EMPLOYEE));
+    hashes = (uint64_t*)Malloc(n*sizeof(uint64_t));
+    for(int i = 0; i < n; i++)
+    {
+        ary[i].first = miss[i].first = NULL;
+        ary[i].EN = 2*i;//even keys are in, odd keys are not
+        miss[i].EN = 2*(rand() % n) + 1;//random order: no help from the cache
+        hashes[i] = bloom_hash_int(ary[i].EN);
+    }
+    plain = create_hash_table(n/8 + 1, 0, NULL, chain_compare, NULL, OPEN_ADDRESSING, DIVISION, CHAINING);
+    filtered = create_hash_table(n/8 + 1, 0, NULL, chain_compare, NULL, OPEN_ADDRESSING, DIVISION, CHAINING);
+    for(int i = 0; i < n; i++)
+    {
+        insert_ht(plain, &ary[i], ary[i].EN);
+        insert_ht(filtered, &ary[i], ary[i].EN);
+    }
+    //bulk construction in two halves, merged by union
+    bf = create_bloom_filter(n, 0.01);
+    half = create_bloom_filter(n, 0.01);
+    bloom_add_bulk(bf, hashes, n/2);
+    bloom_add_bulk(half, hashes + n/2, n - n/2);
+    bloom_union(bf, half);
+    destroy_bloom_filter(half);
+    ht_attach_filter(filtered, bf);
+    printf("filter: %u blocks (%.1f bits/key), k = %d, estimated fp %.4f\n", bf->block_count,
+           (double)bf->block_count*BLOOM_BLOCK_BITS/n, bf->k, bloom_fp_estimate(bf));
+    
+    start = clock();
+    found = 0;
+    for(int i = 0; i < n; i++)
+        found += search_ht(plain, &miss[i], miss[i].EN);
+    t_plain = (double)(clock() - start)/CLOCKS_PER_SEC;
+    start = clock();
+    for(int i = 0; i < n; i++)
+        found += search_ht(filtered, &miss[i], miss[i].EN);
+    t_filtered = (double)(clock() - start)/CLOCKS_PER_SEC;
+    fp = 0;
+    for(int i = 0; i < n; i++)
+        fp += bloom_may_contain(bf, bloom_hash_int(miss[i].EN));
+    printf("%d misses: plain %.1f Mlookups/s, filtered %.1f Mlookups/s, measured fp %.4f%s\n", n,
+           n/t_plain/1e6, n/t_filtered/1e6, (double)fp/n, found ? " FALSE HIT!" : "");
+    found = 0;
+    for(int i = 0; i < n; i++)
+        found += search_ht(filtered, &ary[i], ary[i].EN);
+    unknown.first = NULL;
+    unknown.EN = 1;
+    printf("hits through the filter: %d/%d, EN 1: %s\n", found, n, retrieve_ht(filtered, &unknown, 1) ? "FOUND?!" : "rejected");
+    free_ht(plain);
+    free_ht(filtered);
+    
+    //GRAPH: empty filter attached up front, insert_to_graph() fills it
+    size = get_line_count(vertex_file);
+    nodes = (ROUTER**)Malloc(size*sizeof(ROUTER*));
+    g = create_graph(MATRIX, UNDIRECTED, IS_WEIGHTED, size, gcompare, gprocess);
+    graph_attach_filter(g, create_bloom_filter(size, 0.01), router_hash);
+    create_sample_topology(vertex_file, links_file, g, nodes);
+    found = 0;
+    for(int i = 0; i < size; i++)
+        found += search_graph(g, nodes[i]);
+    stranger = *nodes[0];
+    stranger.ip_addr = ~stranger.ip_addr;
+    printf("routers found: %d/%d, stranger: %s\n", found, size, search_graph(g, &stranger) ? "FOUND?!" : "rejected");
+    delete_graph(g);
+    free(nodes);
+    free(hashes);
+    free(miss);
+    free(ary);
+}
+
+typedef struct cht_worker
+{
+    CONCURRENT_HT *ht;
+    int *keys;
+    int n_keys;
+    int ops;
+    unsigned int seed;
+}CHT_WORKER;
+
+//90% lookups, 10% writes split between insert and delete of random keys
+void *cht_mixed_workload(void *arg)
+{
+    CHT_WORKER *w = (CHT_WORKER*)arg;
+    int k;
+    
+    for(int i = 0; i < w->ops; i++)
+    {
+        k = rand_r(&w->seed) % w->n_keys;
+        if(i % 10 != 0)
+            cht_retrieve(w->ht, NULL, w->keys[k]);
+        else if(i % 20 == 0)
+            cht_delete(w->ht, NULL, w->keys[k]);
+        else
+            cht_insert(w->ht, &w->keys[k], w->keys[k]);
+    }
+    return NULL;
+}
+
+//throughput of the striped table from 1 to max_threads threads, wall-clock time.
+void sample_concurrent_ht_scaling(int n_keys, int ops_per_thread, int max_threads)
+{
+    CONCURRENT_HT *ht;
+    CHT_WORKER *w;
+    pthread_t *tid;
+    struct timespec t0, t1;
+    int *keys;
+    double secs;
+    
+    keys = (int*)Malloc(n_keys*sizeof(int));
+    for(int i = 0; i < n_keys; i++)
+        keys[i] = i;
+    w = (CHT_WORKER*)Malloc(max_threads*sizeof(CHT_WORKER));
+    tid = (pthread_t*)Malloc(max_threads*sizeof(pthread_t));
+    for(int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        ht = create_concurrent_ht(n_keys, NULL);
+        for(int i = 0; i < n_keys; i++)
+            cht_insert(ht, &keys[i], keys[i]);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(int t = 0; t < threads; t++)
+        {
+            w[t].ht = ht;
+            w[t].keys = keys;
+            w[t].n_keys = n_keys;
+            w[t].ops = ops_per_thread;
+            w[t].seed = t + 1;
+            pthread_create(&tid[t], NULL, cht_mixed_workload, &w[t]);
+        }
+        for(int t = 0; t < threads; t++)
+            pthread_join(tid[t], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+        printf("%2d threads: %.2f Mops/s (%d resizes)\n", threads,
+               (double)threads*ops_per_thread/secs/1e6, ht->resize_count);
+        destroy_concurrent_ht(ht);
+    }
+    free(tid);
+    free(w);
+    free(keys);
+}
+
+typedef struct lf_worker
+{
+    LF_HASH_TABLE *ht;
+    int *keys;
+    int n_keys;
+    int phase;//0: everyone inserts every key, 1: everyone deletes every key
+    int wins;//successful inserts/deletes by this thread
+    int bad_reads;//lookups that returned another key's data
+}LF_WORKER;
+
+void *lf_contended_workload(void *arg)
+{
+    LF_WORKER *w = (LF_WORKER*)arg;
+    int *data_out;
+    
+    for(int i = 0; i < w->n_keys; i++)
+    {
+        if(w->phase == 0 && lf_insert_ht(w->ht, &w->keys[i], w->keys[i]))
+            w->wins++;
+        if(w->phase == 1 && lf_delete_ht(w->ht, NULL, w->keys[i]))
+            w->wins++;
+        //a concurrent lookup may miss, but must never see the wrong entry
+        data_out = (int*)lf_retrieve_ht(w->ht, NULL, w->keys[(i*7) % w->n_keys]);
+        if(data_out && data_out != &w->keys[(i*7) % w->n_keys])
+            w->bad_reads++;
+    }
+    lf_thread_done(w->ht);
+    return NULL;
+}
+
+/*
+ LINEARIZABILITY: short bursts of random insert/delete/retrieve on a few hot keys, every call
+ stamped with a ticket taken before it is invoked and after it returns. the history of each key
+ (linearizability is local: per-key histories suffice) must have a sequential order that keeps
+ the real-time order (a call that returned before another was invoked comes first) and that a
+ plain dictionary would answer the same way. inserted satellites are the op records themselves,
+ so a retrieve says WHICH insert it saw.
+ */
+#define LF_HOT_KEYS 2
+#define LF_HOT_OPS 3 //per thread per trial: at most threads*LF_HOT_OPS ops in one key's history
+
+typedef struct lf_op
+{
+    int key;
+    char type;//'i'nsert, 'd'elete, 'r'etrieve
+    bool ok;
+    void *out;
+    unsigned long invoke, response;
+}LF_OP;
+
+typedef struct lf_hot_worker
+{
+    LF_HASH_TABLE *ht;
+    int threads;
+    int trials;
+    int id;
+    atomic_ulong *ticket;
+    atomic_int *arrived;
+    LF_OP *ops;//trials*LF_HOT_OPS
+}LF_HOT_WORKER;
+
+void *lf_hot_workload(void *arg)
+{
+    LF_HOT_WORKER *w = (LF_HOT_WORKER*)arg;
+    unsigned int seed = w->id + 1;
+    LF_OP *op;
+
+    for(int trial = 0; trial < w->trials; trial++)
+    {   //start together: every thread has arrived for this trial
+        atomic_fetch_add(w->arrived, 1);
+        while(atomic_load(w->arrived) < (trial + 1)*w->threads)
+            sched_yield();
+        for(int j = 0; j < LF_HOT_OPS; j++)
+        {
+            op = &w->ops[trial*LF_HOT_OPS + j];
+            op->key = trial*LF_HOT_KEYS + rand_r(&seed) % LF_HOT_KEYS;//fresh keys every trial
+            op->type = "iidr"[rand_r(&seed) % 4];
+            op->out = NULL;
+            op->invoke = atomic_fetch_add(w->ticket, 1);
+            if(op->type == 'i')
+                op->ok = lf_insert_ht(w->ht, op, op->key);
+            else if(op->type == 'd')
+                op->ok = lf_delete_ht(w->ht, NULL, op->key);
+            else
+                op->ok = (op->out = lf_retrieve_ht(w->ht, NULL, op->key)) != NULL;
+            op->response = atomic_fetch_add(w->ticket, 1);
+        }
+    }
+    lf_thread_done(w->ht);
+    return NULL;
+}
+
+//backtracking search (Wing & Gong): state is the satellite the key maps to, NULL if absent.
+//only an op invoked before every pending op's response can be the next linearized one.
+bool lf_linearize(LF_OP **ops, int n, uint64_t done, void *state)
+{
+    unsigned long first_response = ULONG_MAX;
+    void *next;
+
+    if(done == (n == 64 ? ~0ULL : (1ULL << n) - 1))
+        return true;
+    for(int i = 0; i < n; i++)
+    {
+        if(!(done & (1ULL << i)) && ops[i]->response < first_response)
+            first_response = ops[i]->response;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        if((done & (1ULL << i)) || ops[i]->invoke > first_response)
+            continue;
+        next = state;
+        if(ops[i]->type == 'i')
+        {
+            if(ops[i]->ok != (state == NULL))
+                continue;
+            next = ops[i]->ok ? ops[i] : state;
+        }
+        else if(ops[i]->type == 'd')
+        {
+            if(ops[i]->ok != (state != NULL))
+                continue;
+            next = NULL;
+        }
+        else if(ops[i]->out != state)
+            continue;
+        if(lf_linearize(ops, n, done | (1ULL << i), next))
+            return true;
+    }
+    return false;
+}
+
+bool lf_ht_linearizable(int threads, int trials)
+{
+    LF_HASH_TABLE *ht;
+    LF_HOT_WORKER *w;
+    pthread_t *tid;
+    atomic_ulong ticket;
+    atomic_int arrived;
+    LF_OP *history[64];
+    int n, failed = 0, checked = 0;
+
+    threads = threads*LF_HOT_OPS <= 64 ? threads : 64/LF_HOT_OPS;
+    ht = create_lf_hash_table(16);
+    atomic_init(&ticket, 0);
+    atomic_init(&arrived, 0);
+    w = (LF_HOT_WORKER*)Malloc(threads*sizeof(LF_HOT_WORKER));
+    tid = (pthread_t*)Malloc(threads*sizeof(pthread_t));
+    for(int t = 0; t < threads; t++)
+    {
+        w[t].ht = ht;
+        w[t].threads = threads;
+        w[t].trials = trials;
+        w[t].id = t;
+        w[t].ticket = &ticket;
+        w[t].arrived = &arrived;
+        w[t].ops = (LF_OP*)Malloc(trials*LF_HOT_OPS*sizeof(LF_OP));
+        pthread_create(&tid[t], NULL, lf_hot_workload, &w[t]);
+    }
+    for(int t = 0; t < threads; t++)
+        pthread_join(tid[t], NULL);
+    for(int trial = 0; trial < trials; trial++)
+    {
+        for(int k = 0; k < LF_HOT_KEYS; k++)
+        {
+            n = 0;
+            for(int t = 0; t < threads; t++)
+            {
+                for(int j = 0; j < LF_HOT_OPS; j++)
+                {
+                    if(w[t].ops[trial*LF_HOT_OPS + j].key == trial*LF_HOT_KEYS + k)
+                        history[n++] = &w[t].ops[trial*LF_HOT_OPS + j];
+                }
+            }
+            checked += n;
+            if(n && !lf_linearize(history, n, 0, NULL))
+                failed++;
+        }
+    }
+    printf("linearizability: %d ops on %d hot key histories, %d not linearizable\n",
+           checked, trials*LF_HOT_KEYS, failed);
+    destroy_lf_hash_table(ht);
+    for(int t = 0; t < threads; t++)
+        free(w[t].ops);
+    free(tid);
+    free(w);
+    return failed == 0;
+}
+
+//all threads race on the SAME keys: each key must be inserted exactly once and
+//deleted exactly once per round, and the table must agree afterwards. then the hot key
+//histories of lf_ht_linearizable() are checked.
+void sample_lf_ht_stress(int threads, int n_keys, int rounds)
+{
+    LF_HASH_TABLE *ht;
+    LF_WORKER *w;
+    pthread_t *tid;
+    int *keys, wins, bad_reads, present;
+    bool pass = true;
+    
+    keys = (int*)Malloc(n_keys*sizeof(int));
+    for(int i = 0; i < n_keys; i++)
+        keys[i] = i*31 - n_keys;//negative keys too
+    w = (LF_WORKER*)Malloc(threads*sizeof(LF_WORKER));
+    tid = (pthread_t*)Malloc(threads*sizeof(pthread_t));
+    ht = create_lf_hash_table(16);
+    for(int r = 0; r < rounds; r++)
+    {
+        for(int phase = 0; phase < 2; phase++)
+        {
+            for(int t = 0; t < threads; t++)
+            {
+                w[t].ht = ht;
+                w[t].keys = keys;
+                w[t].n_keys = n_keys;
+                w[t].phase = phase;
+                w[t].wins = w[t].bad_reads = 0;
+                pthread_create(&tid[t], NULL, lf_contended_workload, &w[t]);
+            }
+            wins = bad_reads = 0;
+            for(int t = 0; t < threads; t++)
+            {
+                pthread_join(tid[t], NULL);
+                wins += w[t].wins;
+                bad_reads += w[t].bad_reads;
+            }
+            present = 0;
+            for(int i = 0; i < n_keys; i++)
+                present += (lf_retrieve_ht(ht, NULL, keys[i]) == &keys[i]);
+            printf("round %d %s: %d successful (expect %d), %d present (expect %d), %d bad reads\n",
+                   r, phase == 0 ? "insert" : "delete", wins, n_keys, present, phase == 0 ? n_keys : 0, bad_reads);
+            if(wins != n_keys || present != (phase == 0 ? n_keys : 0) || bad_reads)
+                pass = false;
+        }
+    }
+    lf_thread_done(ht);
+    if(!lf_ht_linearizable(threads, 2000*rounds))
+        pass = false;
+    printf("LOCK-FREE STRESS %s\n", pass ? "PASSED" : "FAILED");
+    destroy_lf_hash_table(ht);
+    free(tid);
+    free(w);
+    free(keys);
+}
+
 void set_sample_prefix_table(char *in)
 {
     FILE *fp;
@@ -1343,6 +3498,387 @@ void sample_ht_with_route_fwd_table(char *input_file)
     printf("outgoing interface is %d\n", data_out->outgoing_intf);
 }
 
+uint32_t random_ipv4(void)
+{
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+//the same forwarding decision as above through a DIR-24-8 table: any prefix length, real
+//longest-prefix match, at most two memory accesses per address.
+void sample_fib_lpm(char *route_file, int n_prefixes, int n_lookups)
+{
+    FIB *fib;
+    uint32_t *addrs, prefix, sum;
+    uint8_t len;
+    int installed, r;
+    clock_t start;
+    double secs;
+    
+    fib = create_fib(1 << 16);
+    installed = fib_load(fib, route_file);
+    set_sample_prefix_table(route_file);
+    prefix = string_to_binary_ip("198.28.0.0");
+    printf("%d routes loaded. 198.28.0.0 -> intf %u (prefix24_hash: %d)\n", installed, fib_lookup(fib, prefix), prefix24_hash(prefix));
+    
+    //nested prefixes: the longest one wins, a delete falls back to the next longest
+    fib_insert(fib, string_to_binary_ip("10.0.0.0"), 8, 1);
+    fib_insert(fib, string_to_binary_ip("10.1.0.0"), 16, 2);
+    fib_insert(fib, string_to_binary_ip("10.1.1.128"), 25, 3);
+    prefix = string_to_binary_ip("10.1.1.200");
+    printf("10.1.1.200 -> intf %u", fib_lookup(fib, prefix));
+    fib_delete(fib, string_to_binary_ip("10.1.1.128"), 25);
+    printf(", after deleting /25 -> %u", fib_lookup(fib, prefix));
+    fib_delete(fib, string_to_binary_ip("10.1.0.0"), 16);
+    printf(", after deleting /16 -> %u\n", fib_lookup(fib, prefix));
+    
+    //bulk table, roughly the shape of a full table: mostly /24, some shorter, a few longer
+    for(int i = 0; i < n_prefixes; i++)
+    {
+        r = rand() % 100;
+        len = r < 55 ? 24 : r < 95 ? (uint8_t)(16 + rand() % 8) : (uint8_t)(25 + rand() % 8);
+        fib_insert(fib, random_ipv4(), len, (uint32_t)(rand() % 64));
+    }
+    printf("%u rules, %u tbl8 groups in use\n", fib->rule_count, fib->groups_used - fib->free_top);
+    addrs = (uint32_t*)Malloc(n_lookups*sizeof(uint32_t));
+    for(int i = 0; i < n_lookups; i++)
+        addrs[i] = random_ipv4();
+    sum = 0;
+    start = clock();
+    for(int i = 0; i < n_lookups; i++)
+        sum += fib_lookup(fib, addrs[i]);
+    secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("%d random lookups: %.1f Mlookups/s (checksum %u)\n", n_lookups, n_lookups/secs/1e6, sum);
+    free(addrs);
+    destroy_fib(fib);
+}
+
+#define FIB_UPDATES 1000
+/*
+ DIR-24-8 vs poptrie on the same rules: memory, and lookup rate for
+ uniformly random addresses (mostly one tbl24 access / one direct entry) and for addresses
+ drawn from the installed prefixes, the way real traffic concentrates on routed space.
+ */
+void sample_fib_backends(char *route_file, int n_prefixes, int n_lookups)
+{
+    FIB *fib;
+    POPTRIE *pt;
+    uint32_t *prefixes, *addrs, sum_fib, sum_pt, mismatches;
+    uint8_t *lens;
+    int r, updates[FIB_UPDATES];
+    clock_t start;
+    double secs_fib, secs_pt;
+    
+    fib = create_fib(1 << 16);
+    pt = create_poptrie();
+    fib_load(fib, route_file);
+    poptrie_load(pt, route_file);
+    prefixes = (uint32_t*)Malloc(n_prefixes*sizeof(uint32_t));
+    lens = (uint8_t*)Malloc(n_prefixes*sizeof(uint8_t));
+    start = clock();
+    poptrie_batch_begin(pt);
+    for(int i = 0; i < n_prefixes; i++)
+    {
+        r = rand() % 100;
+        lens[i] = r < 55 ? 24 : r < 95 ? (uint8_t)(16 + rand() % 8) : (uint8_t)(25 + rand() % 8);
+        prefixes[i] = random_ipv4() & FIB_MASK(lens[i]);
+        r = rand() % 64;
+        fib_insert(fib, prefixes[i], lens[i], (uint32_t)r);
+        poptrie_insert(pt, prefixes[i], lens[i], (uint32_t)r);
+    }
+    poptrie_batch_end(pt);
+    printf("%u rules loaded into both in %.2fs\n", fib->rule_count, (double)(clock() - start)/CLOCKS_PER_SEC);
+    //incremental updates: each one recompiles only the /16 it falls in
+    for(int i = 0; i < FIB_UPDATES; i++)
+    {
+        updates[i] = rand() % n_prefixes;
+        fib_insert(fib, prefixes[updates[i]], lens[updates[i]], (uint32_t)i % 64);
+    }
+    start = clock();
+    for(int i = 0; i < FIB_UPDATES; i++)
+    {
+        r = updates[i];
+        poptrie_delete(pt, prefixes[r], lens[r]);
+        poptrie_insert(pt, prefixes[r], lens[r], (uint32_t)i % 64);
+    }
+    printf("poptrie: %.1f us per update\n", (double)(clock() - start)/CLOCKS_PER_SEC/(2*FIB_UPDATES)*1e6);
+    printf("MEMORY: DIR-24-8 %.1f MB, poptrie %.1f MB (%u nodes, %u leaves)\n",
+           (FIB_TBL24_SIZE + (double)(fib->groups_used - fib->free_top)*FIB_GROUP_SIZE)*sizeof(uint32_t)/1e6,
+           poptrie_memory(pt)/1e6, pt->node_count, pt->leaf_count);
+    addrs = (uint32_t*)Malloc(n_lookups*sizeof(uint32_t));
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(int i = 0; i < n_lookups; i++)
+        {
+            if(pass == 0)
+                addrs[i] = random_ipv4();
+            else
+            {
+                r = rand() % n_prefixes;
+                addrs[i] = prefixes[r] | (random_ipv4() & ~FIB_MASK(lens[r]));
+            }
+        }
+        sum_fib = sum_pt = mismatches = 0;
+        start = clock();
+        for(int i = 0; i < n_lookups; i++)
+            sum_fib += fib_lookup(fib, addrs[i]);
+        secs_fib = (double)(clock() - start)/CLOCKS_PER_SEC;
+        start = clock();
+        for(int i = 0; i < n_lookups; i++)
+            sum_pt += poptrie_lookup(pt, addrs[i]);
+        secs_pt = (double)(clock() - start)/CLOCKS_PER_SEC;
+        for(int i = 0; i < n_lookups; i += 64)
+            mismatches += fib_lookup(fib, addrs[i]) != poptrie_lookup(pt, addrs[i]);
+        printf("%s addresses: DIR-24-8 %.1f Mlookups/s, poptrie %.1f Mlookups/s, %s\n",
+               pass == 0 ? "random" : "routed", n_lookups/secs_fib/1e6, n_lookups/secs_pt/1e6,
+               sum_fib == sum_pt && mismatches == 0 ? "same next hops" : "RESULTS DIFFER!!");
+    }
+    free(addrs);
+    free(lens);
+    free(prefixes);
+    destroy_poptrie(pt);
+    destroy_fib(fib);
+}
+
+#define FIB_MARKERS 16 //10.0-15.0.0/16, plus 10.x.7.128/25 in odd generations
+
+typedef struct fib_rcu_worker
+{
+    FIB_RCU *fr;
+    atomic_int *stop;
+    uint64_t lookups;
+    uint64_t torn;//batches that mixed two generations
+    unsigned int seed;
+}FIB_RCU_WORKER;
+
+//data plane: batches of FIB_BULK, half of them on the routes the control plane keeps changing.
+//every marker route of a generation has the same next hop, so one batch must see one value.
+void *fib_rcu_reader_workload(void *arg)
+{
+    FIB_RCU_WORKER *w = (FIB_RCU_WORKER*)arg;
+    uint32_t addrs[FIB_BULK], hops[FIB_BULK];
+    int reader = fib_rcu_register_reader(w->fr);
+    
+    while(!atomic_load_explicit(w->stop, memory_order_relaxed))
+    {
+        for(int k = 0; k < FIB_BULK; k++)
+        {
+            if(k % 2)
+                addrs[k] = (uint32_t)rand_r(&w->seed) << 1 ^ (uint32_t)rand_r(&w->seed);
+            else//10.x.1.1 hits the /16, 10.x.7.200 the /25 when it exists
+                addrs[k] = 0x0a000000 | (uint32_t)(rand_r(&w->seed) % FIB_MARKERS) << 16 | (k % 4 ? 0x0101 : 0x07c8);
+        }
+        fib_rcu_lookup_bulk(w->fr, reader, addrs, hops, FIB_BULK);
+        for(int k = 2; k < FIB_BULK; k += 2)
+            if(hops[k] != hops[0])
+            {
+                w->torn++;
+                break;
+            }
+        w->lookups += FIB_BULK;
+    }
+    return NULL;
+}
+
+/*
+ 1) batch lookups vs one at a time on the same table.
+ 2) readers run batches without locks while the control plane rewrites the marker routes and
+    publishes, over and over. no batch may see half of a publish.
+ */
+void sample_fib_rcu(char *route_file, int n_prefixes, int n_lookups, int readers, int publishes)
+{
+    FIB_RCU *fr;
+    FIB *fib;
+    FIB_RCU_WORKER *w;
+    pthread_t *tid;
+    atomic_int stop;
+    uint32_t *addrs, *hops, prefix, mismatches;
+    uint64_t lookups, torn;
+    uint8_t len;
+    int r, reader, batched;
+    clock_t start;
+    double secs_one, secs_bulk;
+    struct timespec t0, t1;
+    
+    fr = create_fib_rcu(1 << 16);
+    fib_rcu_load(fr, route_file);
+    for(int i = 0; i < n_prefixes; i++)
+    {
+        r = rand() % 100;
+        len = r < 55 ? 24 : r < 95 ? (uint8_t)(16 + rand() % 8) : (uint8_t)(25 + rand() % 8);
+        prefix = random_ipv4();
+        if((prefix >> 24) != 10)//keep 10/8 for the marker routes
+            fib_rcu_insert(fr, prefix, len, (uint32_t)(rand() % 64));
+    }
+    fib_rcu_publish(fr);
+    
+    //1) one snapshot, one thread
+    reader = fib_rcu_register_reader(fr);
+    fib = fib_rcu_read_begin(fr, reader);
+    addrs = (uint32_t*)Malloc(n_lookups*sizeof(uint32_t));
+    hops = (uint32_t*)Malloc(n_lookups*sizeof(uint32_t));
+    for(int i = 0; i < n_lookups; i++)
+    {
+        addrs[i] = random_ipv4();
+        hops[i] = 0;//page in the output before timing
+    }
+    start = clock();
+    for(int i = 0; i < n_lookups; i++)
+        hops[i] = fib_lookup(fib, addrs[i]);
+    secs_one = (double)(clock() - start)/CLOCKS_PER_SEC;
+    batched = n_lookups - n_lookups % FIB_BULK;
+    start = clock();
+    for(int i = 0; i < batched; i += FIB_BULK)
+        fib_lookup_bulk(fib, &addrs[i], &hops[i], FIB_BULK);
+    secs_bulk = (double)(clock() - start)/CLOCKS_PER_SEC;
+    mismatches = 0;
+    for(int i = 0; i < batched; i++)
+        mismatches += hops[i] != fib_lookup(fib, addrs[i]);
+    fib_rcu_read_end(fr, reader);
+#if defined(__AVX2__)
+    printf("one at a time %.1f Mlookups/s, batches of %d (AVX2 gathers) %.1f Mlookups/s, %u mismatches\n",
+#else
+    printf("one at a time %.1f Mlookups/s, batches of %d (scalar) %.1f Mlookups/s, %u mismatches\n",
+#endif
+           n_lookups/secs_one/1e6, FIB_BULK, batched/secs_bulk/1e6, mismatches);
+    
+    //2) readers vs a control plane that never stops publishing
+    atomic_init(&stop, 0);
+    w = (FIB_RCU_WORKER*)Malloc(readers*sizeof(FIB_RCU_WORKER));
+    tid = (pthread_t*)Malloc(readers*sizeof(pthread_t));
+    for(int t = 0; t < readers; t++)
+    {
+        w[t].fr = fr;
+        w[t].stop = &stop;
+        w[t].lookups = w[t].torn = 0;
+        w[t].seed = t + 1;
+        pthread_create(&tid[t], NULL, fib_rcu_reader_workload, &w[t]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int g = 1; g <= publishes; g++)
+    {
+        for(uint32_t x = 0; x < FIB_MARKERS; x++)
+        {
+            fib_rcu_insert(fr, 0x0a000000 | x << 16, 16, (uint32_t)g);
+            if(g % 2)
+                fib_rcu_insert(fr, 0x0a000780 | x << 16, 25, (uint32_t)g);
+            else
+                fib_rcu_delete(fr, 0x0a000780 | x << 16, 25);
+        }
+        fib_rcu_publish(fr);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    atomic_store(&stop, 1);
+    lookups = torn = 0;
+    for(int t = 0; t < readers; t++)
+    {
+        pthread_join(tid[t], NULL);
+        lookups += w[t].lookups;
+        torn += w[t].torn;
+    }
+    printf("%d readers, %d publishes of %d route changes in %.2fs: %.1f Mlookups/s total, %llu torn batches\n",
+           readers, publishes, 2*FIB_MARKERS, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9,
+           lookups/((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9)/1e6, (unsigned long long)torn);
+    free(tid);
+    free(w);
+    free(hops);
+    free(addrs);
+    destroy_fib_rcu(fr);
+}
+
+//prefix/len with the remaining bits random
+void random_ipv6(uint8_t addr[16], const uint8_t prefix[16], uint8_t len)
+{
+    for(int i = 0; i < 16; i++)
+    {
+        addr[i] = (uint8_t)rand();
+        if(8*i + 8 <= len)
+            addr[i] = prefix[i];
+        else if(8*i < len)
+            addr[i] = (prefix[i] & (uint8_t)(0xff << (8 - len % 8))) | (addr[i] & (uint8_t)(0xff >> len % 8));
+    }
+}
+
+/*
+ IPv6 next to the IPv4 table. the bulk table mimics a default-free one: /29../32 allocations
+ inside 2000::/3, most routes /48 under them, the rest /33../64 and a few hosts.
+ */
+void sample_fib6_lpm(char *route_file, int n_prefixes, int n_lookups)
+{
+    FIB6 *fib;
+    uint8_t (*allocs)[16], (*addrs)[16], addr[16], prefix[16], len, *alloc_len;
+    uint32_t sum, routed;
+    char text[INET6_ADDRSTRLEN];
+    const char *probes[] = {"2001:db8:10:20::1", "2001:db8:10:20::2", "2001:db8:10:30::1", "2001:db8:1fff::1", "2001:db9::1"};
+    int n_allocs, a, r;
+    clock_t start;
+    
+    fib = create_fib6(1024);
+    printf("%d routes loaded\n", fib6_load(fib, route_file));
+    for(int i = 0; i < 5; i++)
+    {
+        inet_pton(AF_INET6, probes[i], addr);
+        printf("%s -> %u\n", probes[i], fib6_lookup(fib, addr));
+    }
+    inet_pton(AF_INET6, "2001:db8:10::", prefix);
+    fib6_delete(fib, prefix, 48);
+    inet_pton(AF_INET6, probes[2], addr);
+    printf("after deleting 2001:db8:10::/48, %s -> %u\n", probes[2], fib6_lookup(fib, addr));
+    
+    n_allocs = n_prefixes/10 + 1;
+    allocs = (uint8_t(*)[16])Malloc(n_allocs*16);
+    alloc_len = (uint8_t*)Malloc(n_allocs);
+    memset(prefix, 0, 16);
+    prefix[0] = 0x20;
+    for(a = 0; a < n_allocs; a++)
+    {
+        alloc_len[a] = (uint8_t)(29 + rand() % 4);
+        random_ipv6(allocs[a], prefix, 3);
+        fib6_insert(fib, allocs[a], alloc_len[a], (uint32_t)(rand() % 256));
+    }
+    start = clock();
+    for(int i = n_allocs; i < n_prefixes; i++)
+    {
+        a = rand() % n_allocs;
+        r = rand() % 100;
+        len = r < 60 ? 48 : r < 75 ? (uint8_t)(33 + rand() % 15) : r < 97 ? (uint8_t)(49 + rand() % 16) : 128;
+        random_ipv6(addr, allocs[a], alloc_len[a]);
+        fib6_insert(fib, addr, len, (uint32_t)(rand() % 256));
+    }
+    printf("%u rules (%.2f us per insert), %.1f MB in use\n", fib->rule_count,
+           (double)(clock() - start)/CLOCKS_PER_SEC/(n_prefixes - n_allocs)*1e6, fib6_memory(fib)/1e6);
+    
+    addrs = (uint8_t(*)[16])Malloc((size_t)n_lookups*16);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(int i = 0; i < n_lookups; i++)
+        {
+            if(pass == 0)
+                random_ipv6(addrs[i], prefix, 3);
+            else
+            {
+                a = rand() % n_allocs;
+                random_ipv6(addrs[i], allocs[a], (uint8_t)(alloc_len[a] + rand() % 24));
+            }
+        }
+        sum = routed = 0;
+        start = clock();
+        for(int i = 0; i < n_lookups; i++)
+        {
+            r = fib6_lookup(fib, addrs[i]);
+            sum += r;
+            routed += r != (int)FIB6_NO_ROUTE;
+        }
+        printf("%s: %.1f Mlookups/s, %u of %d routed (checksum %u)\n", pass == 0 ? "random in 2000::/3" : "inside allocations",
+               n_lookups/((double)(clock() - start)/CLOCKS_PER_SEC)/1e6, routed, n_lookups, sum);
+    }
+    inet_ntop(AF_INET6, allocs[0], text, sizeof(text));
+    printf("first allocation %s/%u\n", text, alloc_len[0]);
+    free(addrs);
+    free(alloc_len);
+    free(allocs);
+    destroy_fib6(fib);
+}
+
 int compare2(void *arg1, void *arg2)
 {
     PERSON *a, *b;
@@ -0,0 +1,343 @@
+/* PERSISTENT HASH TABLE: ON-DISK FORMAT, OPENED WITH MMAP */
+
+#ifndef mmap_hash_table_h
+#define mmap_hash_table_h
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wrappers.h"
+#include "hash_table.h"
+
+/*
+ the file IS the table: opening it is one mmap(), no parsing and no re-inserting, so restart
+ cost does not depend on the table size. lookups return pointers straight into the mapping.
+
+ FILE LAYOUT (all offsets in bytes from the start of the file, 0 means "none"):
+   [header, 64 bytes][slots: slot_count x uint64 offset of the first record][records...]
+   record: {uint64 next; int32 key; uint32 flags; value[value_size]} padded to 8 bytes.
+ chains link records by file offset, never by pointer, so the file maps at any address.
+
+ updates only append: insert writes the record at the end, then publishes it by storing its
+ offset into the slot (a torn write leaves an unreachable record, never a broken chain).
+ an insert of an existing key appends the new version and marks the old one dead, delete only
+ marks. mht_compact() rewrites the live records into a fresh file and renames it over the old.
+ pointers from mht_retrieve() are valid until the next insert (the mapping may move on growth).
+ */
+#define MHT_MAGIC 0x3154484d //"MHT1"
+#define MHT_VERSION 1
+#define MHT_DEAD 0x1
+#define MHT_MAX_LOAD 2 //live records per slot that mht_compact() sizes the slots for
+#define MHT_MIN_GROW (1 << 20) //bytes the file grows by at least
+
+typedef struct mht_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed;//mixed into the hash of every key
+    uint32_t slot_count;
+    uint32_t value_size;
+    uint32_t record_size;
+    uint64_t live;//records reachable and not dead
+    uint64_t dead;//garbage that mht_compact() reclaims
+    uint64_t end;//offset of the first free byte
+    uint64_t capacity;//file size
+    uint8_t pad[8];
+}MHT_HEADER;
+
+typedef struct mht_record
+{
+    uint64_t next;
+    int32_t key;
+    uint32_t flags;
+    unsigned char value[];
+}MHT_RECORD;
+
+typedef struct mmap_hash_table
+{
+    int fd;
+    char *file;
+    unsigned char *base;
+    MHT_HEADER *header;
+    uint64_t *slots;
+    uint64_t records;//offset of the first record, right after the slots
+}MMAP_HT;
+
+MMAP_HT *mht_create(char *file, uint32_t slot_count, uint32_t value_size, uint32_t seed);
+MMAP_HT *mht_open(char *file);
+bool mht_insert(MMAP_HT *mht, int key, const void *value);
+void *mht_retrieve(MMAP_HT *mht, int key);
+bool mht_delete(MMAP_HT *mht, int key);
+MMAP_HT *mht_compact(MMAP_HT *mht);
+void mht_sync(MMAP_HT *mht);
+void mht_close(MMAP_HT *mht);
+MHT_RECORD *_mht_find(MMAP_HT *mht, int key);
+bool _mht_link_ok(MMAP_HT *mht, uint64_t off, uint64_t from);
+bool _mht_map(MMAP_HT *mht, uint64_t size);
+bool _mht_grow(MMAP_HT *mht, uint64_t need);
+
+#define MHT_RECORD_AT(mht, off) ((MHT_RECORD*)((mht)->base + (off)))
+#define MHT_SLOT(mht, key) (bucket_hash((int)((uint32_t)(key) ^ (mht)->header->seed)) % (mht)->header->slot_count)
+
+bool _mht_map(MMAP_HT *mht, uint64_t size)
+{
+    void *base = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, mht->fd, 0);
+
+    if(base == MAP_FAILED)
+    {
+        printf("ERROR: MMAP OF %s FAILED!!\n", mht->file);
+        return false;
+    }
+    mht->base = (unsigned char*)base;
+    mht->header = (MHT_HEADER*)base;
+    mht->slots = (uint64_t*)(mht->base + sizeof(MHT_HEADER));
+    mht->records = sizeof(MHT_HEADER) + (uint64_t)mht->header->slot_count*sizeof(uint64_t);
+    return true;
+}
+
+MMAP_HT *mht_create(char *file, uint32_t slot_count, uint32_t value_size, uint32_t seed)
+{
+    MMAP_HT *mht;
+    uint64_t size;
+
+    if(slot_count == 0)
+        slot_count = 1;
+    mht = (MMAP_HT*)Malloc(sizeof(MMAP_HT));
+    mht->file = strdup(file);
+    if((mht->fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+        FOPEN_ERROR;
+        free(mht->file);
+        free(mht);
+        return NULL;
+    }
+    size = sizeof(MHT_HEADER) + (uint64_t)slot_count*sizeof(uint64_t) + MHT_MIN_GROW;
+    //ftruncate zero-fills: every slot starts out empty
+    if(ftruncate(mht->fd, (off_t)size) != 0 || !_mht_map(mht, size))
+    {
+        close(mht->fd);
+        free(mht->file);
+        free(mht);
+        return NULL;
+    }
+    mht->header->magic = MHT_MAGIC;
+    mht->header->version = MHT_VERSION;
+    mht->header->seed = seed;
+    mht->header->slot_count = slot_count;
+    mht->header->value_size = value_size;
+    mht->header->record_size = (uint32_t)((sizeof(MHT_RECORD) + value_size + 7) & ~(size_t)7);
+    mht->header->live = 0;
+    mht->header->dead = 0;
+    mht->header->end = sizeof(MHT_HEADER) + (uint64_t)slot_count*sizeof(uint64_t);
+    mht->header->capacity = size;
+    mht->records = mht->header->end;
+    return mht;
+}
+
+//O(1) in the table size: map it and go. NULL if the file is missing or not a table.
+//the header is checked so that the slots and records it describes lie inside the mapping;
+//the chains are checked as they are walked, by _mht_link_ok().
+MMAP_HT *mht_open(char *file)
+{
+    MMAP_HT *mht;
+    struct stat st;
+
+    mht = (MMAP_HT*)Malloc(sizeof(MMAP_HT));
+    mht->file = strdup(file);
+    if((mht->fd = open(file, O_RDWR)) == -1)
+    {
+        free(mht->file);
+        free(mht);
+        return NULL;
+    }
+    if(fstat(mht->fd, &st) != 0 || (uint64_t)st.st_size < sizeof(MHT_HEADER) || !_mht_map(mht, (uint64_t)st.st_size))
+    {
+        close(mht->fd);
+        free(mht->file);
+        free(mht);
+        return NULL;
+    }
+    if(mht->header->magic != MHT_MAGIC || mht->header->version != MHT_VERSION
+       || mht->header->capacity != (uint64_t)st.st_size || mht->header->end > mht->header->capacity
+       || mht->header->slot_count == 0 || mht->records > mht->header->end
+       || mht->header->record_size != ((sizeof(MHT_RECORD) + (uint64_t)mht->header->value_size + 7) & ~(uint64_t)7))
+    {
+        printf("ERROR: %s IS NOT A HASH TABLE FILE!!\n", file);
+        munmap(mht->base, (size_t)st.st_size);
+        close(mht->fd);
+        free(mht->file);
+        free(mht);
+        return NULL;
+    }
+    return mht;
+}
+
+//the mapping moves: every pointer into the old one is stale afterwards.
+bool _mht_grow(MMAP_HT *mht, uint64_t need)
+{
+    uint64_t old_size, new_size;
+
+    old_size = mht->header->capacity;
+    new_size = 2*old_size;
+    if(new_size < need)
+        new_size = need;
+    if(new_size - old_size < MHT_MIN_GROW)
+        new_size = old_size + MHT_MIN_GROW;
+    if(ftruncate(mht->fd, (off_t)new_size) != 0)
+    {
+        printf("ERROR: CANNOT GROW %s!!\n", mht->file);
+        return false;
+    }
+    munmap(mht->base, (size_t)old_size);
+    if(!_mht_map(mht, new_size))
+    {
+        mht->base = NULL;//unusable from here on, only mht_close() is safe
+        return false;
+    }
+    mht->header->capacity = new_size;
+    return true;
+}
+
+/*
+ a link the appends can have made: a whole, aligned record between the slots and end, and
+ below the record (or slot, from = UINT64_MAX) it hangs off, since a record only ever links to
+ records written before it. this also means a corrupt chain cannot loop.
+ */
+bool _mht_link_ok(MMAP_HT *mht, uint64_t off, uint64_t from)
+{
+    return off >= mht->records && off < from && !(off & 7)
+           && off + mht->header->record_size <= mht->header->end;
+}
+
+//NULL on a corrupt chain, as if the key were not there
+MHT_RECORD *_mht_find(MMAP_HT *mht, int key)
+{
+    MHT_RECORD *rec;
+
+    for(uint64_t off = mht->slots[MHT_SLOT(mht, key)], from = UINT64_MAX; off; from = off, off = rec->next)
+    {
+        if(!_mht_link_ok(mht, off, from))
+        {
+            printf("ERROR: %s IS CORRUPT!!\n", mht->file);
+            return NULL;
+        }
+        rec = MHT_RECORD_AT(mht, off);
+        if(rec->key == key && !(rec->flags & MHT_DEAD))
+            return rec;
+    }
+    return NULL;
+}
+
+//appends a new version; an older live version of the key is marked dead.
+bool mht_insert(MMAP_HT *mht, int key, const void *value)
+{
+    MHT_RECORD *rec, *old;
+    uint64_t off;
+    uint32_t slot;
+
+    if(mht->header->end + mht->header->record_size > mht->header->capacity
+       && !_mht_grow(mht, mht->header->end + mht->header->record_size))
+        return false;
+    slot = MHT_SLOT(mht, key);
+    off = mht->header->end;
+    rec = MHT_RECORD_AT(mht, off);
+    rec->next = mht->slots[slot];
+    rec->key = key;
+    rec->flags = 0;
+    memcpy(rec->value, value, mht->header->value_size);
+    mht->header->end += mht->header->record_size;
+    old = _mht_find(mht, key);
+    mht->slots[slot] = off;//publish: the record is complete before it is reachable
+    if(old)
+    {
+        old->flags |= MHT_DEAD;
+        mht->header->dead++;
+    }
+    else
+        mht->header->live++;
+    return true;
+}
+
+//zero-copy: the pointer is into the mapping, writes through it land in the file.
+void *mht_retrieve(MMAP_HT *mht, int key)
+{
+    MHT_RECORD *rec = _mht_find(mht, key);
+
+    return rec ? rec->value : NULL;
+}
+
+bool mht_delete(MMAP_HT *mht, int key)
+{
+    MHT_RECORD *rec = _mht_find(mht, key);
+
+    if(!rec)
+        return false;
+    rec->flags |= MHT_DEAD;
+    mht->header->live--;
+    mht->header->dead++;
+    return true;
+}
+
+//writes the live records into <file>.compact with the slots resized for the live count,
+//then renames it over the original. returns the new table (the old handle is closed),
+//or the old one untouched if anything fails.
+MMAP_HT *mht_compact(MMAP_HT *mht)
+{
+    MMAP_HT *fresh;
+    MHT_RECORD *rec;
+    char *tmp;
+    uint32_t slot_count;
+
+    tmp = (char*)Malloc(strlen(mht->file) + sizeof(".compact"));
+    sprintf(tmp, "%s.compact", mht->file);
+    slot_count = (uint32_t)(mht->header->live/MHT_MAX_LOAD + 1);
+    if(!(fresh = mht_create(tmp, slot_count, mht->header->value_size, mht->header->seed)))
+    {
+        free(tmp);
+        return mht;
+    }
+    for(uint32_t s = 0; s < mht->header->slot_count; s++)
+    {
+        for(uint64_t off = mht->slots[s], from = UINT64_MAX; off; from = off, off = rec->next)
+        {
+            rec = _mht_link_ok(mht, off, from) ? MHT_RECORD_AT(mht, off) : NULL;
+            if(!rec)
+                printf("ERROR: %s IS CORRUPT!!\n", mht->file);
+            if(!rec || (!(rec->flags & MHT_DEAD) && !mht_insert(fresh, rec->key, rec->value)))
+            {
+                mht_close(fresh);
+                unlink(tmp);
+                free(tmp);
+                return mht;
+            }
+        }
+    }
+    mht_sync(fresh);
+    if(rename(tmp, mht->file) != 0)
+    {
+        printf("ERROR: CANNOT REPLACE %s!!\n", mht->file);
+        mht_close(fresh);
+        unlink(tmp);
+        free(tmp);
+        return mht;
+    }
+    free(fresh->file);
+    fresh->file = strdup(mht->file);
+    mht_close(mht);
+    free(tmp);
+    return fresh;
+}
+
+void mht_sync(MMAP_HT *mht)
+{
+    msync(mht->base, (size_t)mht->header->capacity, MS_SYNC);
+}
+
+void mht_close(MMAP_HT *mht)
+{
+    if(mht->base)
+        munmap(mht->base, (size_t)mht->header->capacity);
+    close(mht->fd);
+    free(mht->file);
+    free(mht);
+}
+#endif /* mmap_hash_table_h */
@@ -0,0 +1,169 @@
+/* MULTIQUEUE: RELAXED CONCURRENT PRIORITY QUEUE OVER c*p LOCKED HEAPS */
+
+#ifndef multiqueue_h
+#define multiqueue_h
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "wrappers.h"
+#include "typed_heap.h"
+
+/*
+ insert and delete_min from any thread, without one lock that every thread waits on.
+   c*p sequential heaps (p threads, c a small factor, 2-4), each behind its own lock.
+   insert: a random heap; if its lock is busy, another random heap.
+   delete_min: two random heaps, lock the one whose minimum is smaller and pop it. the minimums are
+   read without locking from a copy of each heap's top key kept next to its lock.
+ the result is relaxed: delete_min returns one of the smallest keys, not always the smallest, with
+ an expected rank error of O(c*p) (how many smaller keys were still queued). what it buys is that
+ threads almost never meet on a lock.
+ entries are {key, data} stored inline (TYPED_HEAP): the unlocked peek needs the key as a value,
+ a compare callback on void* could read an element another thread is popping.
+ keys are 0 .. UINT64_MAX - 1: UINT64_MAX is how a heap's top says it is empty, mq_insert() rejects it.
+ */
+#define MQ_EMPTY UINT64_MAX //top key of an empty heap
+#define MQ_TRIES 8 //random two-choice attempts before delete_min scans every heap for work
+
+typedef struct mq_entry
+{
+    uint64_t key;
+    void *data;
+}MQ_ENTRY;
+
+#define MQ_LESS(a, b) ((a)->key < (b)->key)
+TYPED_HEAP(MQ_HEAP, mq_heap, MQ_ENTRY, MQ_LESS, 4)
+
+//one per cache line: a thread spinning on one heap does not slow the neighbours
+typedef struct mq_queue
+{
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    atomic_uint_fast64_t top;//key at the root, MQ_EMPTY if none
+    MQ_HEAP *heap;
+}MQ_QUEUE;
+
+typedef struct multiqueue
+{
+    MQ_QUEUE *queues;
+    int queue_count;
+}MULTIQUEUE;
+
+MULTIQUEUE *create_multiqueue(int threads, int c);
+bool mq_insert(MULTIQUEUE *mq, uint64_t key, void *data_in);
+bool mq_delete_min(MULTIQUEUE *mq, uint64_t *key_out, void **data_out);
+void destroy_multiqueue(MULTIQUEUE *mq);
+uint32_t _mq_random(void);
+bool _mq_pop(MQ_QUEUE *q, uint64_t *key_out, void **data_out);
+
+MULTIQUEUE *create_multiqueue(int threads, int c)
+{
+    MULTIQUEUE *mq = (MULTIQUEUE*)Malloc(sizeof(MULTIQUEUE));
+
+    mq->queue_count = (threads > 0 ? threads : 1)*(c > 1 ? c : 2);
+    mq->queues = (MQ_QUEUE*)Malloc_aligned(CACHE_LINE_SIZE, mq->queue_count*sizeof(MQ_QUEUE));
+    for(int i = 0; i < mq->queue_count; i++)
+    {
+        pthread_mutex_init(&mq->queues[i].lock, NULL);
+        atomic_init(&mq->queues[i].top, MQ_EMPTY);
+        mq->queues[i].heap = create_mq_heap(64);
+    }
+    return mq;
+}
+
+//per-thread xorshift, seeded from the thread's own address on first use
+uint32_t _mq_random(void)
+{
+    static _Thread_local uint32_t state;
+
+    if(state == 0)
+        state = (uint32_t)((uintptr_t)&state >> 4) ^ (uint32_t)time(NULL) ^ 0x9e3779b9U;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//false for key MQ_EMPTY: queued, its heap would look empty and delete_min would skip it
+bool mq_insert(MULTIQUEUE *mq, uint64_t key, void *data_in)
+{
+    MQ_QUEUE *q;
+    MQ_ENTRY entry;
+
+    if(key == MQ_EMPTY)
+    {
+        INDEX_ERROR;
+        return false;
+    }
+    do
+        q = &mq->queues[_mq_random() % mq->queue_count];
+    while(pthread_mutex_trylock(&q->lock) != 0);
+    entry.key = key;
+    entry.data = data_in;
+    mq_heap_insert(q->heap, entry);
+    atomic_store_explicit(&q->top, mq_heap_peek(q->heap)->key, memory_order_release);
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+//q is locked by the caller
+bool _mq_pop(MQ_QUEUE *q, uint64_t *key_out, void **data_out)
+{
+    MQ_ENTRY entry;
+    MQ_ENTRY *top;
+
+    if(!mq_heap_get_min(q->heap, &entry))
+        return false;
+    top = mq_heap_peek(q->heap);
+    atomic_store_explicit(&q->top, top ? top->key : MQ_EMPTY, memory_order_release);
+    *key_out = entry.key;
+    *data_out = entry.data;
+    return true;
+}
+
+//false only if every heap was seen empty
+bool mq_delete_min(MULTIQUEUE *mq, uint64_t *key_out, void **data_out)
+{
+    MQ_QUEUE *a, *b;
+    bool popped;
+
+    for(int tries = 0; tries < MQ_TRIES; tries++)
+    {
+        a = &mq->queues[_mq_random() % mq->queue_count];
+        b = &mq->queues[_mq_random() % mq->queue_count];
+        if(atomic_load_explicit(&b->top, memory_order_acquire) < atomic_load_explicit(&a->top, memory_order_acquire))
+            a = b;
+        if(atomic_load_explicit(&a->top, memory_order_acquire) == MQ_EMPTY)
+            continue;
+        if(pthread_mutex_trylock(&a->lock) != 0)
+            continue;
+        popped = _mq_pop(a, key_out, data_out);
+        pthread_mutex_unlock(&a->lock);
+        if(popped)
+            return true;
+    }
+    //few entries left: sweep every heap before calling the queue empty
+    for(int i = 0; i < mq->queue_count; i++)
+    {
+        a = &mq->queues[i];
+        if(atomic_load_explicit(&a->top, memory_order_acquire) == MQ_EMPTY)
+            continue;
+        pthread_mutex_lock(&a->lock);
+        popped = _mq_pop(a, key_out, data_out);
+        pthread_mutex_unlock(&a->lock);
+        if(popped)
+            return true;
+    }
+    return false;
+}
+
+//no thread may be using mq
+void destroy_multiqueue(MULTIQUEUE *mq)
+{
+    for(int i = 0; i < mq->queue_count; i++)
+    {
+        pthread_mutex_destroy(&mq->queues[i].lock);
+        destroy_mq_heap(mq->queues[i].heap);
+    }
+    free(mq->queues);
+    free(mq);
+}
+#endif /* multiqueue_h */
@@ -0,0 +1,279 @@
+/* PAIRING HEAP: POOLED NODES, STABLE HANDLES, MELD AND DECREASE-KEY */
+
+#ifndef pairing_heap_h
+#define pairing_heap_h
+#include "wrappers.h"
+
+/*
+ a min heap ordered by compare(a, b) < 0 like HEAP_ADT, but a tree of nodes instead of an array:
+   every node keeps its leftmost child, its right sibling (next) and prev: the left sibling, or
+   the parent when it is the leftmost child. a node never moves, so the node returned by insert
+   is a handle for decrease-key and delete until the element leaves the heap.
+   link: the larger of two roots becomes the leftmost child of the smaller. insert, meld and
+   decrease-key are one link each (decrease-key cuts the subtree loose first): O(1).
+   get_min: the root's children are linked in pairs left to right, then the pairs are linked right
+   to left into one root (two-pass): O(log n) amortized.
+ nodes come from a PAIRING_POOL: blocks of PAIRING_BLOCK_NODES, freed nodes on a free list, like the
+ chained hash table's arena. heaps that are melded must share their pool; a heap created with a
+ NULL pool gets a private one.
+ */
+#define PAIRING_BLOCK_NODES 256
+
+typedef struct pairing_node
+{
+    void *data;
+    struct pairing_node *child;//leftmost child
+    struct pairing_node *next;//right sibling
+    struct pairing_node *prev;//left sibling, parent if leftmost, NULL for the root
+}PAIRING_NODE;
+
+typedef struct pairing_block
+{
+    struct pairing_block *next;
+    PAIRING_NODE nodes[PAIRING_BLOCK_NODES];
+}PAIRING_BLOCK;
+
+typedef struct pairing_pool
+{
+    PAIRING_BLOCK *blocks;//newest block first
+    PAIRING_NODE *free_list;//chained through next
+    int used;//nodes handed out from the newest block
+    int block_count;
+}PAIRING_POOL;
+
+typedef struct pairing_heap
+{
+    int (*compare)(void *arg1, void *arg2);
+    PAIRING_NODE *root;
+    int count;
+    PAIRING_POOL *pool;
+    bool own_pool;
+}PAIRING_HEAP;
+
+PAIRING_POOL *create_pairing_pool(void);
+void destroy_pairing_pool(PAIRING_POOL *pool);
+PAIRING_HEAP *create_pairing_heap(int (*compare)(void *arg1, void *arg2), PAIRING_POOL *pool);
+PAIRING_NODE *pairing_heap_insert(PAIRING_HEAP *heap, void *data_in);
+void *pairing_heap_peek(PAIRING_HEAP *heap);
+void *pairing_heap_get_min(PAIRING_HEAP *heap);
+void pairing_heap_decrease_key(PAIRING_HEAP *heap, PAIRING_NODE *node);
+void *pairing_heap_delete(PAIRING_HEAP *heap, PAIRING_NODE *node);
+bool pairing_heap_meld(PAIRING_HEAP *heap, PAIRING_HEAP *other);
+void destroy_pairing_heap(PAIRING_HEAP *heap);
+PAIRING_NODE *_pairing_alloc(PAIRING_POOL *pool);
+void _pairing_release(PAIRING_POOL *pool, PAIRING_NODE *node);
+PAIRING_NODE *_pairing_link(PAIRING_HEAP *heap, PAIRING_NODE *a, PAIRING_NODE *b);
+PAIRING_NODE *_pairing_merge_pairs(PAIRING_HEAP *heap, PAIRING_NODE *first);
+void _pairing_cut(PAIRING_NODE *node);
+
+PAIRING_POOL *create_pairing_pool(void)
+{
+    PAIRING_POOL *pool = (PAIRING_POOL*)Malloc(sizeof(PAIRING_POOL));
+
+    pool->blocks = NULL;
+    pool->free_list = NULL;
+    pool->used = PAIRING_BLOCK_NODES;//forces a block on first use
+    pool->block_count = 0;
+    return pool;
+}
+
+void destroy_pairing_pool(PAIRING_POOL *pool)
+{
+    PAIRING_BLOCK *block, *next;
+
+    for(block = pool->blocks; block; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+    free(pool);
+}
+
+PAIRING_NODE *_pairing_alloc(PAIRING_POOL *pool)
+{
+    PAIRING_NODE *node;
+    PAIRING_BLOCK *block;
+
+    if(pool->free_list)
+    {
+        node = pool->free_list;
+        pool->free_list = node->next;
+        return node;
+    }
+    if(pool->used == PAIRING_BLOCK_NODES)
+    {
+        block = (PAIRING_BLOCK*)Malloc(sizeof(PAIRING_BLOCK));
+        block->next = pool->blocks;
+        pool->blocks = block;
+        pool->used = 0;
+        pool->block_count++;
+    }
+    return &pool->blocks->nodes[pool->used++];
+}
+
+void _pairing_release(PAIRING_POOL *pool, PAIRING_NODE *node)
+{
+    node->next = pool->free_list;
+    pool->free_list = node;
+}
+
+PAIRING_HEAP *create_pairing_heap(int (*compare)(void *arg1, void *arg2), PAIRING_POOL *pool)
+{
+    PAIRING_HEAP *heap = (PAIRING_HEAP*)Malloc(sizeof(PAIRING_HEAP));
+
+    heap->compare = compare;
+    heap->root = NULL;
+    heap->count = 0;
+    heap->own_pool = pool == NULL;
+    heap->pool = pool ? pool : create_pairing_pool();
+    return heap;
+}
+
+//a and b are roots (either may be NULL); returns the new root with next/prev cleared
+PAIRING_NODE *_pairing_link(PAIRING_HEAP *heap, PAIRING_NODE *a, PAIRING_NODE *b)
+{
+    PAIRING_NODE *hold;
+
+    if(!a || !b)
+    {
+        a = a ? a : b;
+        if(a)
+            a->next = a->prev = NULL;
+        return a;
+    }
+    if(heap->compare(b->data, a->data) < 0)
+    {
+        hold = a;
+        a = b;
+        b = hold;
+    }
+    b->next = a->child;
+    if(a->child)
+        a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+    a->next = a->prev = NULL;
+    return a;
+}
+
+//two-pass merge of a sibling list into one root
+PAIRING_NODE *_pairing_merge_pairs(PAIRING_HEAP *heap, PAIRING_NODE *first)
+{
+    PAIRING_NODE *pairs = NULL, *a, *b, *rest, *root;
+
+    //pass 1, left to right: link neighbours, stack the results (last pair on top)
+    while(first)
+    {
+        a = first;
+        b = a->next;
+        rest = b ? b->next : NULL;
+        a = _pairing_link(heap, a, b);
+        a->next = pairs;
+        pairs = a;
+        first = rest;
+    }
+    if(!pairs)
+        return NULL;
+    //pass 2, right to left: fold the stack into one root
+    root = pairs;
+    pairs = pairs->next;
+    while(pairs)
+    {
+        rest = pairs->next;
+        root = _pairing_link(heap, root, pairs);
+        pairs = rest;
+    }
+    root->next = root->prev = NULL;
+    return root;
+}
+
+PAIRING_NODE *pairing_heap_insert(PAIRING_HEAP *heap, void *data_in)
+{
+    PAIRING_NODE *node = _pairing_alloc(heap->pool);
+
+    node->data = data_in;
+    node->child = NULL;
+    heap->root = _pairing_link(heap, heap->root, node);
+    heap->count++;
+    return node;
+}
+
+void *pairing_heap_peek(PAIRING_HEAP *heap)
+{
+    return heap->root ? heap->root->data : NULL;
+}
+
+//NULL when empty; the root's handle is released
+void *pairing_heap_get_min(PAIRING_HEAP *heap)
+{
+    PAIRING_NODE *root = heap->root;
+    void *data;
+
+    if(!root)
+        return NULL;
+    data = root->data;
+    heap->root = _pairing_merge_pairs(heap, root->child);
+    heap->count--;
+    _pairing_release(heap->pool, root);
+    return data;
+}
+
+//unhooks a non-root node and its subtree from its parent and siblings
+void _pairing_cut(PAIRING_NODE *node)
+{
+    if(node->prev->child == node)
+        node->prev->child = node->next;
+    else
+        node->prev->next = node->next;
+    if(node->next)
+        node->next->prev = node->prev;
+    node->next = node->prev = NULL;
+}
+
+//call after lowering the key of node's data
+void pairing_heap_decrease_key(PAIRING_HEAP *heap, PAIRING_NODE *node)
+{
+    if(node == heap->root)
+        return;
+    _pairing_cut(node);
+    heap->root = _pairing_link(heap, heap->root, node);
+}
+
+//removes any element by handle and returns its data
+void *pairing_heap_delete(PAIRING_HEAP *heap, PAIRING_NODE *node)
+{
+    void *data;
+
+    if(node == heap->root)
+        return pairing_heap_get_min(heap);
+    data = node->data;
+    _pairing_cut(node);
+    heap->root = _pairing_link(heap, heap->root, _pairing_merge_pairs(heap, node->child));
+    heap->count--;
+    _pairing_release(heap->pool, node);
+    return data;
+}
+
+//moves every element of other into heap (handles stay valid); false if the pools differ
+bool pairing_heap_meld(PAIRING_HEAP *heap, PAIRING_HEAP *other)
+{
+    if(heap->pool != other->pool)
+    {
+        puts("MELD: HEAPS MUST SHARE A POOL");
+        return false;
+    }
+    heap->root = _pairing_link(heap, heap->root, other->root);
+    heap->count += other->count;
+    other->root = NULL;
+    other->count = 0;
+    return true;
+}
+
+//nodes still queued in a shared pool are reclaimed with the pool
+void destroy_pairing_heap(PAIRING_HEAP *heap)
+{
+    if(heap->own_pool)
+        destroy_pairing_pool(heap->pool);
+    free(heap);
+}
+#endif /* pairing_heap_h */
@@ -0,0 +1,298 @@
+/* STATIC PERFECT HASHING (CHD: compress, hash and displace) */
+
+#ifndef perfect_hash_h
+#define perfect_hash_h
+#include "wrappers.h"
+
+/*
+ for key sets that never change after load (symbol tables, config keys): build once, then
+ every lookup is ONE probe into the slot array, no collisions, no probing.
+
+ build: keys are split into r = n/PH_LAMBDA buckets by one hash. buckets are placed largest
+ first: bucket b gets the first displacement index d such that all of its keys land on free,
+ distinct slots at (f1 + d0*f2 + d1) % m with d0 = d >> 8, d1 = d & 0xff.
+ lookup: slot = (f1 + d0*f2 + d1) % m with d read from disp[bucket]. 16 bits per bucket of
+ PH_LAMBDA keys is ~3.2 bits per key: disp[] and a 20-byte header are all that is saved.
+ NOT MINIMAL: m = n/PH_LOAD slots, 1% of them empty. with m == n the last buckets must each hit
+ one of the few free slots, and 2^16 displacements reach only 2^16 of the m positions: large
+ builds fail. the 1% slack costs slots, not metadata.
+
+ the slot array holds satellites; get_key() gives back a satellite's key so that a lookup can
+ reject keys that were never in the set (a perfect hash maps ANY key to some slot).
+ */
+#define PH_LAMBDA 5 //average keys per bucket
+#define PH_LOAD 0.99 //keys per slot
+#define PH_MAX_DISP 65536 //displacement indices tried per bucket
+#define PH_MAX_SEEDS 32 //hash seeds tried before the build gives up
+#define PH_MAX_BUCKET 64 //keys in one bucket before the seed is rejected
+#define PH_MAGIC 0x31464850 //"PHF1"
+
+typedef struct perfect_hash
+{
+    uint32_t n;//keys
+    uint32_t m;//slots
+    uint32_t r;//buckets
+    uint32_t seed;
+    uint16_t *disp;//displacement index per bucket
+    void **slots;
+    const char *(*get_key)(void *data);
+}PERFECT_HASH;
+
+PERFECT_HASH *build_perfect_hash(void **data, int n, const char *(*get_key)(void *data));
+uint32_t ph_index(PERFECT_HASH *ph, const char *key);
+void *ph_retrieve(PERFECT_HASH *ph, const char *key);
+bool ph_save(PERFECT_HASH *ph, char *file);
+PERFECT_HASH *ph_load(char *file, void **data, uint32_t n, const char *(*get_key)(void *data));
+void destroy_perfect_hash(PERFECT_HASH *ph);
+uint64_t ph_hash(const char *key, uint64_t seed);
+bool _ph_try_seed(PERFECT_HASH *ph, void **data, uint32_t *bucket_of, int *order_by_size);
+
+//FNV-1a over the bytes, then a 64-bit finalizer so every input bit reaches every output bit
+uint64_t ph_hash(const char *key, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+
+    for(const unsigned char *p = (const unsigned char*)key; *p; p++)
+    {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint32_t ph_index(PERFECT_HASH *ph, const char *key)
+{
+    uint64_t h, g;
+    uint32_t d;
+
+    h = ph_hash(key, ph->seed);
+    g = ph_hash(key, ~(uint64_t)ph->seed);
+    d = ph->disp[(uint32_t)h % ph->r];
+    return (uint32_t)(((g >> 32) % ph->m + (uint64_t)(d >> 8)*((uint32_t)g % ph->m) + (d & 0xff)) % ph->m);
+}
+
+//ONE probe, then one key compare to reject keys outside the set
+void *ph_retrieve(PERFECT_HASH *ph, const char *key)
+{
+    void *data_out = ph->slots[ph_index(ph, key)];
+
+    if(data_out && strcmp(ph->get_key(data_out), key) == 0)
+        return data_out;
+    return NULL;
+}
+
+bool _ph_try_seed(PERFECT_HASH *ph, void **data, uint32_t *bucket_of, int *order_by_size)
+{
+    uint32_t pos[PH_MAX_BUCKET], f1[PH_MAX_BUCKET], f2[PH_MAX_BUCKET];
+    int members[PH_MAX_BUCKET];
+    int i, b, k, count, placed;
+    uint64_t g;
+    bool ok;
+
+    memset(ph->slots, 0, ph->m*sizeof(void*));
+    //order_by_size[] lists keys grouped by bucket, largest buckets first
+    i = 0;
+    while(i < (int)ph->n)
+    {
+        b = bucket_of[order_by_size[i]];
+        count = 0;
+        while(i < (int)ph->n && (int)bucket_of[order_by_size[i]] == b)
+        {
+            if(count == PH_MAX_BUCKET)
+                return false;//pathological bucket: try another seed
+            members[count] = order_by_size[i];
+            g = ph_hash(ph->get_key(data[members[count]]), ~(uint64_t)ph->seed);
+            f1[count] = (uint32_t)((g >> 32) % ph->m);
+            f2[count] = (uint32_t)g % ph->m;
+            count++;
+            i++;
+        }
+        ok = false;
+        for(uint32_t d = 0; d < PH_MAX_DISP && !ok; d++)
+        {
+            ok = true;
+            for(k = 0; k < count && ok; k++)
+            {
+                pos[k] = (uint32_t)((f1[k] + (uint64_t)(d >> 8)*f2[k] + (d & 0xff)) % ph->m);
+                if(ph->slots[pos[k]])
+                    ok = false;
+                for(placed = 0; placed < k && ok; placed++)
+                    if(pos[placed] == pos[k])
+                        ok = false;//two keys of this bucket on one slot (or duplicate keys)
+            }
+            if(ok)
+            {
+                ph->disp[b] = (uint16_t)d;
+                for(k = 0; k < count; k++)
+                    ph->slots[pos[k]] = data[members[k]];
+            }
+        }
+        if(!ok)
+            return false;
+    }
+    return true;
+}
+
+PERFECT_HASH *build_perfect_hash(void **data, int n, const char *(*get_key)(void *data))
+{
+    PERFECT_HASH *ph;
+    uint32_t *bucket_of, *size_of;
+    int *order_by_size, *bucket_order, *head, *next_in_bucket, start[PH_MAX_BUCKET+2];
+    int k, cap;
+    bool built = false;
+
+    ph = (PERFECT_HASH*)Malloc(sizeof(PERFECT_HASH));
+    ph->n = n;
+    ph->m = (uint32_t)ceil(n/PH_LOAD);
+    if(ph->m == 0)
+        ph->m = 1;
+    ph->r = n/PH_LAMBDA + 1;
+    ph->get_key = get_key;
+    ph->disp = (uint16_t*)Calloc(ph->r, sizeof(uint16_t));
+    ph->slots = (void**)Calloc(ph->m, sizeof(void*));
+    bucket_of = (uint32_t*)Malloc((n+1)*sizeof(uint32_t));
+    size_of = (uint32_t*)Malloc(ph->r*sizeof(uint32_t));
+    bucket_order = (int*)Malloc(ph->r*sizeof(int));
+    head = (int*)Malloc(ph->r*sizeof(int));
+    next_in_bucket = (int*)Malloc((n+1)*sizeof(int));
+    order_by_size = (int*)Malloc((n+1)*sizeof(int));
+    for(ph->seed = 1; ph->seed <= PH_MAX_SEEDS && !built; ph->seed++)
+    {
+        //1) bucket of every key, keys chained per bucket
+        memset(size_of, 0, ph->r*sizeof(uint32_t));
+        for(uint32_t b = 0; b < ph->r; b++)
+            head[b] = -1;
+        for(int i = n - 1; i >= 0; i--)
+        {
+            bucket_of[i] = (uint32_t)ph_hash(get_key(data[i]), ph->seed) % ph->r;
+            size_of[bucket_of[i]]++;
+            next_in_bucket[i] = head[bucket_of[i]];
+            head[bucket_of[i]] = i;
+        }
+        //2) counting sort of the buckets by size, largest first
+        memset(start, 0, sizeof(start));
+        for(uint32_t b = 0; b < ph->r; b++)
+        {
+            cap = size_of[b] > PH_MAX_BUCKET ? PH_MAX_BUCKET : (int)size_of[b];
+            start[PH_MAX_BUCKET - cap + 1]++;
+        }
+        for(int c = 1; c <= PH_MAX_BUCKET + 1; c++)
+            start[c] += start[c-1];
+        for(uint32_t b = 0; b < ph->r; b++)
+        {
+            cap = size_of[b] > PH_MAX_BUCKET ? PH_MAX_BUCKET : (int)size_of[b];
+            bucket_order[start[PH_MAX_BUCKET - cap]++] = b;
+        }
+        //3) keys listed bucket by bucket in that order
+        k = 0;
+        for(uint32_t j = 0; j < ph->r; j++)
+            for(int i = head[bucket_order[j]]; i != -1; i = next_in_bucket[i])
+                order_by_size[k++] = i;
+        built = _ph_try_seed(ph, data, bucket_of, order_by_size);
+    }
+    ph->seed--;
+    free(order_by_size);
+    free(next_in_bucket);
+    free(head);
+    free(bucket_order);
+    free(size_of);
+    free(bucket_of);
+    if(!built)
+    {
+        printf("ERROR: NO PERFECT HASH FOUND (DUPLICATE KEYS?)!!\n");
+        destroy_perfect_hash(ph);
+        return NULL;
+    }
+    return ph;
+}
+
+/*
+ FILE FORMAT: header {magic, n, m, r, seed}, then disp[r].
+ satellites are pointers and are not written: ph_load() places each of the n satellites of the
+ data array the table was built from at ph_index() of its key.
+ */
+bool ph_save(PERFECT_HASH *ph, char *file)
+{
+    FILE *fp;
+    uint32_t header[5];
+    bool success;
+
+    header[0] = PH_MAGIC;
+    header[1] = ph->n;
+    header[2] = ph->m;
+    header[3] = ph->r;
+    header[4] = ph->seed;
+    fp = Fopen(file, "wb");
+    success = fwrite(header, sizeof(uint32_t), 5, fp) == 5
+              && fwrite(ph->disp, sizeof(uint16_t), ph->r, fp) == ph->r;
+    Fclose(fp);
+    return success;
+}
+
+//data holds the n satellites the table was built from; the file must be for exactly n keys
+PERFECT_HASH *ph_load(char *file, void **data, uint32_t n, const char *(*get_key)(void *data))
+{
+    PERFECT_HASH *ph;
+    FILE *fp;
+    uint32_t header[5], slot, m, r;
+
+    //the m and r build_perfect_hash() picks for n keys: anything else is not a file for this data
+    m = (uint32_t)ceil(n/PH_LOAD);
+    m = m ? m : 1;
+    r = n/PH_LAMBDA + 1;
+    fp = Fopen(file, "rb");
+    if(fread(header, sizeof(uint32_t), 5, fp) != 5 || header[0] != PH_MAGIC)
+    {
+        printf("ERROR: %s IS NOT A PERFECT HASH FILE!!\n", file);
+        Fclose(fp);
+        return NULL;
+    }
+    if(header[1] != n || header[2] != m || header[3] != r)
+    {
+        printf("ERROR: %s IS FOR %u KEYS, %u SLOTS, %u BUCKETS, NOT %u KEYS!!\n", file, header[1], header[2], header[3], n);
+        Fclose(fp);
+        return NULL;
+    }
+    ph = (PERFECT_HASH*)Malloc(sizeof(PERFECT_HASH));
+    ph->n = header[1];
+    ph->m = header[2];
+    ph->r = header[3];
+    ph->seed = header[4];
+    ph->get_key = get_key;
+    ph->disp = (uint16_t*)Malloc(ph->r*sizeof(uint16_t));
+    ph->slots = (void**)Calloc(ph->m, sizeof(void*));
+    if(fread(ph->disp, sizeof(uint16_t), ph->r, fp) != ph->r)
+    {
+        printf("ERROR: %s IS TRUNCATED!!\n", file);
+        Fclose(fp);
+        destroy_perfect_hash(ph);
+        return NULL;
+    }
+    Fclose(fp);
+    //two satellites on one slot: the file was not built from this data
+    for(uint32_t i = 0; i < n; i++)
+    {
+        slot = ph_index(ph, get_key(data[i]));
+        if(ph->slots[slot])
+        {
+            printf("ERROR: %s DOES NOT MATCH THE DATA!!\n", file);
+            destroy_perfect_hash(ph);
+            return NULL;
+        }
+        ph->slots[slot] = data[i];
+    }
+    return ph;
+}
+
+void destroy_perfect_hash(PERFECT_HASH *ph)
+{
+    free(ph->disp);
+    free(ph->slots);
+    free(ph);
+}
+#endif /* perfect_hash_h */
@@ -0,0 +1,388 @@
+/* IPv4 FORWARDING TABLE: POPTRIE (COMPRESSED MULTIBIT TRIE, POPCOUNT-INDEXED) */
+
+#ifndef poptrie_h
+#define poptrie_h
+#include "wrappers.h"
+#include "fib.h"
+
+/*
+ the memory-bounded alternative to fib.h: a full table fits in a few MB instead of 64+ MB
+ (real tables cluster and share next hops; uniformly random prefixes are close to the worst
+ case and take ~20 MB for 800k). same rules in, same next hops out (FIB_NO_ROUTE for no match).
+
+ direct[addr >> 16] is either a leaf (POPTRIE_LEAF | next hop) or the root node of the
+ subtree for that /16. below that every node consumes 6 address bits (64 positions):
+   vector bit v: position v is an internal node. children are stored contiguously from base1,
+                 child of v = nodes[base1 + popcount(vector & bits 0..v) - 1].
+   leafvec bit v: a run of equal next hops starts at leaf position v (internal positions are
+                 skipped), next hop = leaves[base0 + popcount(leafvec & bits 0..v) - 1].
+ a node is 24 bytes, leaves are 16 bits and runs are stored once: a /16 full of /24s with a
+ handful of next hops is a few nodes and a few dozen leaves. lookup = direct entry + at most
+ 3 nodes (16 + 6 + 6 + 6 >= 32 bits) + one leaf.
+
+ the poptrie is compiled from a plain binary trie of the rules (the RIB). an update changes
+ the RIB and recompiles only the /16 subtrees it covers; the old blocks become garbage that a
+ full rebuild reclaims once it outweighs the live part. bulk loads go between
+ poptrie_batch_begin() and poptrie_batch_end(): RIB only, then one compile at the end.
+ */
+#define POPTRIE_DIRECT_BITS 16
+#define POPTRIE_STRIDE 6
+#define POPTRIE_LEAF 0x80000000U
+#define POPTRIE_NO_LEAF 0xffff //no route, stored in 16-bit leaves
+#define POPTRIE_MAX_NEXT_HOP 0xfffe
+
+typedef struct poptrie_node
+{
+    uint64_t vector;
+    uint64_t leafvec;
+    uint32_t base0;//first leaf
+    uint32_t base1;//first child node
+}POPTRIE_NODE;
+
+typedef struct rib_node
+{
+    struct rib_node *child[2];
+    uint32_t next_hop;
+    bool has_route;
+}RIB_NODE;
+
+typedef struct poptrie
+{
+    uint32_t *direct;
+    POPTRIE_NODE *nodes;
+    uint16_t *leaves;
+    uint32_t node_count, node_cap;
+    uint32_t leaf_count, leaf_cap;
+    uint32_t garbage;//nodes + leaves no longer reachable
+    RIB_NODE *rib;
+    uint32_t rule_count;
+    bool batch;//updates only touch the RIB until poptrie_batch_end()
+}POPTRIE;
+
+POPTRIE *create_poptrie(void);
+bool poptrie_insert(POPTRIE *pt, uint32_t prefix, uint8_t len, uint32_t next_hop);
+bool poptrie_delete(POPTRIE *pt, uint32_t prefix, uint8_t len);
+uint32_t poptrie_lookup(POPTRIE *pt, uint32_t addr);
+int poptrie_load(POPTRIE *pt, char *file);
+void poptrie_rebuild(POPTRIE *pt);
+void poptrie_batch_begin(POPTRIE *pt);
+void poptrie_batch_end(POPTRIE *pt);
+size_t poptrie_memory(POPTRIE *pt);
+void destroy_poptrie(POPTRIE *pt);
+bool _rib_delete(RIB_NODE **n, uint32_t prefix, uint8_t len, uint8_t depth);
+void _rib_free(RIB_NODE *n);
+uint32_t _poptrie_alloc(void **array, uint32_t *count, uint32_t *cap, uint32_t n, size_t size);
+void _poptrie_build_node(POPTRIE *pt, uint32_t slot, RIB_NODE *rib, int offset, uint16_t inherited);
+void _poptrie_build_direct(POPTRIE *pt, uint32_t d);
+uint32_t _poptrie_subtree_size(POPTRIE *pt, uint32_t slot);
+void _poptrie_update(POPTRIE *pt, uint32_t prefix, uint8_t len);
+
+//6 address bits at offset (from the top), zero-padded past bit 31
+#define POPTRIE_CHUNK(addr, offset) ((uint32_t)((((uint64_t)(addr) << 32) << (offset)) >> (64 - POPTRIE_STRIDE)))
+#define POPTRIE_UPTO(v) ((2ULL << (v)) - 1) //bits 0..v
+
+POPTRIE *create_poptrie(void)
+{
+    POPTRIE *pt = (POPTRIE*)Malloc(sizeof(POPTRIE));
+
+    pt->direct = (uint32_t*)Malloc((1 << POPTRIE_DIRECT_BITS)*sizeof(uint32_t));
+    for(int d = 0; d < (1 << POPTRIE_DIRECT_BITS); d++)
+        pt->direct[d] = POPTRIE_LEAF | POPTRIE_NO_LEAF;
+    pt->node_cap = 1024;
+    pt->nodes = (POPTRIE_NODE*)Malloc(pt->node_cap*sizeof(POPTRIE_NODE));
+    pt->leaf_cap = 4096;
+    pt->leaves = (uint16_t*)Malloc(pt->leaf_cap*sizeof(uint16_t));
+    pt->node_count = pt->leaf_count = pt->garbage = 0;
+    pt->rib = NULL;
+    pt->rule_count = 0;
+    pt->batch = false;
+    return pt;
+}
+
+uint32_t poptrie_lookup(POPTRIE *pt, uint32_t addr)
+{
+    POPTRIE_NODE *node;
+    uint32_t e, v;
+    int offset;
+
+    e = pt->direct[addr >> (32 - POPTRIE_DIRECT_BITS)];
+    if(e & POPTRIE_LEAF)
+    {
+        e &= ~POPTRIE_LEAF;
+        return e == POPTRIE_NO_LEAF ? FIB_NO_ROUTE : e;
+    }
+    node = &pt->nodes[e];
+    offset = POPTRIE_DIRECT_BITS;
+    v = POPTRIE_CHUNK(addr, offset);
+    while(node->vector & (1ULL << v))
+    {
+        node = &pt->nodes[node->base1 + __builtin_popcountll(node->vector & POPTRIE_UPTO(v)) - 1];
+        offset += POPTRIE_STRIDE;
+        v = POPTRIE_CHUNK(addr, offset);
+    }
+    e = pt->leaves[node->base0 + __builtin_popcountll(node->leafvec & POPTRIE_UPTO(v)) - 1];
+    return e == POPTRIE_NO_LEAF ? FIB_NO_ROUTE : e;
+}
+
+//n contiguous elements at the end of a growable array, returns the first index
+uint32_t _poptrie_alloc(void **array, uint32_t *count, uint32_t *cap, uint32_t n, size_t size)
+{
+    uint32_t first = *count;
+
+    while(*count + n > *cap)
+    {
+        *cap *= 2;
+        *array = Realloc(*array, (size_t)*cap*size);
+    }
+    *count += n;
+    return first;
+}
+
+/*
+ compiles the RIB below rib (a prefix of offset bits, inherited = its best next hop so far)
+ into nodes[slot]. the 64 positions are resolved by walking 6 more RIB levels; a position
+ whose RIB node still has children becomes an internal node, anything else a leaf.
+ the children's slots are reserved as one block before any of them is built.
+ */
+void _poptrie_build_node(POPTRIE *pt, uint32_t slot, RIB_NODE *rib, int offset, uint16_t inherited)
+{
+    RIB_NODE *below[1 << POPTRIE_STRIDE], *n;
+    uint16_t hop[1 << POPTRIE_STRIDE], last;
+    uint64_t vector, leafvec;
+    uint32_t base0, base1, runs, c;
+    int depth;
+
+    vector = leafvec = 0;
+    runs = 0;
+    last = 0;
+    for(uint32_t v = 0; v < (1 << POPTRIE_STRIDE); v++)
+    {
+        n = rib;
+        hop[v] = inherited;
+        for(depth = 1; depth <= POPTRIE_STRIDE && n; depth++)
+        {
+            n = n->child[(v >> (POPTRIE_STRIDE - depth)) & 1];
+            if(n && n->has_route && offset + depth <= 32)
+                hop[v] = (uint16_t)n->next_hop;
+        }
+        below[v] = n;
+        if(n && (n->child[0] || n->child[1]) && offset + POPTRIE_STRIDE < 32)
+            vector |= 1ULL << v;
+        else if(runs == 0 || hop[v] != last)
+        {
+            leafvec |= 1ULL << v;
+            last = hop[v];
+            runs++;
+        }
+    }
+    base0 = _poptrie_alloc((void**)&pt->leaves, &pt->leaf_count, &pt->leaf_cap, runs, sizeof(uint16_t));
+    base1 = _poptrie_alloc((void**)&pt->nodes, &pt->node_count, &pt->node_cap, __builtin_popcountll(vector), sizeof(POPTRIE_NODE));
+    runs = c = 0;
+    for(uint32_t v = 0; v < (1 << POPTRIE_STRIDE); v++)
+    {
+        if(vector & (1ULL << v))
+            _poptrie_build_node(pt, base1 + c++, below[v], offset + POPTRIE_STRIDE, hop[v]);
+        else if(leafvec & (1ULL << v))
+            pt->leaves[base0 + runs++] = hop[v];
+    }
+    //written last: pt->nodes may have moved while the children were built
+    pt->nodes[slot].vector = vector;
+    pt->nodes[slot].leafvec = leafvec;
+    pt->nodes[slot].base0 = base0;
+    pt->nodes[slot].base1 = base1;
+}
+
+//direct[d]: a leaf if nothing longer than /16 lives under d, otherwise a compiled subtree
+void _poptrie_build_direct(POPTRIE *pt, uint32_t d)
+{
+    RIB_NODE *n = pt->rib;
+    uint16_t hop = POPTRIE_NO_LEAF;
+    uint32_t slot;
+
+    if(n && n->has_route)
+        hop = (uint16_t)n->next_hop;//the default route
+    for(int depth = 1; depth <= POPTRIE_DIRECT_BITS && n; depth++)
+    {
+        n = n->child[(d >> (POPTRIE_DIRECT_BITS - depth)) & 1];
+        if(n && n->has_route)
+            hop = (uint16_t)n->next_hop;
+    }
+    if(!n || (!n->child[0] && !n->child[1]))
+    {
+        pt->direct[d] = POPTRIE_LEAF | hop;
+        return;
+    }
+    slot = _poptrie_alloc((void**)&pt->nodes, &pt->node_count, &pt->node_cap, 1, sizeof(POPTRIE_NODE));
+    _poptrie_build_node(pt, slot, n, POPTRIE_DIRECT_BITS, hop);
+    pt->direct[d] = slot;
+}
+
+//nodes + leaves reachable from nodes[slot]
+uint32_t _poptrie_subtree_size(POPTRIE *pt, uint32_t slot)
+{
+    POPTRIE_NODE *node = &pt->nodes[slot];
+    uint32_t size = 1 + __builtin_popcountll(node->leafvec);
+
+    for(int c = 0; c < __builtin_popcountll(node->vector); c++)
+        size += _poptrie_subtree_size(pt, node->base1 + c);
+    return size;
+}
+
+//recompiles the /16 subtrees under prefix/len, or everything once garbage dominates
+void _poptrie_update(POPTRIE *pt, uint32_t prefix, uint8_t len)
+{
+    uint32_t first, count;
+
+    if(pt->batch)
+        return;
+    if(pt->garbage > pt->node_count + pt->leaf_count - pt->garbage && pt->garbage > (1 << 16))
+    {
+        poptrie_rebuild(pt);
+        return;
+    }
+    first = prefix >> (32 - POPTRIE_DIRECT_BITS);
+    count = len >= POPTRIE_DIRECT_BITS ? 1 : 1U << (POPTRIE_DIRECT_BITS - len);
+    for(uint32_t d = first; d < first + count; d++)
+    {
+        if(!(pt->direct[d] & POPTRIE_LEAF))
+            pt->garbage += _poptrie_subtree_size(pt, pt->direct[d]);
+        _poptrie_build_direct(pt, d);
+    }
+}
+
+//compiles the whole RIB into fresh arrays: no garbage afterwards
+void poptrie_rebuild(POPTRIE *pt)
+{
+    pt->node_count = pt->leaf_count = pt->garbage = 0;
+    for(uint32_t d = 0; d < (1 << POPTRIE_DIRECT_BITS); d++)
+        _poptrie_build_direct(pt, d);
+}
+
+//lookups see the table as of poptrie_batch_begin() until poptrie_batch_end()
+void poptrie_batch_begin(POPTRIE *pt)
+{
+    pt->batch = true;
+}
+
+void poptrie_batch_end(POPTRIE *pt)
+{
+    pt->batch = false;
+    poptrie_rebuild(pt);
+}
+
+//adds prefix/len -> next_hop, or changes the next hop of an existing rule
+bool poptrie_insert(POPTRIE *pt, uint32_t prefix, uint8_t len, uint32_t next_hop)
+{
+    RIB_NODE **n = &pt->rib;
+
+    if(len > 32 || next_hop > POPTRIE_MAX_NEXT_HOP)
+    {
+        INDEX_ERROR;
+        return false;
+    }
+    prefix &= FIB_MASK(len);
+    for(int depth = 0; ; depth++)
+    {
+        if(!*n)
+            *n = (RIB_NODE*)Calloc(1, sizeof(RIB_NODE));
+        if(depth == len)
+            break;
+        n = &(*n)->child[(prefix >> (31 - depth)) & 1];
+    }
+    if(!(*n)->has_route)
+        pt->rule_count++;
+    (*n)->has_route = true;
+    (*n)->next_hop = next_hop;
+    _poptrie_update(pt, prefix, len);
+    return true;
+}
+
+//clears the route at prefix/len and prunes RIB nodes left with neither route nor children
+bool _rib_delete(RIB_NODE **n, uint32_t prefix, uint8_t len, uint8_t depth)
+{
+    bool found;
+
+    if(!*n)
+        return false;
+    if(depth == len)
+    {
+        found = (*n)->has_route;
+        (*n)->has_route = false;
+    }
+    else
+        found = _rib_delete(&(*n)->child[(prefix >> (31 - depth)) & 1], prefix, len, depth + 1);
+    if(!(*n)->has_route && !(*n)->child[0] && !(*n)->child[1])
+    {
+        free(*n);
+        *n = NULL;
+    }
+    return found;
+}
+
+bool poptrie_delete(POPTRIE *pt, uint32_t prefix, uint8_t len)
+{
+    if(len > 32)
+        return false;
+    prefix &= FIB_MASK(len);
+    if(!_rib_delete(&pt->rib, prefix, len, 0))
+    {
+        DELETE_ERROR;
+        return false;
+    }
+    pt->rule_count--;
+    _poptrie_update(pt, prefix, len);
+    return true;
+}
+
+//same route file format as fib_load()
+int poptrie_load(POPTRIE *pt, char *file)
+{
+    FILE *fp;
+    char buffer[128];
+    uint32_t prefix, next_hop;
+    uint8_t len;
+    int line, installed;
+
+    fp = Fopen(file, "r");
+    line = installed = 0;
+    poptrie_batch_begin(pt);
+    while(fgets(buffer, sizeof(buffer), fp))
+    {
+        next_hop = (uint32_t)line/2;
+        if(fib_parse_route(buffer, &prefix, &len, &next_hop))
+        {
+            if(poptrie_insert(pt, prefix, len, next_hop))
+                installed++;
+            line++;
+        }
+    }
+    Fclose(fp);
+    poptrie_batch_end(pt);
+    return installed;
+}
+
+//bytes used by the lookup structure (the RIB is control-plane state and not counted)
+size_t poptrie_memory(POPTRIE *pt)
+{
+    return (1 << POPTRIE_DIRECT_BITS)*sizeof(uint32_t) + (size_t)pt->node_count*sizeof(POPTRIE_NODE)
+           + (size_t)pt->leaf_count*sizeof(uint16_t);
+}
+
+void _rib_free(RIB_NODE *n)
+{
+    if(!n)
+        return;
+    _rib_free(n->child[0]);
+    _rib_free(n->child[1]);
+    free(n);
+}
+
+void destroy_poptrie(POPTRIE *pt)
+{
+    _rib_free(pt->rib);
+    free(pt->leaves);
+    free(pt->nodes);
+    free(pt->direct);
+    free(pt);
+}
+#endif /* poptrie_h */
@@ -0,0 +1,131 @@
+/* MONOTONE RADIX HEAP: 33 BUCKETS OVER 32-BIT KEYS */
+
+#ifndef radix_heap_h
+#define radix_heap_h
+#include "wrappers.h"
+
+/*
+ a min priority queue for unsigned integer keys that never go below the last key extracted, which
+ is what DIJKSTRA with non-negative weights (and any event queue that never schedules into the past)
+ extracts. no compare callback: keys are bits.
+   last is the key extracted most recently. bucket 0 holds keys equal to last, bucket i (1..32)
+   keys whose highest bit that differs from last is bit i-1: the index is 32 - clz(key ^ last).
+   insert: compute the bucket, append. O(1).
+   get_min: from bucket 0 if it has anything. otherwise the first non-empty bucket i holds the
+   minimum: scan it for the minimum, make that last, and redistribute the bucket. every entry of
+   bucket i now differs from last below bit i-1, so it lands in a lower bucket: an entry moves at
+   most 32 times in its life, and O(log C) for keys within C of last.
+ buckets are arrays that double; a bitmap of non-empty buckets finds the first one with one ctz.
+ */
+#define RADIX_BUCKETS 33
+
+typedef struct radix_entry
+{
+    uint32_t key;
+    void *data;
+}RADIX_ENTRY;
+
+typedef struct radix_bucket
+{
+    RADIX_ENTRY *ary;
+    int count;
+    int size;
+}RADIX_BUCKET;
+
+typedef struct radix_heap
+{
+    RADIX_BUCKET buckets[RADIX_BUCKETS];
+    uint64_t non_empty;//bit i set when bucket i holds entries
+    uint32_t last;//last key extracted: the floor for inserts
+    int count;
+}RADIX_HEAP;
+
+RADIX_HEAP *create_radix_heap(void);
+bool radix_heap_insert(RADIX_HEAP *heap, uint32_t key, void *data_in);
+bool radix_heap_get_min(RADIX_HEAP *heap, uint32_t *key_out, void **data_out);
+void destroy_radix_heap(RADIX_HEAP *heap);
+int _radix_bucket(uint32_t key, uint32_t last);
+void _radix_append(RADIX_HEAP *heap, int b, uint32_t key, void *data);
+
+RADIX_HEAP *create_radix_heap(void)
+{
+    RADIX_HEAP *heap = (RADIX_HEAP*)Calloc(1, sizeof(RADIX_HEAP));
+
+    return heap;
+}
+
+int _radix_bucket(uint32_t key, uint32_t last)
+{
+    return key == last ? 0 : 32 - __builtin_clz(key ^ last);
+}
+
+void _radix_append(RADIX_HEAP *heap, int b, uint32_t key, void *data)
+{
+    RADIX_BUCKET *bucket = &heap->buckets[b];
+
+    if(bucket->count == bucket->size)
+    {
+        bucket->size = bucket->size ? bucket->size*2 : 16;
+        bucket->ary = (RADIX_ENTRY*)Realloc(bucket->ary, (size_t)bucket->size*sizeof(RADIX_ENTRY));
+    }
+    bucket->ary[bucket->count].key = key;
+    bucket->ary[bucket->count].data = data;
+    bucket->count++;
+    heap->non_empty |= 1ULL << b;
+}
+
+//false if key is below the last key extracted (monotonicity broken)
+bool radix_heap_insert(RADIX_HEAP *heap, uint32_t key, void *data_in)
+{
+    if(key < heap->last)
+    {
+        INDEX_ERROR;
+        return false;
+    }
+    _radix_append(heap, _radix_bucket(key, heap->last), key, data_in);
+    heap->count++;
+    return true;
+}
+
+bool radix_heap_get_min(RADIX_HEAP *heap, uint32_t *key_out, void **data_out)
+{
+    RADIX_BUCKET *bucket;
+    RADIX_ENTRY *ary;
+    uint32_t min;
+    int b, n;
+
+    if(heap->count == 0)
+        return false;
+    if(heap->buckets[0].count == 0)
+    {
+        //first non-empty bucket: its minimum is the new last, the rest moves down
+        b = __builtin_ctzll(heap->non_empty);
+        bucket = &heap->buckets[b];
+        ary = bucket->ary;
+        n = bucket->count;
+        min = ary[0].key;
+        for(int i = 1; i < n; i++)
+            min = ary[i].key < min ? ary[i].key : min;
+        heap->last = min;
+        bucket->count = 0;
+        heap->non_empty &= ~(1ULL << b);
+        for(int i = 0; i < n; i++)
+            _radix_append(heap, _radix_bucket(ary[i].key, min), ary[i].key, ary[i].data);
+    }
+    bucket = &heap->buckets[0];
+    bucket->count--;
+    *key_out = bucket->ary[bucket->count].key;
+    *data_out = bucket->ary[bucket->count].data;
+    if(bucket->count == 0)
+        heap->non_empty &= ~1ULL;
+    heap->count--;
+    return true;
+}
+
+void destroy_radix_heap(RADIX_HEAP *heap)
+{
+    for(int i = 0; i < RADIX_BUCKETS; i++)
+        free(heap->buckets[i].ary);
+    free(heap);
+}
+#endif /* radix_heap_h */
@@ -0,0 +1,243 @@
+/* HIERARCHICAL TIMER WHEEL: O(1) START/STOP/TICK, CASCADING, HEAP OVERFLOW */
+
+#ifndef timer_wheel_h
+#define timer_wheel_h
+#include "wrappers.h"
+#include "pairing_heap.h"
+
+/*
+ millions of timeouts, most stopped before they expire: a heap pays O(log n) on every start and
+ has no cheap cancel. a timing wheel pays O(1) for start, stop and each tick.
+   TW_LEVELS wheels of TW_SLOTS slots; level l slot i holds timers whose expiry agrees with now
+   on every bit above the level's 6 (bits 6l+6 and up) and has i in bits 6l..6l+5. a timer goes to
+   the lowest level where that holds, so its slot is always ahead of the level's current slot.
+   tick: now++. whenever the low 6l bits of now wrap to 0, level l's current slot is cascaded:
+   its timers agree with now on more bits now and are re-filed lower (highest level first). then
+   level 0's slot holds exactly the timers due now: they fire. a timer cascades at most
+   TW_LEVELS-1 times.
+   expiries that differ from now above bit 6*TW_LEVELS (2^24 ticks out) wait in a pairing heap
+   keyed on expiry and move into the wheel when now enters their 2^24 window.
+ timer nodes are intrusive (the slot list links live in the node, pprev points at whatever
+ points to it, so stop unlinks in O(1)) and come from a pool of blocks like PAIRING_POOL.
+ the node returned by timer_start() is the handle for timer_stop(); it is released once the
+ timer fires or stops, and must not be used afterwards.
+ */
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_SPAN_BITS (TW_LEVELS*TW_SLOT_BITS)
+#define TW_BLOCK_NODES 256
+
+typedef struct timer_node
+{
+    struct timer_node *next;//slot list, or the pool's free list
+    struct timer_node **pprev;//the pointer that points to this node
+    uint64_t expires;
+    void (*expire)(void *arg);
+    void *arg;
+    PAIRING_NODE *overflow;//handle while in the overflow heap, NULL in the wheel
+}TIMER_NODE;
+
+typedef struct timer_block
+{
+    struct timer_block *next;
+    TIMER_NODE nodes[TW_BLOCK_NODES];
+}TIMER_BLOCK;
+
+typedef struct timer_wheel
+{
+    uint64_t now;
+    TIMER_NODE *slots[TW_LEVELS][TW_SLOTS];
+    PAIRING_HEAP *overflow;
+    int count;//timers running
+    TIMER_BLOCK *blocks;
+    TIMER_NODE *free_list;
+    int used;//nodes handed out from the newest block
+    uint64_t cascaded;//timers re-filed by cascades, for the stats
+}TIMER_WHEEL;
+
+TIMER_WHEEL *create_timer_wheel(uint64_t now);
+TIMER_NODE *timer_start(TIMER_WHEEL *w, uint64_t expires, void (*expire)(void *arg), void *arg);
+void timer_stop(TIMER_WHEEL *w, TIMER_NODE *t);
+int timer_wheel_tick(TIMER_WHEEL *w);
+int timer_wheel_advance(TIMER_WHEEL *w, uint64_t to);
+void destroy_timer_wheel(TIMER_WHEEL *w);
+int timer_compare(void *arg1, void *arg2);
+void _timer_file(TIMER_WHEEL *w, TIMER_NODE *t);
+void _timer_unlink(TIMER_NODE *t);
+void _timer_cascade(TIMER_WHEEL *w, int level);
+TIMER_NODE *_timer_alloc(TIMER_WHEEL *w);
+void _timer_release(TIMER_WHEEL *w, TIMER_NODE *t);
+
+TIMER_WHEEL *create_timer_wheel(uint64_t now)
+{
+    TIMER_WHEEL *w = (TIMER_WHEEL*)Calloc(1, sizeof(TIMER_WHEEL));
+
+    w->now = now;
+    w->overflow = create_pairing_heap(timer_compare, NULL);
+    w->used = TW_BLOCK_NODES;//forces a block on first use
+    return w;
+}
+
+int timer_compare(void *arg1, void *arg2)
+{
+    uint64_t a = ((TIMER_NODE*)arg1)->expires, b = ((TIMER_NODE*)arg2)->expires;
+
+    return a < b ? -1 : a > b;
+}
+
+TIMER_NODE *_timer_alloc(TIMER_WHEEL *w)
+{
+    TIMER_NODE *t;
+    TIMER_BLOCK *block;
+
+    if(w->free_list)
+    {
+        t = w->free_list;
+        w->free_list = t->next;
+        return t;
+    }
+    if(w->used == TW_BLOCK_NODES)
+    {
+        block = (TIMER_BLOCK*)Malloc(sizeof(TIMER_BLOCK));
+        block->next = w->blocks;
+        w->blocks = block;
+        w->used = 0;
+    }
+    return &w->blocks->nodes[w->used++];
+}
+
+void _timer_release(TIMER_WHEEL *w, TIMER_NODE *t)
+{
+    t->pprev = NULL;
+    t->next = w->free_list;
+    w->free_list = t;
+}
+
+//into the lowest level whose slot is ahead of now, or the overflow heap
+void _timer_file(TIMER_WHEEL *w, TIMER_NODE *t)
+{
+    TIMER_NODE **slot;
+    int level;
+
+    t->overflow = NULL;
+    for(level = 0; level < TW_LEVELS; level++)
+        if((t->expires >> (TW_SLOT_BITS*(level + 1))) == (w->now >> (TW_SLOT_BITS*(level + 1))))
+            break;
+    if(level == TW_LEVELS)
+    {
+        t->pprev = NULL;
+        t->overflow = pairing_heap_insert(w->overflow, t);
+        return;
+    }
+    slot = &w->slots[level][(t->expires >> (TW_SLOT_BITS*level)) & (TW_SLOTS - 1)];
+    t->next = *slot;
+    if(*slot)
+        (*slot)->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+void _timer_unlink(TIMER_NODE *t)
+{
+    *t->pprev = t->next;
+    if(t->next)
+        t->next->pprev = t->pprev;
+    t->pprev = NULL;
+}
+
+//expires <= now fires on the next tick
+TIMER_NODE *timer_start(TIMER_WHEEL *w, uint64_t expires, void (*expire)(void *arg), void *arg)
+{
+    TIMER_NODE *t = _timer_alloc(w);
+
+    t->expires = expires > w->now ? expires : w->now + 1;
+    t->expire = expire;
+    t->arg = arg;
+    _timer_file(w, t);
+    w->count++;
+    return t;
+}
+
+void timer_stop(TIMER_WHEEL *w, TIMER_NODE *t)
+{
+    if(t->overflow)
+        pairing_heap_delete(w->overflow, t->overflow);
+    else
+        _timer_unlink(t);
+    w->count--;
+    _timer_release(w, t);
+}
+
+void _timer_cascade(TIMER_WHEEL *w, int level)
+{
+    TIMER_NODE **slot = &w->slots[level][(w->now >> (TW_SLOT_BITS*level)) & (TW_SLOTS - 1)];
+    TIMER_NODE *t;
+
+    while((t = *slot))
+    {
+        _timer_unlink(t);
+        _timer_file(w, t);
+        w->cascaded++;
+    }
+}
+
+//one tick: cascade what now reaches, then fire what is due; returns how many fired
+int timer_wheel_tick(TIMER_WHEEL *w)
+{
+    TIMER_NODE *due, *t;
+    int fired = 0, level;
+
+    w->now++;
+    if((w->now & (((uint64_t)1 << TW_SPAN_BITS) - 1)) == 0)
+    {
+        //a new 2^24 window: pull its timers out of the overflow heap
+        while((t = (TIMER_NODE*)pairing_heap_peek(w->overflow)) && (t->expires >> TW_SPAN_BITS) == (w->now >> TW_SPAN_BITS))
+        {
+            pairing_heap_get_min(w->overflow);
+            _timer_file(w, t);
+        }
+    }
+    //highest level first: what it re-files may land in a slot cascaded next
+    for(level = TW_LEVELS - 1; level > 0; level--)
+        if((w->now & (((uint64_t)1 << (TW_SLOT_BITS*level)) - 1)) == 0)
+            _timer_cascade(w, level);
+    //detach the due list: callbacks may start timers, or stop ones still on it
+    due = w->slots[0][w->now & (TW_SLOTS - 1)];
+    w->slots[0][w->now & (TW_SLOTS - 1)] = NULL;
+    if(due)
+        due->pprev = &due;
+    while((t = due))
+    {
+        _timer_unlink(t);
+        w->count--;
+        t->expire(t->arg);
+        _timer_release(w, t);
+        fired++;
+    }
+    return fired;
+}
+
+int timer_wheel_advance(TIMER_WHEEL *w, uint64_t to)
+{
+    int fired = 0;
+
+    while(w->now < to)
+        fired += timer_wheel_tick(w);
+    return fired;
+}
+
+//timers still running are dropped without firing
+void destroy_timer_wheel(TIMER_WHEEL *w)
+{
+    TIMER_BLOCK *block, *next;
+
+    for(block = w->blocks; block; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+    destroy_pairing_heap(w->overflow);
+    free(w);
+}
+#endif /* timer_wheel_h */
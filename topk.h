@@ -0,0 +1,309 @@
+/* STREAMING TOP-K (BOUNDED HEAP + SIMD THRESHOLD FILTER) AND LOSER-TREE K-WAY MERGE */
+
+#ifndef topk_h
+#define topk_h
+#include "wrappers.h"
+#include "heap.h"
+#include "dary_heap.h"
+#include "typed_heap.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ TOP-K: the K largest elements of a stream under compare, in O(K) memory.
+   the kept elements sit in a K-element min heap (DARY_HEAP), so the root is the threshold: the
+   smallest element still kept. a newcomer that does not beat it is dropped after one compare; one
+   that does replaces the root in a single reheap down (dary_heap_replace_min).
+   for the K smallest pass a reversed compare, as with DHEAP's max heap.
+ TOP-K over int32 keys (TOPK_INT): the same heap of {key, position} records inline (TYPED_HEAP),
+ MAX or MIN chosen at creation. once the heap is full almost nothing beats the threshold, so a
+ block of 8 keys is tested against it at once (AVX2 compare + movemask, a plain loop without
+ AVX2) and only blocks holding a candidate reach the heap.
+   keys are stored as key ^ flip, flip = 0 for MAX and ~0 for MIN (~x reverses the int32 order
+   without overflow): one code path keeps the K largest of the flipped keys.
+ both are built on DARY_HEAP / TYPED_HEAP rather than DHEAP: a bounded heap replaces its root on
+ almost every accepted element, and DHEAP has no replace (get_root + insert is two reheaps).
+ K-WAY MERGE: a loser tree over k sorted runs, standalone rather than a heap of run heads. each
+ internal node keeps the loser of the match played there, the winner goes on up; the overall
+ winner is the next output. replacing it with the next element of its run replays only its
+ leaf-to-root path against the stored losers: log2(k) compares, one per level, where a heap of
+ run heads needs up to two per level.
+ */
+#define TOPK_BLOCK 8
+
+typedef struct topk
+{
+    DARY_HEAP *heap;
+    int k;
+    int (*compare)(void *arg1, void *arg2);
+    uint64_t seen;
+}TOPK;
+
+typedef struct topk_entry
+{
+    int32_t key;//flipped
+    uint64_t index;//position in the stream
+}TOPK_ENTRY;
+
+#define TOPK_ENTRY_LESS(a, b) ((a)->key < (b)->key)
+TYPED_HEAP(TOPK_HEAP, topk_heap, TOPK_ENTRY, TOPK_ENTRY_LESS, 4)
+
+typedef struct topk_int
+{
+    TOPK_HEAP *heap;
+    int k;
+    int32_t flip;//0: K largest, ~0: K smallest
+    uint64_t seen;
+    uint64_t filtered;//keys dropped by the block test without touching the heap
+}TOPK_INT;
+
+typedef struct loser_tree
+{
+    int (*compare)(void *arg1, void *arg2);
+    int k;//runs, rounded up to a power of 2 with empty runs
+    int *tree;//tree[1..k-1]: loser run at each match, tree[0]: overall winner
+    void ***runs;
+    int *lengths;
+    int *pos;
+    void **heads;//runs[i][pos[i]], NULL once run i is used up
+}LOSER_TREE;
+
+TOPK *create_topk(int k, int (*compare)(void *arg1, void *arg2));
+bool topk_push(TOPK *t, void *data_in);
+int topk_result(TOPK *t, void **out);
+void destroy_topk(TOPK *t);
+TOPK_INT *create_topk_int(int k, HEAP_TYPE keep);
+void topk_int_feed(TOPK_INT *t, const int32_t *keys, int n);
+int topk_int_result(TOPK_INT *t, int32_t *keys, uint64_t *indices);
+void destroy_topk_int(TOPK_INT *t);
+void _topk_int_offer(TOPK_INT *t, int32_t flipped, uint64_t index);
+LOSER_TREE *create_loser_tree(void ***runs, int *lengths, int k, int (*compare)(void *arg1, void *arg2));
+void *loser_tree_next(LOSER_TREE *lt);
+void destroy_loser_tree(LOSER_TREE *lt);
+bool _loser_tree_beats(LOSER_TREE *lt, int a, int b);
+
+TOPK *create_topk(int k, int (*compare)(void *arg1, void *arg2))
+{
+    TOPK *t = (TOPK*)Malloc(sizeof(TOPK));
+
+    t->k = k > 0 ? k : 1;
+    t->compare = compare;
+    t->heap = create_dary_heap(4, t->k, compare);
+    t->seen = 0;
+    return t;
+}
+
+//true if data_in is (for now) among the K largest
+bool topk_push(TOPK *t, void *data_in)
+{
+    t->seen++;
+    if(t->heap->count < t->k)
+    {
+        dary_heap_insert(t->heap, data_in);
+        return true;
+    }
+    if(t->compare(data_in, t->heap->ary[0]) <= 0)
+        return false;
+    dary_heap_replace_min(t->heap, data_in);
+    return true;
+}
+
+//empties t into out, largest first; returns how many
+int topk_result(TOPK *t, void **out)
+{
+    int n = t->heap->count;
+
+    for(int i = n - 1; i >= 0; i--)
+        out[i] = dary_heap_get_min(t->heap);
+    return n;
+}
+
+void destroy_topk(TOPK *t)
+{
+    destroy_dary_heap(t->heap);
+    free(t);
+}
+
+TOPK_INT *create_topk_int(int k, HEAP_TYPE keep)
+{
+    TOPK_INT *t = (TOPK_INT*)Malloc(sizeof(TOPK_INT));
+
+    t->k = k > 0 ? k : 1;
+    t->flip = keep == MIN ? ~0 : 0;
+    t->heap = create_topk_heap(t->k);
+    t->seen = 0;
+    t->filtered = 0;
+    return t;
+}
+
+void _topk_int_offer(TOPK_INT *t, int32_t flipped, uint64_t index)
+{
+    TOPK_ENTRY entry, out;
+
+    entry.key = flipped;
+    entry.index = index;
+    if(t->heap->count < t->k)
+        topk_heap_insert(t->heap, entry);
+    else if(flipped > t->heap->ary[0].key)
+        topk_heap_replace_min(t->heap, entry, &out);
+}
+
+//the next n keys of the stream
+void topk_int_feed(TOPK_INT *t, const int32_t *keys, int n)
+{
+    int i = 0, bits;
+    uint64_t base = t->seen;
+    int32_t threshold;
+
+    //fill the heap first: until then there is no threshold
+    for(; i < n && t->heap->count < t->k; i++)
+        _topk_int_offer(t, keys[i] ^ t->flip, base + i);
+#if defined(__AVX2__)
+    __m256i flip = _mm256_set1_epi32(t->flip), v;
+    for(; i + TOPK_BLOCK <= n; i += TOPK_BLOCK)
+    {
+        threshold = t->heap->ary[0].key;
+        v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), flip);
+        bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, _mm256_set1_epi32(threshold))));
+        if(!bits)
+        {
+            t->filtered += TOPK_BLOCK;
+            continue;
+        }
+        //the threshold rises as candidates go in: offer them one by one
+        for(; bits; bits &= bits - 1)
+            _topk_int_offer(t, keys[i + __builtin_ctz(bits)] ^ t->flip, base + i + __builtin_ctz(bits));
+    }
+#else
+    for(; i + TOPK_BLOCK <= n; i += TOPK_BLOCK)
+    {
+        threshold = t->heap->ary[0].key;
+        bits = 0;
+        for(int j = 0; j < TOPK_BLOCK; j++)
+            bits |= ((keys[i + j] ^ t->flip) > threshold) << j;
+        if(!bits)
+        {
+            t->filtered += TOPK_BLOCK;
+            continue;
+        }
+        for(; bits; bits &= bits - 1)
+            _topk_int_offer(t, keys[i + __builtin_ctz(bits)] ^ t->flip, base + i + __builtin_ctz(bits));
+    }
+#endif
+    for(; i < n; i++)
+        _topk_int_offer(t, keys[i] ^ t->flip, base + i);
+    t->seen += n;
+}
+
+//empties t, best first (largest for MAX, smallest for MIN); returns how many
+int topk_int_result(TOPK_INT *t, int32_t *keys, uint64_t *indices)
+{
+    TOPK_ENTRY entry;
+    int n = t->heap->count, i = n;
+
+    //the heap pops the worst kept first: fill from the back
+    while(i > 0 && topk_heap_get_min(t->heap, &entry))
+    {
+        i--;
+        keys[i] = entry.key ^ t->flip;
+        if(indices)
+            indices[i] = entry.index;
+    }
+    return n;
+}
+
+void destroy_topk_int(TOPK_INT *t)
+{
+    destroy_topk_heap(t->heap);
+    free(t);
+}
+
+//run a's head comes out before run b's: an exhausted run loses to everything, ties go to the lower run
+bool _loser_tree_beats(LOSER_TREE *lt, int a, int b)
+{
+    int c;
+
+    if(!lt->heads[b])
+        return true;
+    if(!lt->heads[a])
+        return false;
+    c = lt->compare(lt->heads[a], lt->heads[b]);
+    return c < 0 || (c == 0 && a < b);
+}
+
+//runs[i] holds lengths[i] elements sorted ascending under compare; the tree reads them in place
+LOSER_TREE *create_loser_tree(void ***runs, int *lengths, int k, int (*compare)(void *arg1, void *arg2))
+{
+    LOSER_TREE *lt = (LOSER_TREE*)Malloc(sizeof(LOSER_TREE));
+    int *winner, leaves = 1;
+
+    while(leaves < k)
+        leaves *= 2;
+    lt->compare = compare;
+    lt->k = leaves;
+    lt->tree = (int*)Malloc(leaves*sizeof(int));
+    lt->runs = (void***)Calloc(leaves, sizeof(void**));
+    lt->lengths = (int*)Calloc(leaves, sizeof(int));
+    lt->pos = (int*)Calloc(leaves, sizeof(int));
+    memcpy(lt->runs, runs, k*sizeof(void**));
+    memcpy(lt->lengths, lengths, k*sizeof(int));
+    lt->heads = (void**)Malloc(leaves*sizeof(void*));
+    for(int i = 0; i < leaves; i++)
+        lt->heads[i] = lt->lengths[i] > 0 ? lt->runs[i][0] : NULL;
+    //initial tournament bottom up: winner[n] of the subtree at n, leaves at leaves..2*leaves-1
+    winner = (int*)Malloc(2*leaves*sizeof(int));
+    for(int i = 0; i < leaves; i++)
+        winner[leaves + i] = i;
+    for(int n = leaves - 1; n >= 1; n--)
+    {
+        int a = winner[2*n], b = winner[2*n + 1];
+        if(_loser_tree_beats(lt, a, b))
+        {
+            winner[n] = a;
+            lt->tree[n] = b;
+        }
+        else
+        {
+            winner[n] = b;
+            lt->tree[n] = a;
+        }
+    }
+    lt->tree[0] = winner[1];
+    free(winner);
+    return lt;
+}
+
+//next element in merged order, NULL when every run is used up
+void *loser_tree_next(LOSER_TREE *lt)
+{
+    int w = lt->tree[0], hold;
+    void *out;
+
+    if(!(out = lt->heads[w]))
+        return NULL;
+    lt->heads[w] = ++lt->pos[w] < lt->lengths[w] ? lt->runs[w][lt->pos[w]] : NULL;
+    //replay w's path with its next element
+    for(int n = (lt->k + w)/2; n >= 1; n /= 2)
+    {
+        if(_loser_tree_beats(lt, lt->tree[n], w))
+        {
+            hold = lt->tree[n];
+            lt->tree[n] = w;
+            w = hold;
+        }
+    }
+    lt->tree[0] = w;
+    return out;
+}
+
+void destroy_loser_tree(LOSER_TREE *lt)
+{
+    free(lt->tree);
+    free(lt->runs);
+    free(lt->lengths);
+    free(lt->pos);
+    free(lt->heads);
+    free(lt);
+}
+#endif /* topk_h */
@@ -0,0 +1,150 @@
+/* TYPED MIN HEAP GENERATED PER ELEMENT TYPE: ELEMENTS INLINE, COMPARE INLINED */
+
+#ifndef typed_heap_h
+#define typed_heap_h
+#include "wrappers.h"
+
+/*
+ HEAP_ADT, DHEAP and DARY_HEAP store void* and call compare through a pointer: every compare is
+ an indirect call plus a load from wherever the element lives. AHEAP avoids both by hard-coding
+ INTR. TYPED_HEAP does the same for any type: one expansion writes a heap for that type and that
+ order, with the elements themselves in one contiguous array.
+
+   TYPED_HEAP(EVENT_HEAP, event_heap, EVENT, event_less, 4)
+ expands to the struct EVENT_HEAP and
+   EVENT_HEAP *create_event_heap(int size);
+   void event_heap_insert(EVENT_HEAP *heap, EVENT data_in);
+   bool event_heap_get_min(EVENT_HEAP *heap, EVENT *data_out);//false when empty
+   EVENT *event_heap_peek(EVENT_HEAP *heap);//NULL when empty
+   bool event_heap_replace_min(EVENT_HEAP *heap, EVENT data_in, EVENT *data_out);//get_min + insert
+   void event_heap_build(EVENT_HEAP *heap, const EVENT *data, int n);
+   void destroy_event_heap(EVENT_HEAP *heap);
+ less(const type *a, const type *b) is true when a comes out first; a macro or a function the
+ compiler can see, so it is inlined into the reheap loops. d (a power of 2) is a constant: the
+ child loop unrolls. the layout is DARY_HEAP's: the array starts d-1 elements into a cache-aligned
+ block, so a sibling group never straddles a line when d*sizeof(type) divides CACHE_LINE_SIZE
+ (e.g. 4 x 16-byte records, 8 x 8 bytes, 16 ints). reheaps move a hole; the array doubles.
+ */
+#define TYPED_HEAP(HEAP, prefix, type, less, d) \
+typedef struct prefix##_struct \
+{ \
+    int size;/*capacity*/ \
+    int count; \
+    type *block;/*aligned allocation*/ \
+    type *ary;/*block + d-1: ary[0] is the root*/ \
+}HEAP; \
+\
+void _##prefix##_resize(HEAP *heap, int size) \
+{ \
+    type *block = (type*)Malloc_aligned(CACHE_LINE_SIZE, ((size_t)size + (d) - 1)*sizeof(type)); \
+    if(heap->block) \
+    { \
+        memcpy(block + (d) - 1, heap->ary, (size_t)heap->count*sizeof(type)); \
+        free(heap->block); \
+    } \
+    heap->block = block; \
+    heap->ary = block + (d) - 1; \
+    heap->size = size; \
+} \
+\
+HEAP *create_##prefix(int size) \
+{ \
+    HEAP *heap = (HEAP*)Malloc(sizeof(HEAP)); \
+    heap->count = 0; \
+    heap->block = NULL; \
+    _##prefix##_resize(heap, size > 0 ? size : 16); \
+    return heap; \
+} \
+\
+void _##prefix##_reheap_down(HEAP *heap, int hole, type data) \
+{ \
+    type *ary = heap->ary; \
+    int count = heap->count, child, smallest; \
+    while((child = (d)*hole + 1) < count) \
+    { \
+        smallest = child; \
+        if(child + (d) <= count)/*full group: fixed trip count*/ \
+        { \
+            for(int i = 1; i < (d); i++) \
+                smallest = less(&ary[child + i], &ary[smallest]) ? child + i : smallest; \
+        } \
+        else \
+        { \
+            for(int i = child + 1; i < count; i++) \
+                smallest = less(&ary[i], &ary[smallest]) ? i : smallest; \
+        } \
+        if(!less(&ary[smallest], &data)) \
+            break; \
+        ary[hole] = ary[smallest]; \
+        hole = smallest; \
+    } \
+    ary[hole] = data; \
+} \
+\
+void prefix##_insert(HEAP *heap, type data_in) \
+{ \
+    type *ary; \
+    int hole, parent; \
+    if(heap->count == heap->size) \
+        _##prefix##_resize(heap, heap->size*2); \
+    ary = heap->ary; \
+    hole = heap->count++; \
+    while(hole) \
+    { \
+        parent = (hole - 1)/(d); \
+        if(!less(&data_in, &ary[parent])) \
+            break; \
+        ary[hole] = ary[parent]; \
+        hole = parent; \
+    } \
+    ary[hole] = data_in; \
+} \
+\
+bool prefix##_get_min(HEAP *heap, type *data_out) \
+{ \
+    if(heap->count == 0) \
+        return false; \
+    *data_out = heap->ary[0]; \
+    heap->count--; \
+    if(heap->count) \
+        _##prefix##_reheap_down(heap, 0, heap->ary[heap->count]); \
+    return true; \
+} \
+\
+type *prefix##_peek(HEAP *heap) \
+{ \
+    return heap->count ? &heap->ary[0] : NULL; \
+} \
+\
+bool prefix##_replace_min(HEAP *heap, type data_in, type *data_out) \
+{ \
+    if(heap->count == 0) \
+    { \
+        prefix##_insert(heap, data_in); \
+        return false; \
+    } \
+    *data_out = heap->ary[0]; \
+    _##prefix##_reheap_down(heap, 0, data_in); \
+    return true; \
+} \
+\
+void prefix##_build(HEAP *heap, const type *data, int n) \
+{ \
+    int size = heap->size; \
+    while(heap->count + n > size) \
+        size *= 2; \
+    if(size != heap->size) \
+        _##prefix##_resize(heap, size); \
+    memcpy(heap->ary + heap->count, data, (size_t)n*sizeof(type)); \
+    heap->count += n; \
+    for(int i = (heap->count - 2)/(d); i >= 0 && heap->count > 1; i--) \
+        _##prefix##_reheap_down(heap, i, heap->ary[i]); \
+} \
+\
+void destroy_##prefix(HEAP *heap) \
+{ \
+    free(heap->block); \
+    free(heap); \
+}
+
+#endif /* typed_heap_h */
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
@@ -55,6 +56,21 @@ void *Realloc(void *ptr, size_t numMembers)
     return newptr;
 }
 
+#define CACHE_LINE_SIZE 64
+
+//alignment must be a power of 2 and a multiple of sizeof(void*), e.g. a cache line.
+void *Malloc_aligned(size_t alignment, size_t size)
+{
+    void *ptr;
+    
+    if(posix_memalign(&ptr, alignment, size) != 0)
+    {
+        MALLOC_ERROR;
+        exit(101);
+    }
+    return ptr;
+}
+
 void *Calloc(size_t numMembers, size_t size)
 {
     void *ptr;